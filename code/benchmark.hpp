@@ -0,0 +1,235 @@
+/**
+ * @file benchmark.hpp
+ * @brief Statistics of repeated query runs for the benchmark driver
+ * (simdops_query_bench, query.cpp built with BENCHMARK_DRIVER=1): the driver
+ * runs the query BENCH_WARMUP times unmeasured and BENCH_REPETITIONS times
+ * measured on the same tables and reports median, p95, min, avg and max of
+ * the query, every section and every thread group. With BENCH_CSV and / or
+ * BENCH_JSON set, the samples' statistics are also written to these files.
+ * With BENCH_SWEEP set, the driver instead measures every point of a grid of
+ * table sizes and query settings (see sweep_grid), with BENCH_TUNE set it
+ * tunes the placement of the stages (see placement.hpp).
+ */
+
+#pragma once
+
+#ifndef BENCHMARK_DRIVER
+#define BENCHMARK_DRIVER 0
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../modules/json/single_include/nlohmann/json.hpp"
+
+namespace vampir {
+
+/// @brief Settings of the benchmark driver, read from the environment.
+struct benchmark_config {
+  size_t warmup = 2;
+  size_t repetitions = 10;
+  /// output files, empty for none
+  std::string csv_path;
+  std::string json_path;
+
+  static benchmark_config from_env() {
+    benchmark_config config;
+    if (const char *value = std::getenv("BENCH_WARMUP"))
+      config.warmup = std::stoul(value);
+    if (const char *value = std::getenv("BENCH_REPETITIONS"))
+      config.repetitions = std::stoul(value);
+    if (const char *value = std::getenv("BENCH_CSV"))
+      config.csv_path = value;
+    if (const char *value = std::getenv("BENCH_JSON"))
+      config.json_path = value;
+    if (config.repetitions == 0)
+      throw std::invalid_argument("BENCH_REPETITIONS must be greater than 0");
+    return config;
+  }
+};
+
+/// @brief Order statistics of the samples of one measurement.
+struct sample_stats {
+  size_t count = 0;
+  double min = 0.0;
+  double median = 0.0;
+  double p95 = 0.0;
+  double avg = 0.0;
+  double max = 0.0;
+
+  /// @brief p95 is the nearest rank (the smallest sample >= 95% of all).
+  static sample_stats of(std::vector<double> samples) {
+    sample_stats stats;
+    if (samples.empty())
+      return stats;
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    stats.count = n;
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.median = n % 2 == 1 ? samples[n / 2]
+                              : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    stats.p95 = samples[std::min(n - 1, (95 * n + 99) / 100 - 1)];
+    double sum = 0.0;
+    for (double sample : samples)
+      sum += sample;
+    stats.avg = sum / n;
+    return stats;
+  }
+};
+
+/// @brief Collects one sample (in seconds) per measured repetition for every
+/// measurement, grouped by kind ("query", "section", "group").
+class BenchmarkStats {
+private:
+  /// (kind, name) -> samples, in order of the first sample
+  std::vector<std::pair<std::string, std::string>> order;
+  std::map<std::pair<std::string, std::string>, std::vector<double>> samples;
+
+public:
+  void add(const std::string &kind, const std::string &name, double seconds) {
+    auto key = std::make_pair(kind, name);
+    auto it = samples.find(key);
+    if (it == samples.end()) {
+      order.push_back(key);
+      it = samples.emplace(key, std::vector<double>()).first;
+    }
+    it->second.push_back(seconds);
+  }
+
+  sample_stats stats(const std::string &kind, const std::string &name) const {
+    auto it = samples.find(std::make_pair(kind, name));
+    return it == samples.end() ? sample_stats() : sample_stats::of(it->second);
+  }
+
+  /// @brief Names of the measurements of kind, in order of their first sample.
+  std::vector<std::string> names(const std::string &kind) const {
+    std::vector<std::string> result;
+    for (const auto &key : order)
+      if (key.first == kind)
+        result.push_back(key.second);
+    return result;
+  }
+
+  void print(std::ostream &out) const {
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "%-8s %-32s %5s %12s %12s %12s %12s %12s\n", "kind", "name",
+                  "n", "median [s]", "p95 [s]", "min [s]", "avg [s]",
+                  "max [s]");
+    out << line;
+    for (const auto &key : order) {
+      const sample_stats s = sample_stats::of(samples.at(key));
+      std::snprintf(line, sizeof(line),
+                    "%-8s %-32s %5zu %12.8f %12.8f %12.8f %12.8f %12.8f\n",
+                    key.first.c_str(), key.second.c_str(), s.count, s.median,
+                    s.p95, s.min, s.avg, s.max);
+      out << line;
+    }
+  }
+
+  static constexpr const char *csv_header =
+      "kind,name,count,median_s,p95_s,min_s,avg_s,max_s";
+
+  /// @brief One line per measurement (see csv_header), each starting with
+  /// prefix + ',' if prefix is not empty (e.g. the parameters of a sweep).
+  void write_csv_rows(std::ostream &out, const std::string &prefix = "") const {
+    for (const auto &key : order) {
+      const sample_stats s = sample_stats::of(samples.at(key));
+      if (!prefix.empty())
+        out << prefix << ',';
+      out << key.first << ',' << key.second << ',' << s.count << ','
+          << s.median << ',' << s.p95 << ',' << s.min << ',' << s.avg << ','
+          << s.max << '\n';
+    }
+  }
+
+  void write_csv(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file)
+      throw std::runtime_error("Could not write benchmark results " + path);
+    file << csv_header << '\n';
+    write_csv_rows(file);
+  }
+
+  /// @brief {"query": {"query": {...}}, "section": {name: {...}}, ...} with
+  /// the statistics and the raw samples of every measurement.
+  void write_json(const std::string &path,
+                  const nlohmann::json &meta = nlohmann::json::object()) const {
+    std::ofstream file(path);
+    if (!file)
+      throw std::runtime_error("Could not write benchmark results " + path);
+    nlohmann::json result = {{"meta", meta}};
+    for (const auto &key : order) {
+      const auto &values = samples.at(key);
+      const sample_stats s = sample_stats::of(values);
+      result[key.first][key.second] = {
+          {"count", s.count}, {"median_s", s.median}, {"p95_s", s.p95},
+          {"min_s", s.min},   {"avg_s", s.avg},       {"max_s", s.max},
+          {"samples_s", values}};
+    }
+    file << result.dump(2) << std::endl;
+  }
+};
+
+/**
+ * @brief Grid of the parameter sweep of the benchmark driver (BENCH_SWEEP
+ * set). Every dimension is a comma separated list in the environment, unset
+ * dimensions only contain the default value:
+ * SWEEP_DATA_AMOUNT (rows of r), SWEEP_FK_RANGE (fk range / size of s, i.e.
+ * 1 / selectivity), SWEEP_MEMORY (HBM, DRAM or AUTO placement of r),
+ * SWEEP_THREADS (threads per group) and SWEEP_MORSEL_SEGMENTS (0 for static
+ * split).
+ */
+struct sweep_grid {
+  std::vector<size_t> data_amounts;
+  std::vector<size_t> fk_range_factors;
+  std::vector<std::string> memories;
+  std::vector<uint32_t> thread_counts;
+  std::vector<size_t> morsel_segments;
+
+  static sweep_grid from_env(size_t data_amount, size_t fk_range_factor,
+                             uint32_t thread_count, size_t morsel_segments) {
+    sweep_grid grid;
+    grid.data_amounts = _list<size_t>("SWEEP_DATA_AMOUNT", data_amount);
+    grid.fk_range_factors = _list<size_t>("SWEEP_FK_RANGE", fk_range_factor);
+    grid.memories = _list<std::string>("SWEEP_MEMORY", "AUTO");
+    grid.thread_counts = _list<uint32_t>("SWEEP_THREADS", thread_count);
+    grid.morsel_segments =
+        _list<size_t>("SWEEP_MORSEL_SEGMENTS", morsel_segments);
+    return grid;
+  }
+
+private:
+  template <typename T>
+  static std::vector<T> _list(const char *variable, T default_value) {
+    const char *value = std::getenv(variable);
+    if (value == nullptr || *value == '\0')
+      return {default_value};
+    std::vector<T> result;
+    std::string list = value;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+      size_t end = list.find(',', pos);
+      if (end == std::string::npos)
+        end = list.size();
+      const std::string item = list.substr(pos, end - pos);
+      if constexpr (std::is_same_v<T, std::string>)
+        result.push_back(item);
+      else
+        result.push_back(static_cast<T>(std::stoull(item)));
+      pos = end + 1;
+    }
+    return result;
+  }
+};
+
+} // namespace vampir
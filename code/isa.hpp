@@ -0,0 +1,104 @@
+/**
+ * @file isa.hpp
+ * @brief Instruction set variants of the query. The kernels are written
+ * against the TSL processing extension QUERY_ISA (query_ext in query.hpp),
+ * which defaults to the widest one enabled by the compiler flags. With
+ * ISA_DISPATCH (CMake, on by default) the query is built once per variant
+ * (bin/simdops_query_scalar, _avx2 and _avx512, compiled for x86-64-v2, -v3
+ * and -v4) and bin/simdops_query is a launcher that runs the widest variant
+ * the CPU supports, or the one named by QUERY_ISA in the environment (see
+ * query_launcher.cpp). Separate binaries instead of one with all variants
+ * linked in, as inline code shared by the variants (the standard library,
+ * vmalloc, the thread manager) would otherwise be deduplicated by the linker
+ * into a copy possibly compiled for AVX-512.
+ */
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#ifndef QUERY_ISA
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__) &&  \
+    defined(__AVX512VL__)
+#define QUERY_ISA avx512
+#elif defined(__AVX2__)
+#define QUERY_ISA avx2
+#else
+#define QUERY_ISA scalar
+#endif
+#endif
+
+#define QUERY_ISA_STRING_(isa) #isa
+#define QUERY_ISA_STRING(isa) QUERY_ISA_STRING_(isa)
+
+namespace vampir {
+
+/// instruction set variants, narrowest first
+enum class Isa { SCALAR, AVX2, AVX512 };
+
+/// @brief Name of the variant, also the suffix of its binary and the TSL
+/// extension it uses.
+inline std::string isa_to_string(Isa isa) {
+  switch (isa) {
+  case Isa::SCALAR:
+    return "scalar";
+  case Isa::AVX2:
+    return "avx2";
+  case Isa::AVX512:
+    return "avx512";
+  }
+  throw std::invalid_argument("No string representation for ISA " +
+                              std::to_string(static_cast<int>(isa)));
+}
+
+inline Isa isa_from_string(const std::string &str) {
+  if (str == "scalar")
+    return Isa::SCALAR;
+  else if (str == "avx2")
+    return Isa::AVX2;
+  else if (str == "avx512")
+    return Isa::AVX512;
+  throw std::invalid_argument("Unknown ISA: " + str +
+                              " (scalar, avx2 or avx512)");
+}
+
+/// the variant this translation unit is compiled for
+inline const Isa compiled_isa = isa_from_string(QUERY_ISA_STRING(QUERY_ISA));
+
+/// @brief Whether the CPU runs code compiled for the microarchitecture level
+/// of the variant (x86-64-v2, -v3 or -v4, see CMakeLists.txt).
+inline bool cpu_supports(Isa isa) {
+  __builtin_cpu_init();
+  switch (isa) {
+  case Isa::SCALAR:
+    return __builtin_cpu_supports("x86-64-v2");
+  case Isa::AVX2:
+    return __builtin_cpu_supports("x86-64-v3");
+  case Isa::AVX512:
+    return __builtin_cpu_supports("x86-64-v4");
+  }
+  return false;
+}
+
+/**
+ * @brief The variant to run: requested (the value of QUERY_ISA) if not
+ * nullptr, the widest one the CPU supports otherwise.
+ * @throws std::invalid_argument if requested is unknown
+ * @throws std::runtime_error if the CPU does not support requested
+ */
+inline Isa select_isa(const char *requested) {
+  if (requested != nullptr && *requested != '\0') {
+    const Isa isa = isa_from_string(requested);
+    if (!cpu_supports(isa))
+      throw std::runtime_error("The CPU does not support the " +
+                               isa_to_string(isa) + " variant");
+    return isa;
+  }
+  for (Isa isa : {Isa::AVX512, Isa::AVX2})
+    if (cpu_supports(isa))
+      return isa;
+  return Isa::SCALAR;
+}
+
+} // namespace vampir
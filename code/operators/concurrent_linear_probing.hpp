@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// pulls in the TSL
+#include "algorithms/dbops/filter/filter.hpp"
+
+namespace vampir {
+
+/// @brief Semi-join hash table (right side) with linear probing that can be
+/// filled by many threads at once. The interface mirrors
+/// tuddbs::Hash_Semi_Join_RightSide_SIMD_Linear_Probing (builder_t/prober_t
+/// over a key and a used array), but the table layout is its own: a table
+/// built by this builder has to be probed by this prober.
+///
+/// used[slot] holds the state of a slot: empty, claimed (a thread won the CAS
+/// and is writing the key) or filled. Both arrays have to be zeroed before the
+/// first insert. The slot count has to be a power of two of at least 2 (and
+/// below 2^30, the prober gathers the states with 32 bit indices), see
+/// bucket_count_for.
+///
+/// The build inserts one key at a time (CAS). The prober tests a vector of
+/// keys against their home slots with gathers; only the keys whose home slot
+/// holds another key continue along their probe sequence one by one.
+/// @tparam HSStyle TSL processing style (base type uint32_t).
+/// @tparam position_t Type of the emitted positions.
+template <class HSStyle, typename position_t = std::size_t>
+class Hash_Semi_Join_RightSide_Concurrent_Linear_Probing {
+public:
+  using key_t = typename HSStyle::base_type;
+  static_assert(sizeof(key_t) == sizeof(uint32_t), "32 bit keys only");
+
+  static constexpr uint64_t slot_empty = 0;
+  static constexpr uint64_t slot_claimed = 1;
+  static constexpr uint64_t slot_filled = 2;
+  static constexpr uint32_t key_hash = 0x9E3779B1u;
+
+  /// @brief Slot count of a table for key_count keys (load factor <= 0.5).
+  static std::size_t bucket_count_for(std::size_t key_count) {
+    return std::bit_ceil(std::max<std::size_t>(key_count * 2, 2));
+  }
+
+  /// @brief Maps a key onto [0, 2^log2_buckets) (fibonacci hashing, the top
+  /// bits of the product).
+  static inline std::size_t bucket(key_t key, uint32_t log2_buckets) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(key) * key_hash) >>
+           (32 - log2_buckets);
+  }
+
+  class builder_t {
+  private:
+    key_t *key_sink;
+    uint64_t *used_sink;
+    std::size_t bucket_count;
+    uint32_t log2_buckets;
+
+  public:
+    builder_t(key_t *key_sink, uint64_t *used_sink, std::size_t bucket_count)
+        : key_sink(key_sink), used_sink(used_sink), bucket_count(bucket_count),
+          log2_buckets(std::countr_zero(bucket_count)) {}
+
+    /// @brief Inserts count keys. Safe to call concurrently from many threads
+    /// on the same table. Duplicate keys are stored once.
+    /// @return false if the table ran full.
+    bool operator()(const key_t *data, std::size_t count) {
+      for (std::size_t i = 0; i < count; ++i) {
+        if (!insert(data[i]))
+          return false;
+      }
+      return true;
+    }
+
+  private:
+    bool insert(key_t key) {
+      std::size_t slot = bucket(key, log2_buckets);
+      for (std::size_t probes = 0; probes < bucket_count; ++probes) {
+        std::atomic_ref<uint64_t> state(used_sink[slot]);
+        uint64_t current = state.load(std::memory_order_acquire);
+
+        if (current == slot_empty) {
+          if (state.compare_exchange_strong(current, slot_claimed,
+                                            std::memory_order_acq_rel)) {
+            key_sink[slot] = key;
+            state.store(slot_filled, std::memory_order_release);
+            return true;
+          }
+          // lost the race, current now holds the winners state
+        }
+        // the winner of a slot publishes its key right after the CAS
+        while (current == slot_claimed)
+          current = state.load(std::memory_order_acquire);
+
+        if (key_sink[slot] == key)
+          return true; // inserted by another thread (or duplicate in input)
+
+        slot = (slot + 1) & (bucket_count - 1);
+      }
+      return false;
+    }
+  };
+
+  class prober_t {
+  private:
+    const key_t *keys;
+    const uint64_t *used;
+    std::size_t bucket_count;
+    uint32_t log2_buckets;
+
+  public:
+    prober_t(const key_t *keys, const uint64_t *used, std::size_t bucket_count)
+        : keys(keys), used(used), bucket_count(bucket_count),
+          log2_buckets(bucket_count == 0 ? 0 : std::countr_zero(bucket_count)) {}
+
+    /// @brief Writes the positions (relative to data) of all keys contained in
+    /// the table to position_sink.
+    /// @return number of written positions
+    std::size_t operator()(position_t *position_sink, const key_t *data,
+                           std::size_t count) const {
+      if (bucket_count == 0)
+        return 0;
+      constexpr std::size_t lanes = HSStyle::vector_element_count();
+      std::size_t hits = 0;
+      if constexpr (lanes == 1) {
+        for (std::size_t i = 0; i < count; ++i) {
+          position_sink[hits] = i;
+          hits += contains(data[i]);
+        }
+        return hits;
+      }
+
+      // the low half of a state (little endian) is enough to tell empty
+      const key_t *states = reinterpret_cast<const key_t *>(used);
+
+      const auto hash = tsl::set1<HSStyle>(key_hash);
+      const auto zero = tsl::set1<HSStyle>(0);
+
+      std::size_t i = 0;
+      for (; i + lanes <= count; i += lanes) {
+        const auto probe_keys = tsl::loadu<HSStyle>(data + i);
+        const auto slots = tsl::shift_right<HSStyle>(
+            tsl::mul<HSStyle>(probe_keys, hash), 32 - log2_buckets);
+        const auto slot_keys = tsl::gather<HSStyle>(keys, slots);
+        const auto slot_states =
+            tsl::gather<HSStyle>(states, tsl::add<HSStyle>(slots, slots));
+
+        const uint64_t equal = static_cast<uint64_t>(tsl::to_integral<HSStyle>(
+            tsl::equal<HSStyle>(slot_keys, probe_keys)));
+        const uint64_t empty = static_cast<uint64_t>(tsl::to_integral<HSStyle>(
+            tsl::equal<HSStyle>(slot_states, zero)));
+        uint64_t found = equal & ~empty;
+        // home slot filled with another key -> follow the probe sequence
+        for (uint64_t open = ~(equal | empty) & lane_bits(lanes); open != 0;
+             open &= open - 1) {
+          const std::size_t lane = std::countr_zero(open);
+          if (contains(data[i + lane], bucket(data[i + lane], log2_buckets) + 1))
+            found |= uint64_t(1) << lane;
+        }
+        for (; found != 0; found &= found - 1)
+          position_sink[hits++] = i + std::countr_zero(found);
+      }
+      for (; i < count; ++i) {
+        position_sink[hits] = i;
+        hits += contains(data[i]);
+      }
+      return hits;
+    }
+
+    bool contains(key_t key) const {
+      if (bucket_count == 0)
+        return false;
+      return contains(key, bucket(key, log2_buckets));
+    }
+
+  private:
+    static constexpr uint64_t lane_bits(std::size_t lanes) {
+      return lanes >= 64 ? ~uint64_t(0) : (uint64_t(1) << lanes) - 1;
+    }
+
+    /// @brief Follows the probe sequence of key from slot on.
+    bool contains(key_t key, std::size_t slot) const {
+      // a probe sequence ends at the first empty slot (or after a full round
+      // if the table is completely filled)
+      for (std::size_t probes = 0; probes < bucket_count; ++probes) {
+        slot &= bucket_count - 1;
+        if (used[slot] == slot_empty)
+          return false;
+        if (keys[slot] == key)
+          return true;
+        ++slot;
+      }
+      return false;
+    }
+  };
+};
+
+} // namespace vampir
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vmalloc/VamPointer.hpp"
+
+namespace vampir {
+
+/// @brief Column type of the scans (one size_t per segment, e.g.
+/// join_result::lengths). The exclusive scan over them is a two-pass block
+/// scan: the threads scan their slivers locally (fused into the probe, see
+/// probing_with_offsets), the sliver totals are scanned serially and the
+/// threads add the base of their sliver.
+using scan_column_t = VamPointer<size_t, sizeof(size_t)>;
+
+/// @brief Turns the sliver totals into the base of each sliver (exclusive
+/// prefix sum, in place). Is run single threaded between the two passes, it
+/// only touches one value per thread.
+/// @return the total over all slivers
+inline size_t scan_sliver_totals(scan_column_t totals) {
+  size_t sum = 0;
+  for (size_t i = 0; i < totals.size(); i++) {
+    const size_t total = totals[i];
+    totals[i] = sum;
+    sum += total;
+  }
+  return sum;
+}
+
+/// @brief Second (fixup) pass: adds the base of the sliver (sliver_base[0],
+/// see scan_sliver_totals) to its sliver local offsets.
+inline void add_sliver_base(scan_column_t result, scan_column_t sliver_base) {
+  const size_t base = sliver_base[0];
+  if (base == 0 || result.size() == 0)
+    return;
+  size_t *out = result.data(0);
+  for (size_t i = 0; i < result.size(); i++)
+    out[i] += base;
+}
+
+} // namespace vampir
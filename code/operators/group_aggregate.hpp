@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vampir {
+
+/// @brief One group of a Group_Sum_Table.
+struct group_slot {
+  uint32_t key;
+  uint32_t used;
+  int64_t sum;
+};
+
+/// @brief (key, value) of a row (GroupStrategy::PARTITIONED) or of a group
+/// of a thread-local table (LOCAL), written to the runs of the partitions.
+struct group_pair {
+  uint32_t key;
+  int64_t value;
+};
+
+/// @brief Hash aggregation of int64_t sums by uint32_t key: open addressing
+/// with linear probing over a power of 2 slots, doubled when half of them
+/// are used (so a table sized for the expected groups never grows).
+class Group_Sum_Table {
+private:
+  std::vector<group_slot> slots;
+  std::size_t mask = 0;
+  std::size_t groups = 0;
+
+  static std::size_t capacity_for(std::size_t expected_groups) {
+    std::size_t capacity = 16;
+    while (capacity < 2 * expected_groups)
+      capacity *= 2;
+    return capacity;
+  }
+
+  /// @brief Fibonacci hashing onto the slots.
+  std::size_t slot_of(uint32_t key) const {
+    return (static_cast<uint64_t>(key * 0x9E3779B1u) * slots.size()) >> 32;
+  }
+
+  void grow() {
+    std::vector<group_slot> old = std::move(slots);
+    slots.assign(old.size() * 2, group_slot{0, 0, 0});
+    mask = slots.size() - 1;
+    groups = 0;
+    for (const group_slot &slot : old)
+      if (slot.used)
+        add(slot.key, slot.sum);
+  }
+
+public:
+  explicit Group_Sum_Table(std::size_t expected_groups = 0)
+      : slots(capacity_for(expected_groups), group_slot{0, 0, 0}),
+        mask(slots.size() - 1) {}
+
+  std::size_t size() const { return groups; }
+
+  std::size_t size_bytes() const { return slots.size() * sizeof(group_slot); }
+
+  void add(uint32_t key, int64_t value) {
+    std::size_t slot = slot_of(key);
+    while (slots[slot].used && slots[slot].key != key)
+      slot = (slot + 1) & mask;
+    if (!slots[slot].used) {
+      if (2 * (groups + 1) > slots.size()) {
+        grow();
+        add(key, value);
+        return;
+      }
+      slots[slot] = group_slot{key, 1, 0};
+      ++groups;
+    }
+    slots[slot].sum += value;
+  }
+
+  /// @brief Adds values[j] to the group of keys[j] for j < count.
+  void add(const uint32_t *keys, const int64_t *values, std::size_t count) {
+    for (std::size_t j = 0; j < count; ++j)
+      add(keys[j], values[j]);
+  }
+
+  /// @brief Calls func(key, sum) for every group (in slot order).
+  template <typename F> void for_each(F &&func) const {
+    for (const group_slot &slot : slots)
+      if (slot.used)
+        func(slot.key, slot.sum);
+  }
+};
+
+/// @brief Groups and their sums, ascending by key.
+struct grouped_sums {
+  std::vector<uint32_t> keys;
+  std::vector<int64_t> sums;
+
+  std::size_t size() const { return keys.size(); }
+
+  bool operator==(const grouped_sums &other) const {
+    return keys == other.keys && sums == other.sums;
+  }
+};
+
+enum class GroupStrategy {
+  LOCAL,       ///< one cache sized Group_Sum_Table per thread, merged
+  PARTITIONED, ///< rows partitioned by key range per thread, aggregated per
+               ///< partition by the merge (high cardinality)
+  AUTO         ///< LOCAL if the expected groups fit group_local_table_bytes
+};
+
+/// @brief Bytes of a thread-local table the expected groups of
+/// GroupStrategy::AUTO have to fit into (about the L2 cache).
+constexpr std::size_t group_local_table_bytes = 256 * 1024;
+
+inline GroupStrategy resolve_group_strategy(GroupStrategy strategy,
+                                            std::size_t expected_groups) {
+  if (strategy != GroupStrategy::AUTO)
+    return strategy;
+  return Group_Sum_Table(expected_groups).size_bytes() <=
+                 group_local_table_bytes
+             ? GroupStrategy::LOCAL
+             : GroupStrategy::PARTITIONED;
+}
+
+/**
+ * @brief Parallel SUM(value) GROUP BY key in two phases, each run by a thread
+ * group: the aggregation threads add their rows to thread-local state (see
+ * add) and split it into runs per partition, a contiguous range of the key
+ * domain (see finish), then merge thread p aggregates the runs of partition
+ * p of all threads (see merge_partition). The thread-local state is
+ * allocated by its thread on first use, so it lies on that thread's NUMA
+ * node, and every merge thread builds its partition on its own node. The
+ * merged partitions are ordered by key, so result only concatenates them.
+ */
+class GroupedSum {
+private:
+  /// @brief State of one aggregation thread (own cache lines).
+  struct alignas(64) local_state {
+    bool initialized = false;
+    Group_Sum_Table table;
+    std::vector<std::vector<group_pair>> partitions;
+  };
+
+  GroupStrategy strategy = GroupStrategy::LOCAL;
+  uint32_t min_key = 0;
+  uint64_t key_range = 1;
+  std::size_t expected_groups = 0;
+  std::vector<local_state> locals;
+  std::vector<grouped_sums> merged;
+
+  local_state &local(std::size_t thread) {
+    local_state &state = locals[thread];
+    if (!state.initialized) {
+      if (strategy == GroupStrategy::LOCAL)
+        state.table = Group_Sum_Table(expected_groups);
+      else
+        state.partitions.resize(merged.size());
+      state.initialized = true;
+    }
+    return state;
+  }
+
+public:
+  /// @param threads aggregation threads (values of thread in add)
+  /// @param partitions merge threads (values of partition in merge_partition)
+  GroupedSum(std::size_t threads, std::size_t partitions)
+      : locals(threads), merged(partitions) {
+    if (threads == 0 || partitions == 0)
+      throw std::invalid_argument(
+          "GroupedSum needs at least one thread and one partition");
+  }
+
+  /**
+   * @brief Sets the strategy (resolved with resolve_group_strategy) and the
+   * key domain [min_key, max_key] (keys outside of it go to the first or last
+   * partition), before the first add.
+   */
+  void plan(GroupStrategy group_strategy, uint32_t min_key, uint32_t max_key,
+            std::size_t expected_groups) {
+    this->strategy = resolve_group_strategy(group_strategy, expected_groups);
+    this->min_key = min_key;
+    this->key_range = max_key >= min_key ? uint64_t(max_key) - min_key + 1 : 1;
+    this->expected_groups = expected_groups;
+  }
+
+  GroupStrategy get_strategy() const { return strategy; }
+
+  std::size_t partition_count() const { return merged.size(); }
+
+  std::size_t partition_of(uint32_t key) const {
+    if (key < min_key)
+      return 0;
+    const uint64_t offset = std::min<uint64_t>(key - min_key, key_range - 1);
+    return offset * merged.size() / key_range;
+  }
+
+  /// @brief Adds values[j] to the group of keys[j] for j < count, called by
+  /// aggregation thread thread only.
+  void add(std::size_t thread, const uint32_t *keys, const int64_t *values,
+           std::size_t count) {
+    local_state &state = local(thread);
+    if (strategy == GroupStrategy::LOCAL) {
+      state.table.add(keys, values, count);
+      return;
+    }
+    for (std::size_t j = 0; j < count; ++j)
+      state.partitions[partition_of(keys[j])].push_back({keys[j], values[j]});
+  }
+
+  /// @brief Ends the adds of aggregation thread thread. With
+  /// GroupStrategy::LOCAL its table is scattered into runs per partition
+  /// once (like the rows of PARTITIONED), so every merge thread reads only
+  /// the groups of its partition instead of all tables.
+  void finish(std::size_t thread) {
+    local_state &state = locals[thread];
+    if (!state.initialized || strategy != GroupStrategy::LOCAL)
+      return;
+    state.partitions.resize(merged.size());
+    state.table.for_each([&](uint32_t key, int64_t sum) {
+      state.partitions[partition_of(key)].push_back({key, sum});
+    });
+    state.table = Group_Sum_Table();
+  }
+
+  /// @brief Aggregates partition over all threads, called by one merge
+  /// thread per partition after all threads finished their adds.
+  void merge_partition(std::size_t partition) {
+    Group_Sum_Table table(strategy == GroupStrategy::LOCAL
+                              ? expected_groups / merged.size() + 1
+                              : 0);
+    for (const local_state &state : locals) {
+      if (!state.initialized)
+        continue;
+      for (const group_pair &pair : state.partitions[partition])
+        table.add(pair.key, pair.value);
+    }
+
+    std::vector<std::pair<uint32_t, int64_t>> groups;
+    groups.reserve(table.size());
+    table.for_each(
+        [&](uint32_t key, int64_t sum) { groups.emplace_back(key, sum); });
+    std::sort(groups.begin(), groups.end());
+    grouped_sums &result = merged[partition];
+    result.keys.clear();
+    result.sums.clear();
+    for (const auto &[key, sum] : groups) {
+      result.keys.push_back(key);
+      result.sums.push_back(sum);
+    }
+  }
+
+  /// @brief All groups, after every partition has been merged.
+  grouped_sums result() const {
+    grouped_sums all;
+    for (const grouped_sums &partition : merged) {
+      all.keys.insert(all.keys.end(), partition.keys.begin(),
+                      partition.keys.end());
+      all.sums.insert(all.sums.end(), partition.sums.begin(),
+                      partition.sums.end());
+    }
+    return all;
+  }
+
+  /// @brief Bytes of the runs read by the merge (each run by one merge
+  /// thread).
+  std::size_t local_bytes() const {
+    std::size_t bytes = 0;
+    for (const local_state &state : locals) {
+      for (const auto &partition : state.partitions)
+        bytes += partition.size() * sizeof(group_pair);
+    }
+    return bytes;
+  }
+};
+
+} // namespace vampir
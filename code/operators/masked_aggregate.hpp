@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// pulls in the TSL
+#include "algorithms/dbops/filter/filter.hpp"
+
+namespace vampir {
+
+/// @brief Returns the mask bits of the lanes starting at row i from a
+/// selection bitmask (bit i % 64 of word i / 64 selects row i).
+template <std::size_t lanes>
+inline uint64_t mask_lanes(const uint64_t *mask, std::size_t i) {
+  static_assert(64 % lanes == 0, "vectors must not straddle mask words");
+  constexpr uint64_t lane_bits =
+      lanes == 64 ? ~uint64_t(0) : (uint64_t(1) << lanes) - 1;
+  return (mask[i >> 6] >> (i & 63)) & lane_bits;
+}
+
+/// @brief Number of 64 bit mask words for count rows.
+inline std::size_t mask_word_count(std::size_t count) {
+  return (count + 63) / 64;
+}
+
+/// @brief result[i] = a[i] * b[i] for the rows selected by mask, 0 otherwise.
+/// Works on the base columns directly, so no materialization is needed.
+/// @tparam HSStyle TSL processing style.
+template <class HSStyle> class Masked_Multiply {
+public:
+  using base_t = typename HSStyle::base_type;
+
+  void operator()(base_t *result, const base_t *a, std::size_t count,
+                  const base_t *b, const uint64_t *mask) const {
+    constexpr std::size_t lanes = HSStyle::vector_element_count();
+    const auto zero = tsl::set_zero<HSStyle>();
+
+    std::size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+      const auto product = tsl::mul<HSStyle>(tsl::loadu<HSStyle>(a + i),
+                                             tsl::loadu<HSStyle>(b + i));
+      const auto selected =
+          tsl::to_mask<HSStyle>(mask_lanes<lanes>(mask, i));
+      tsl::storeu<HSStyle>(result + i,
+                           tsl::blend<HSStyle>(selected, zero, product));
+    }
+    for (; i < count; ++i)
+      result[i] = ((mask[i >> 6] >> (i & 63)) & 1) ? a[i] * b[i] : 0;
+  }
+};
+
+/// @brief *result = sum of data[i] over the rows selected by mask.
+/// @tparam HSStyle TSL processing style.
+template <class HSStyle> class Masked_Sum {
+public:
+  using base_t = typename HSStyle::base_type;
+
+  void operator()(base_t *result, const base_t *data, std::size_t count,
+                  const uint64_t *mask) const {
+    constexpr std::size_t lanes = HSStyle::vector_element_count();
+    const auto zero = tsl::set_zero<HSStyle>();
+    auto sum = zero;
+
+    std::size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+      const auto selected =
+          tsl::to_mask<HSStyle>(mask_lanes<lanes>(mask, i));
+      sum = tsl::add<HSStyle>(
+          sum, tsl::blend<HSStyle>(selected, zero,
+                                   tsl::loadu<HSStyle>(data + i)));
+    }
+    base_t scalar_sum = tsl::hadd<HSStyle>(sum);
+    for (; i < count; ++i)
+      scalar_sum += ((mask[i >> 6] >> (i & 63)) & 1) ? data[i] : 0;
+    *result = scalar_sum;
+  }
+};
+
+} // namespace vampir
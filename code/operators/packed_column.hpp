@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// pulls in the TSL
+#include "algorithms/dbops/filter/filter.hpp"
+#include "semi_join_filter.hpp"
+#include "vmalloc/VamPointer.hpp"
+
+namespace vampir {
+
+/// @brief Unpacks bit-packed, frame-of-reference encoded values: value k is
+/// stored in BITS bits starting at bit k * BITS of words (least significant
+/// bit first) and decodes to reference + value k.
+/// @tparam HSStyle TSL processing style (unsigned base type = word type).
+/// @tparam BITS bits per value.
+template <class HSStyle, std::size_t BITS> class Unpack_FOR {
+public:
+  using word_t = typename HSStyle::base_type;
+  static constexpr std::size_t word_bits = 8 * sizeof(word_t);
+  static_assert(std::is_unsigned_v<word_t>, "words have to be unsigned");
+  static_assert(BITS > 0 && BITS < word_bits, "BITS has to fit into a word");
+  static constexpr word_t value_mask = (word_t(1) << BITS) - 1;
+
+  /// @brief Value k (without the reference).
+  static word_t unpack(const word_t *words, std::size_t k) {
+    const std::size_t offset = k * BITS;
+    const std::size_t shift = offset % word_bits;
+    word_t value = words[offset / word_bits] >> shift;
+    if (shift + BITS > word_bits)
+      value |= words[offset / word_bits + 1] << (word_bits - shift);
+    return value & value_mask;
+  }
+
+  /// @brief Writes the first count values of words to result. Each lane
+  /// gathers the word of the first and of the last bit of its value, so no
+  /// word after the last value is read. Single lane styles (tsl::scalar) use
+  /// unpack, as their shifts by word_bits would be undefined.
+  void operator()(word_t *result, const word_t *words, std::size_t count,
+                  word_t reference) const {
+    constexpr std::size_t lanes = HSStyle::vector_element_count();
+    if constexpr (lanes == 1) {
+      for (std::size_t i = 0; i < count; ++i)
+        result[i] = reference + unpack(words, i);
+      return;
+    }
+    alignas(64) static constexpr auto bit_offsets = [] {
+      auto offsets = lane_sequence<word_t, lanes>();
+      for (auto &offset : offsets)
+        offset *= BITS;
+      return offsets;
+    }();
+    constexpr int log2_word_bits = std::countr_zero(word_bits);
+
+    const auto step = tsl::set1<HSStyle>(lanes * BITS);
+    const auto last_bit = tsl::set1<HSStyle>(BITS - 1);
+    const auto low_bits = tsl::set1<HSStyle>(word_bits - 1);
+    const auto word_width = tsl::set1<HSStyle>(word_bits);
+    const auto mask = tsl::set1<HSStyle>(value_mask);
+    const auto base = tsl::set1<HSStyle>(reference);
+    auto offset = tsl::loadu<HSStyle>(bit_offsets.data());
+
+    std::size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+      const auto first_word = tsl::gather<HSStyle>(
+          words, tsl::shift_right<HSStyle>(offset, log2_word_bits));
+      const auto last_word = tsl::gather<HSStyle>(
+          words, tsl::shift_right<HSStyle>(tsl::add<HSStyle>(offset, last_bit),
+                                           log2_word_bits));
+      const auto shift = tsl::binary_and<HSStyle>(offset, low_bits);
+      // a value within one word shifts its own word out of the mask (the
+      // variable vector shifts, vpsllv / vpsrlv, yield 0 for shifts by
+      // word_bits)
+      const auto value = tsl::binary_or<HSStyle>(
+          tsl::shift_right_individual<HSStyle>(first_word, shift),
+          tsl::shift_left_individual<HSStyle>(
+              last_word, tsl::sub<HSStyle>(word_width, shift)));
+      tsl::storeu<HSStyle>(
+          result + i,
+          tsl::add<HSStyle>(tsl::binary_and<HSStyle>(value, mask), base));
+      offset = tsl::add<HSStyle>(offset, step);
+    }
+    for (; i < count; ++i)
+      result[i] = reference + unpack(words, i);
+  }
+};
+
+/**
+ * @brief Bit-packed, frame-of-reference compressed column: every segment of
+ * segment_rows values is stored as the offsets to the segment's minimum in
+ * BITS bits each, plus a header with the minimum, maximum and row count of
+ * the segment. Words and headers are VamPointers with one segment per
+ * column segment, so a PackedColumn splits (and is placed by vmalloc) like a
+ * VamPointer<T, segment_rows * sizeof(T)> of the same values.
+ * @tparam T value type (integral)
+ * @tparam BITS bits per value; segments whose range does not fit cannot be
+ * packed (see pack_segment)
+ */
+template <typename T, std::size_t BITS> class PackedColumn {
+public:
+  using value_t = T;
+  using word_t = std::make_unsigned_t<T>;
+  static constexpr std::size_t bits = BITS;
+  static constexpr std::size_t segment_rows = 512;
+  static constexpr std::size_t segment_bytes = segment_rows * BITS / 8;
+  static constexpr std::size_t segment_words = segment_bytes / sizeof(word_t);
+  static_assert(segment_rows * BITS % (8 * sizeof(word_t)) == 0,
+                "segments have to end at word boundaries");
+
+  struct segment_header {
+    T min = 0;
+    T max = 0;
+    uint32_t rows = 0;
+  };
+
+  using words_t = VamPointer<word_t, segment_bytes>;
+  using headers_t = VamPointer<segment_header, sizeof(segment_header)>;
+  template <class HSStyle> using unpacker_t = Unpack_FOR<HSStyle, BITS>;
+
+private:
+  words_t words;
+  headers_t headers;
+
+public:
+  PackedColumn() = default;
+  PackedColumn(words_t words, headers_t headers)
+      : words(std::move(words)), headers(std::move(headers)) {}
+
+  /// @brief Number of words of a column of rows values (allocate the words
+  /// and segment_count_for(rows) headers like the plain column, e.g. with the
+  /// same sliver_cpus, so the packed slivers are placed the same way).
+  static std::size_t word_count_for(std::size_t rows) {
+    return segment_count_for(rows) * segment_words;
+  }
+
+  static std::size_t segment_count_for(std::size_t rows) {
+    return (rows + segment_rows - 1) / segment_rows;
+  }
+
+  bool empty() const { return headers.size() == 0; }
+
+  std::size_t segment_count() const { return headers.size(); }
+
+  /// packed bytes (words and headers) read by a full scan
+  std::size_t size_bytes() const {
+    return words.size() * sizeof(word_t) +
+           headers.size() * sizeof(segment_header);
+  }
+
+  const segment_header &header(std::size_t i) const {
+    return *headers.data(i);
+  }
+
+  const word_t *segment_words_of(std::size_t i) const {
+    return words.data(i * segment_words);
+  }
+
+  /// @brief Splits like VamPointer::split (words and headers have the same
+  /// segment count, so sliver i covers the same segments in both).
+  std::vector<PackedColumn> split(std::size_t sliver_count) {
+    return split<0>(sliver_count);
+  }
+
+  /// @brief Same as split(sliver_count) (the block size of a SplitWrapper is
+  /// always a segment).
+  template <std::size_t __ignore>
+  std::vector<PackedColumn> split(std::size_t sliver_count) {
+    auto word_slivers = words.split(sliver_count);
+    auto header_slivers = headers.split(sliver_count);
+    std::vector<PackedColumn> slivers;
+    slivers.reserve(sliver_count);
+    for (std::size_t i = 0; i < sliver_count; i++)
+      slivers.emplace_back(std::move(word_slivers[i]),
+                           std::move(header_slivers[i]));
+    return slivers;
+  }
+
+  /// @brief Decodes segment i into out (segment_rows elements).
+  /// @return rows of the segment
+  template <class HSStyle> std::size_t unpack_segment(std::size_t i,
+                                                      T *out) const {
+    const segment_header &h = header(i);
+    unpacker_t<HSStyle>()(reinterpret_cast<word_t *>(out),
+                          segment_words_of(i), h.rows, word_t(h.min));
+    return h.rows;
+  }
+
+  /// @brief Packs rows values into the words (segment_words) and header of
+  /// one segment.
+  /// @return false if the range of the values does not fit into BITS bits
+  /// (nothing has been written to words)
+  static bool pack_segment(const T *values, std::size_t rows, word_t *out,
+                           segment_header &h) {
+    if (rows == 0) {
+      h = segment_header();
+      return true;
+    }
+    constexpr word_t value_mask = (word_t(1) << BITS) - 1;
+    const auto [min, max] = std::minmax_element(values, values + rows);
+    if (word_t(*max) - word_t(*min) > value_mask)
+      return false;
+    h = segment_header{*min, *max, static_cast<uint32_t>(rows)};
+
+    constexpr std::size_t word_bits = 8 * sizeof(word_t);
+    std::fill(out, out + segment_words, word_t(0));
+    for (std::size_t k = 0; k < rows; k++) {
+      const word_t value = word_t(values[k]) - word_t(*min);
+      const std::size_t offset = k * BITS;
+      const std::size_t shift = offset % word_bits;
+      out[offset / word_bits] |= value << shift;
+      if (shift + BITS > word_bits)
+        out[offset / word_bits + 1] |= value >> (word_bits - shift);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Packs one sliver of a column (run by a thread group with values
+   * and packed wrapped in a SplitWrapper, see pack_table).
+   * @param base first value of the whole column
+   * @param count rows of the whole column (the last sliver may extend past
+   * them, see VamPointer::split)
+   * @param fits is cleared if a segment does not fit
+   */
+  template <std::size_t S>
+  static void pack_sliver(VamPointer<T, S> values, PackedColumn packed,
+                          const T *base, std::size_t count,
+                          std::atomic<bool> *fits) {
+    static_assert(S == segment_rows * sizeof(T),
+                  "values have to be split like the packed column");
+    if (values.size() == 0)
+      return;
+    const std::size_t first_row = values.data(0) - base;
+    for (std::size_t i = 0; i < packed.segment_count(); i++) {
+      const std::size_t row = first_row + i * segment_rows;
+      const std::size_t rows =
+          row < count ? std::min(segment_rows, count - row) : 0;
+      if (!pack_segment(values.data(0) + i * segment_rows, rows,
+                        packed.words.data(i * segment_words),
+                        *packed.headers.data(i))) {
+        fits->store(false, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+};
+
+} // namespace vampir
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// pulls in the TSL
+#include "algorithms/dbops/filter/filter.hpp"
+
+namespace vampir {
+
+/// @brief Returns {0, 1, ..., N-1}, used as lane offsets for SIMD positions.
+template <typename T, std::size_t N> constexpr std::array<T, N> lane_sequence() {
+  std::array<T, N> result{};
+  for (std::size_t i = 0; i < N; ++i)
+    result[i] = static_cast<T>(i);
+  return result;
+}
+
+/// @brief Clears the selection bitmask of count rows (bit i % 64 of word
+/// i / 64 selects row i).
+inline void clear_mask(uint64_t *mask, std::size_t count) {
+  std::fill(mask, mask + (count + 63) / 64, uint64_t(0));
+}
+
+/// @brief Sets a bit in a filter word; atomically if several threads insert
+/// into the same filter.
+template <bool CONCURRENT>
+inline void set_filter_bits(uint32_t *word, uint32_t bits) {
+  if constexpr (CONCURRENT)
+    std::atomic_ref<uint32_t>(*word).fetch_or(bits, std::memory_order_relaxed);
+  else
+    *word |= bits;
+}
+
+/// @brief Register-blocked Bloom filter for 32 bit keys: every key sets
+/// (and tests) 3 bits within a single 32 bit word, so a lookup is one gather
+/// and one compare per lane. log2_word_count() sizes the filter with
+/// bits_per_key bits per key, which keeps it in L1/L2 for build sides of up
+/// to some 100K keys.
+/// @tparam HSStyle TSL processing style (base type uint32_t).
+template <class HSStyle> class Blocked_Bloom_Filter {
+public:
+  using key_t = typename HSStyle::base_type;
+  static_assert(sizeof(key_t) == sizeof(uint32_t), "32 bit keys only");
+
+  static constexpr std::size_t bits_per_key = 16;
+  static constexpr uint32_t word_hash = 0x9E3779B1u;
+  static constexpr uint32_t bit_hash = 0x85EBCA6Bu;
+
+  /// @brief log2 of the number of filter words for key_count keys.
+  static uint32_t log2_word_count(std::size_t key_count) {
+    std::size_t words = (key_count * bits_per_key + 31) / 32;
+    const auto bits = std::bit_width(std::bit_ceil(std::max<std::size_t>(words, 1)));
+    return std::max<uint32_t>(4, static_cast<uint32_t>(bits) - 1);
+  }
+
+  static inline uint32_t word_index(key_t key, uint32_t log2_words) {
+    return (static_cast<uint32_t>(key) * word_hash) >> (32 - log2_words);
+  }
+
+  static inline uint32_t pattern(key_t key) {
+    const uint32_t hash = static_cast<uint32_t>(key) * bit_hash;
+    return (1u << (hash >> 27)) | (1u << ((hash >> 22) & 31)) |
+           (1u << ((hash >> 17) & 31));
+  }
+
+  class builder_t {
+  private:
+    uint32_t *words;
+    uint32_t log2_words;
+
+  public:
+    builder_t(uint32_t *words, uint32_t log2_words)
+        : words(words), log2_words(log2_words) {}
+
+    template <bool CONCURRENT = false>
+    void insert(const key_t *data, std::size_t count) {
+      for (std::size_t i = 0; i < count; ++i) {
+        set_filter_bits<CONCURRENT>(&words[word_index(data[i], log2_words)],
+                                    pattern(data[i]));
+      }
+    }
+  };
+
+  class prober_t {
+  private:
+    const uint32_t *words;
+    uint32_t log2_words;
+
+  public:
+    prober_t(const uint32_t *words, uint32_t log2_words)
+        : words(words), log2_words(log2_words) {}
+
+    /// @brief Compresses all keys that may be contained (and their positions
+    /// relative to data) into candidate_keys/candidate_positions.
+    /// @return number of candidates
+    std::size_t operator()(key_t *candidate_keys, uint32_t *candidate_positions,
+                           const key_t *data, std::size_t count) const {
+      constexpr std::size_t lanes = HSStyle::vector_element_count();
+      alignas(64) static constexpr auto sequence = lane_sequence<key_t, lanes>();
+
+      const auto word_mul = tsl::set1<HSStyle>(word_hash);
+      const auto bit_mul = tsl::set1<HSStyle>(bit_hash);
+      const auto one = tsl::set1<HSStyle>(1);
+      const auto low_bits = tsl::set1<HSStyle>(31);
+      auto position = tsl::loadu<HSStyle>(sequence.data());
+      const auto step = tsl::set1<HSStyle>(lanes);
+
+      std::size_t candidates = 0;
+      std::size_t i = 0;
+      for (; i + lanes <= count; i += lanes) {
+        const auto keys = tsl::loadu<HSStyle>(data + i);
+
+        const auto index =
+            tsl::shift_right<HSStyle>(tsl::mul<HSStyle>(keys, word_mul),
+                                      32 - log2_words);
+        const auto word = tsl::gather<HSStyle>(words, index);
+
+        const auto hash = tsl::mul<HSStyle>(keys, bit_mul);
+        const auto bits = tsl::binary_or<HSStyle>(
+            tsl::shift_left_individual<HSStyle>(
+                one, tsl::shift_right<HSStyle>(hash, 27)),
+            tsl::binary_or<HSStyle>(
+                tsl::shift_left_individual<HSStyle>(
+                    one, tsl::binary_and<HSStyle>(
+                             tsl::shift_right<HSStyle>(hash, 22), low_bits)),
+                tsl::shift_left_individual<HSStyle>(
+                    one, tsl::binary_and<HSStyle>(
+                             tsl::shift_right<HSStyle>(hash, 17), low_bits))));
+
+        const auto hit =
+            tsl::equal<HSStyle>(tsl::binary_and<HSStyle>(word, bits), bits);
+        tsl::compress_store<HSStyle>(hit, candidate_keys + candidates, keys);
+        tsl::compress_store<HSStyle>(hit, candidate_positions + candidates,
+                                     position);
+        candidates += std::popcount(
+            static_cast<uint64_t>(tsl::to_integral<HSStyle>(hit)));
+        position = tsl::add<HSStyle>(position, step);
+      }
+      for (; i < count; ++i) {
+        const uint32_t bits = pattern(data[i]);
+        candidate_keys[candidates] = data[i];
+        candidate_positions[candidates] = i;
+        candidates +=
+            (words[word_index(data[i], log2_words)] & bits) == bits;
+      }
+      return candidates;
+    }
+  };
+};
+
+/// @brief Bitmap over a dense key domain [min_key, min_key + key_range). Is
+/// exact, so a key passing the bitmap does not need a hash table probe.
+/// The bitmap needs (key_range / 32) + 1 words; the last bit (key_range) is
+/// never set and catches all keys outside the domain.
+/// @tparam HSStyle TSL processing style (base type uint32_t).
+template <class HSStyle> class Dense_Bitmap_Filter {
+public:
+  using key_t = typename HSStyle::base_type;
+  static_assert(sizeof(key_t) == sizeof(uint32_t), "32 bit keys only");
+
+  static std::size_t word_count(std::size_t key_range) {
+    return key_range / 32 + 1;
+  }
+
+  class builder_t {
+  private:
+    uint32_t *words;
+    key_t min_key;
+
+  public:
+    builder_t(uint32_t *words, key_t min_key)
+        : words(words), min_key(min_key) {}
+
+    template <bool CONCURRENT = false>
+    void insert(const key_t *data, std::size_t count) {
+      for (std::size_t i = 0; i < count; ++i) {
+        const uint32_t offset = data[i] - min_key;
+        set_filter_bits<CONCURRENT>(&words[offset >> 5], 1u << (offset & 31));
+      }
+    }
+  };
+
+  class prober_t {
+  private:
+    const uint32_t *words;
+    key_t min_key;
+    uint32_t key_range;
+
+  public:
+    prober_t(const uint32_t *words, key_t min_key, uint32_t key_range)
+        : words(words), min_key(min_key), key_range(key_range) {}
+
+    inline bool contains(key_t key) const {
+      const uint32_t offset = std::min<uint32_t>(key - min_key, key_range);
+      return (words[offset >> 5] >> (offset & 31)) & 1;
+    }
+
+    /// @brief Compresses all contained keys (and their positions relative to
+    /// data) into candidate_keys/candidate_positions.
+    /// @return number of contained keys
+    std::size_t operator()(key_t *candidate_keys, uint32_t *candidate_positions,
+                           const key_t *data, std::size_t count) const {
+      constexpr std::size_t lanes = HSStyle::vector_element_count();
+      alignas(64) static constexpr auto sequence = lane_sequence<key_t, lanes>();
+
+      const auto min = tsl::set1<HSStyle>(min_key);
+      const auto range = tsl::set1<HSStyle>(key_range);
+      const auto one = tsl::set1<HSStyle>(1);
+      const auto low_bits = tsl::set1<HSStyle>(31);
+      auto position = tsl::loadu<HSStyle>(sequence.data());
+      const auto step = tsl::set1<HSStyle>(lanes);
+
+      std::size_t candidates = 0;
+      std::size_t i = 0;
+      for (; i + lanes <= count; i += lanes) {
+        const auto keys = tsl::loadu<HSStyle>(data + i);
+        // keys below min_key wrap around and are clamped like keys above
+        const auto offset =
+            tsl::min<HSStyle>(tsl::sub<HSStyle>(keys, min), range);
+        const auto word = tsl::gather<HSStyle>(
+            words, tsl::shift_right<HSStyle>(offset, 5));
+        const auto bit = tsl::binary_and<HSStyle>(
+            tsl::shift_right_individual<HSStyle>(
+                word, tsl::binary_and<HSStyle>(offset, low_bits)),
+            one);
+
+        const auto hit = tsl::equal<HSStyle>(bit, one);
+        tsl::compress_store<HSStyle>(hit, candidate_keys + candidates, keys);
+        tsl::compress_store<HSStyle>(hit, candidate_positions + candidates,
+                                     position);
+        candidates += std::popcount(
+            static_cast<uint64_t>(tsl::to_integral<HSStyle>(hit)));
+        position = tsl::add<HSStyle>(position, step);
+      }
+      for (; i < count; ++i) {
+        candidate_keys[candidates] = data[i];
+        candidate_positions[candidates] = i;
+        candidates += contains(data[i]);
+      }
+      return candidates;
+    }
+
+    /// @brief Writes the selection bitmask of data: bit i is set if data[i]
+    /// is contained.
+    /// @return number of contained keys
+    std::size_t mask(uint64_t *mask_sink, const key_t *data,
+                     std::size_t count) const {
+      constexpr std::size_t lanes = HSStyle::vector_element_count();
+      static_assert(64 % lanes == 0, "vectors must not straddle mask words");
+
+      const auto min = tsl::set1<HSStyle>(min_key);
+      const auto range = tsl::set1<HSStyle>(key_range);
+      const auto one = tsl::set1<HSStyle>(1);
+      const auto low_bits = tsl::set1<HSStyle>(31);
+
+      clear_mask(mask_sink, count);
+      std::size_t hits = 0;
+      std::size_t i = 0;
+      for (; i + lanes <= count; i += lanes) {
+        const auto keys = tsl::loadu<HSStyle>(data + i);
+        const auto offset =
+            tsl::min<HSStyle>(tsl::sub<HSStyle>(keys, min), range);
+        const auto word = tsl::gather<HSStyle>(
+            words, tsl::shift_right<HSStyle>(offset, 5));
+        const auto bit = tsl::binary_and<HSStyle>(
+            tsl::shift_right_individual<HSStyle>(
+                word, tsl::binary_and<HSStyle>(offset, low_bits)),
+            one);
+
+        const uint64_t hit = static_cast<uint64_t>(
+            tsl::to_integral<HSStyle>(tsl::equal<HSStyle>(bit, one)));
+        mask_sink[i >> 6] |= hit << (i & 63);
+        hits += std::popcount(hit);
+      }
+      for (; i < count; ++i) {
+        const uint64_t hit = contains(data[i]);
+        mask_sink[i >> 6] |= hit << (i & 63);
+        hits += hit;
+      }
+      return hits;
+    }
+  };
+};
+
+/// @brief Range test for a build side that contains every key of its domain
+/// [min_key, min_key + key_range); no memory is touched besides the probed
+/// keys.
+/// @tparam HSStyle TSL processing style (base type uint32_t).
+template <class HSStyle> class Dense_Range_Filter {
+public:
+  using key_t = typename HSStyle::base_type;
+
+  class prober_t {
+  private:
+    key_t min_key;
+    uint32_t key_range;
+
+  public:
+    prober_t(key_t min_key, uint32_t key_range)
+        : min_key(min_key), key_range(key_range) {}
+
+    inline bool contains(key_t key) const {
+      return static_cast<uint32_t>(key - min_key) < key_range;
+    }
+
+    /// @brief Compresses all contained keys (and their positions relative to
+    /// data) into candidate_keys/candidate_positions.
+    /// @return number of contained keys
+    std::size_t operator()(key_t *candidate_keys, uint32_t *candidate_positions,
+                           const key_t *data, std::size_t count) const {
+      constexpr std::size_t lanes = HSStyle::vector_element_count();
+      alignas(64) static constexpr auto sequence = lane_sequence<key_t, lanes>();
+
+      const auto min = tsl::set1<HSStyle>(min_key);
+      const auto range = tsl::set1<HSStyle>(key_range);
+      auto position = tsl::loadu<HSStyle>(sequence.data());
+      const auto step = tsl::set1<HSStyle>(lanes);
+
+      std::size_t candidates = 0;
+      std::size_t i = 0;
+      for (; i + lanes <= count; i += lanes) {
+        const auto keys = tsl::loadu<HSStyle>(data + i);
+        // unsigned compare, keys below min_key wrap around
+        const auto hit = tsl::less_than<HSStyle>(
+            tsl::sub<HSStyle>(keys, min), range);
+        tsl::compress_store<HSStyle>(hit, candidate_keys + candidates, keys);
+        tsl::compress_store<HSStyle>(hit, candidate_positions + candidates,
+                                     position);
+        candidates += std::popcount(
+            static_cast<uint64_t>(tsl::to_integral<HSStyle>(hit)));
+        position = tsl::add<HSStyle>(position, step);
+      }
+      for (; i < count; ++i) {
+        candidate_keys[candidates] = data[i];
+        candidate_positions[candidates] = i;
+        candidates += contains(data[i]);
+      }
+      return candidates;
+    }
+
+    /// @brief Writes the selection bitmask of data: bit i is set if data[i]
+    /// is contained.
+    /// @return number of contained keys
+    std::size_t mask(uint64_t *mask_sink, const key_t *data,
+                     std::size_t count) const {
+      constexpr std::size_t lanes = HSStyle::vector_element_count();
+      static_assert(64 % lanes == 0, "vectors must not straddle mask words");
+
+      const auto min = tsl::set1<HSStyle>(min_key);
+      const auto range = tsl::set1<HSStyle>(key_range);
+
+      clear_mask(mask_sink, count);
+      std::size_t hits = 0;
+      std::size_t i = 0;
+      for (; i + lanes <= count; i += lanes) {
+        const auto keys = tsl::loadu<HSStyle>(data + i);
+        const uint64_t hit = static_cast<uint64_t>(tsl::to_integral<HSStyle>(
+            tsl::less_than<HSStyle>(tsl::sub<HSStyle>(keys, min), range)));
+        mask_sink[i >> 6] |= hit << (i & 63);
+        hits += std::popcount(hit);
+      }
+      for (; i < count; ++i) {
+        const uint64_t hit = contains(data[i]);
+        mask_sink[i >> 6] |= hit << (i & 63);
+        hits += hit;
+      }
+      return hits;
+    }
+  };
+};
+
+} // namespace vampir
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <type_traits>
+
+// pulls in the TSL
+#include "algorithms/dbops/filter/filter.hpp"
+
+namespace vampir {
+
+/// @brief Whether ptr is aligned for a (non-temporal) vector store.
+template <std::size_t bytes> inline bool vector_aligned(const void *ptr) {
+  return reinterpret_cast<uintptr_t>(ptr) % bytes == 0;
+}
+
+/// @brief Stores vec to ptr (aligned to the vector size) bypassing the
+/// caches, so no cache line is read for ownership. Falls back to an aligned
+/// store for other than AVX2 / AVX-512 registers (e.g. the scalar variant).
+template <class HSStyle, typename V>
+inline void stream_store(typename HSStyle::base_type *ptr, const V &vec) {
+#ifdef __AVX512F__
+  if constexpr (std::is_same_v<V, __m512i>)
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(ptr), vec);
+  else
+#endif
+#ifdef __AVX2__
+  if constexpr (std::is_same_v<V, __m256i>)
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(ptr), vec);
+  else
+#endif
+    tsl::store<HSStyle>(ptr, vec);
+}
+
+/// @brief Orders the streaming stores of the calling thread before its later
+/// stores (e.g. the completion of its thread group or morsel), so the threads
+/// of the next stage see the written data.
+inline void stream_fence() { _mm_sfence(); }
+
+/// @brief result[i] = a[i] * b[i] written with streaming stores (see
+/// AccessPattern::STREAM_WRITE), the rows before the first vector aligned
+/// one and the tail with plain stores. Call stream_fence once after the last
+/// call of a thread.
+/// @tparam HSStyle TSL processing style.
+template <class HSStyle> class Stream_Multiply {
+public:
+  using base_t = typename HSStyle::base_type;
+
+  void operator()(base_t *result, const base_t *a, std::size_t count,
+                  const base_t *b) const {
+    constexpr std::size_t lanes = HSStyle::vector_element_count();
+    constexpr std::size_t vector_bytes = lanes * sizeof(base_t);
+
+    std::size_t i = 0;
+    for (; i < count && !vector_aligned<vector_bytes>(result + i); ++i)
+      result[i] = a[i] * b[i];
+    for (; i + lanes <= count; i += lanes)
+      stream_store<HSStyle>(result + i,
+                            tsl::mul<HSStyle>(tsl::loadu<HSStyle>(a + i),
+                                              tsl::loadu<HSStyle>(b + i)));
+    for (; i < count; ++i)
+      result[i] = a[i] * b[i];
+  }
+};
+
+/// @brief result[k] = data[positions[k]] for the count positions, written
+/// with streaming stores like Stream_Multiply (positions index data, one
+/// lane per position).
+/// @tparam HSStyle TSL processing style (base type as wide as the
+/// positions).
+template <class HSStyle> class Stream_Materialize {
+public:
+  using base_t = typename HSStyle::base_type;
+
+  template <typename P>
+  void operator()(base_t *result, const base_t *data, const P *positions,
+                  std::size_t count) const {
+    static_assert(sizeof(P) == sizeof(base_t),
+                  "positions have to fill the lanes");
+    constexpr std::size_t lanes = HSStyle::vector_element_count();
+    constexpr std::size_t vector_bytes = lanes * sizeof(base_t);
+
+    std::size_t k = 0;
+    for (; k < count && !vector_aligned<vector_bytes>(result + k); ++k)
+      result[k] = data[positions[k]];
+    for (; k + lanes <= count; k += lanes)
+      stream_store<HSStyle>(
+          result + k,
+          tsl::gather<HSStyle>(data,
+                               tsl::loadu<HSStyle>(
+                                   reinterpret_cast<const base_t *>(
+                                       positions + k))));
+    for (; k < count; ++k)
+      result[k] = data[positions[k]];
+  }
+};
+
+} // namespace vampir
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vmalloc/VamPointer.hpp"
+
+namespace vampir {
+
+/// @brief Minimum and maximum of the values of one column segment.
+template <typename T> struct zone {
+  T min = 0;
+  T max = 0;
+  /// an empty segment (e.g. the tail of the last sliver) contains nothing
+  bool empty = true;
+
+  /// @brief Whether the segment may contain values of [lo, hi].
+  bool overlaps(T lo, T hi) const { return !empty && min <= hi && lo <= max; }
+};
+
+/**
+ * @brief Per segment synopsis (zone map) of a column: zone i describes
+ * segment i of the VamPointer it was built from (see fill_sliver). The zones
+ * are a VamPointer with one segment per zone, so a ZoneMap splits (and is
+ * placed by vmalloc) like the column, and operators on a sliver of the column
+ * get the zones of exactly their segments. An empty ZoneMap knows nothing, its
+ * segments may contain any value.
+ * @tparam T value type of the column
+ */
+template <typename T> class ZoneMap {
+public:
+  using zone_t = zone<T>;
+  using zones_t = VamPointer<zone_t, sizeof(zone_t)>;
+
+private:
+  zones_t zones;
+
+public:
+  ZoneMap() = default;
+  explicit ZoneMap(zones_t zones) : zones(std::move(zones)) {}
+
+  bool empty() const { return zones.size() == 0; }
+
+  std::size_t segment_count() const { return zones.size(); }
+
+  const zone_t &operator[](std::size_t i) const { return *zones.data(i); }
+
+  /// @brief Whether segment i may contain values of [lo, hi] (always true for
+  /// an empty ZoneMap).
+  bool may_contain(std::size_t i, T lo, T hi) const {
+    return empty() || (*this)[i].overlaps(lo, hi);
+  }
+
+  /// @brief Splits like VamPointer::split; an empty ZoneMap splits into empty
+  /// ones.
+  std::vector<ZoneMap> split(std::size_t sliver_count) {
+    return split<0>(sliver_count);
+  }
+
+  template <std::size_t __ignore>
+  std::vector<ZoneMap> split(std::size_t sliver_count) {
+    if (empty())
+      return std::vector<ZoneMap>(sliver_count);
+    std::vector<ZoneMap> slivers;
+    slivers.reserve(sliver_count);
+    for (auto &sliver : zones.split(sliver_count))
+      slivers.emplace_back(std::move(sliver));
+    return slivers;
+  }
+
+  /**
+   * @brief Fills the zones of one sliver of a column (run by a thread group
+   * with column and zones wrapped in a SplitWrapper, zones allocated with one
+   * zone per segment of the column).
+   * @param base first value of the whole column
+   * @param count rows of the whole column (the last sliver may extend past
+   * them, see VamPointer::split)
+   */
+  template <std::size_t S>
+  static void fill_sliver(VamPointer<T, S> column, ZoneMap zones,
+                          const T *base, std::size_t count) {
+    constexpr std::size_t segment_rows = S / sizeof(T);
+    for (std::size_t i = 0; i < zones.segment_count(); i++) {
+      zone_t &z = *zones.zones.data(i);
+      z = zone_t();
+      const T *values = column.data(0) + i * segment_rows;
+      const std::size_t row = values - base;
+      if (row >= count)
+        continue;
+      const std::size_t rows = std::min(segment_rows, count - row);
+      const auto [min, max] = std::minmax_element(values, values + rows);
+      z = zone_t{*min, *max, false};
+    }
+  }
+};
+
+} // namespace vampir
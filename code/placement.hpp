@@ -0,0 +1,128 @@
+/**
+ * @file placement.hpp
+ * @brief Per stage (thread group) thread counts and exec nodes of the query,
+ * chosen by the auto tuner of the benchmark driver (BENCH_TUNE, see
+ * run_tuning in query.cpp) and persisted as JSON to $PLACEMENT_FILE, which
+ * later runs of the query load.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cpu_set_utils.hpp"
+#include "threads/ThreadManager.hpp"
+
+#include "../modules/json/single_include/nlohmann/json.hpp"
+
+namespace vampir {
+
+/// @brief Thread count and CPU cores of one stage: the threads are spread
+/// round robin over the exec nodes (see Crobat::get_spread_pinning_ranges).
+struct stage_placement {
+  uint32_t thread_count = 1;
+  std::vector<int> exec_nodes;
+  /// use the hyperthreads of the nodes after all physical cores
+  bool hyperthreads = false;
+
+  std::vector<std::pair<int, int>> pinning_ranges() const {
+    return Crobat::get_spread_pinning_ranges(exec_nodes, hyperthreads);
+  }
+
+  /// physical cores (and hyperthreads) available for the threads
+  uint32_t cpu_count() const {
+    return exec_nodes.size() * Crobat::cpus_per_node * (hyperthreads ? 2 : 1);
+  }
+
+  std::string to_string() const {
+    std::string nodes;
+    for (int node : exec_nodes)
+      nodes += (nodes.empty() ? "" : ",") + std::to_string(node);
+    return std::to_string(thread_count) + " threads on nodes " + nodes +
+           (hyperthreads ? " (with hyperthreads)" : "");
+  }
+};
+
+/// @brief Placement of the stages by thread group ID. Groups without an
+/// entry keep the thread count given by the query and are pinned in order
+/// (see ThreadManager::plan_pinning).
+class PlacementPlan {
+private:
+  std::map<std::string, stage_placement> stages;
+
+public:
+  bool empty() const { return stages.empty(); }
+
+  bool contains(const std::string &group_id) const {
+    return stages.find(group_id) != stages.end();
+  }
+
+  const std::map<std::string, stage_placement> &get_stages() const {
+    return stages;
+  }
+
+  void set(const std::string &group_id, const stage_placement &placement) {
+    stages.insert_or_assign(group_id, placement);
+  }
+
+  /// @brief Planned thread count of group_id, default_count if not planned.
+  uint32_t thread_count(const std::string &group_id,
+                        uint32_t default_count) const {
+    auto it = stages.find(group_id);
+    return it == stages.end() ? default_count : it->second.thread_count;
+  }
+
+  /// @brief Makes tm pin the planned groups to their cores (replaces the
+  /// plan of a previous apply).
+  void apply(ThreadManager &tm) const {
+    tm.clear_planned_pinnings();
+    for (const auto &[group_id, placement] : stages)
+      tm.plan_pinning(group_id, placement.pinning_ranges());
+  }
+
+  /// @brief {"stages": {group_id: {"thread_count": 8, "exec_nodes": [4, 5],
+  /// "hyperthreads": false}, ...}}
+  static PlacementPlan load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+      throw std::ios_base::failure("Could not open file: " + path);
+    }
+    std::string json_str((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+
+    PlacementPlan plan;
+    nlohmann::json json_obj = nlohmann::json::parse(json_str);
+    for (auto &[group_id, stage] : json_obj["stages"].items()) {
+      stage_placement placement;
+      placement.thread_count = stage["thread_count"];
+      for (auto node : stage["exec_nodes"])
+        placement.exec_nodes.push_back(node);
+      placement.hyperthreads = stage.value("hyperthreads", false);
+      if (placement.thread_count == 0 || placement.exec_nodes.empty())
+        throw std::invalid_argument("Invalid placement of stage " + group_id +
+                                    " in " + path);
+      plan.set(group_id, placement);
+    }
+    return plan;
+  }
+
+  void save(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file)
+      throw std::runtime_error("Could not write placement " + path);
+    nlohmann::json result = {{"stages", nlohmann::json::object()}};
+    for (const auto &[group_id, placement] : stages)
+      result["stages"][group_id] = {
+          {"thread_count", placement.thread_count},
+          {"exec_nodes", placement.exec_nodes},
+          {"hyperthreads", placement.hyperthreads}};
+    file << result.dump(2) << std::endl;
+  }
+};
+
+} // namespace vampir
@@ -1,4 +1,6 @@
 #include "query.hpp"
+#include "benchmark.hpp"
+#include "roofline.hpp"
 
 class Section {
 public:
@@ -7,6 +9,9 @@ public:
     stop_watch<std::allocator<stop_watch_round>> & watch;
     double duration = -1.0;
     bool primary;
+    const char * trace_name;
+    /// system wide hardware counters during the section (see perf_counters.hpp)
+    perf::counter_values counters;
     static std::vector<Section> all_sections;
 
     Section (
@@ -16,8 +21,13 @@ public:
     ) : name(name),
         bytes(bytes),
         watch(watch),
-        primary(true)
+        primary(true),
+        trace_name(TRACE_INTERN(name))
     {
+        TRACE_BEGIN(trace_name, "section", bytes)
+#if MEASURE_COUNTERS
+        counters = perf::read_system();
+#endif
         watch.start_time();
     }
     Section (
@@ -26,13 +36,19 @@ public:
         bytes(section.bytes),
         watch(section.watch),
         duration(section.duration),
-        primary(false)
+        primary(false),
+        trace_name(section.trace_name),
+        counters(section.counters)
     {
     }
 
     ~Section () {
         if (primary) {
             watch.stop_time();
+#if MEASURE_COUNTERS
+            counters = perf::read_system() - counters;
+#endif
+            TRACE_END(trace_name, "section", bytes)
             duration = watch.get_cast_durations().back();
             all_sections.push_back(*this); // saves a !primary copy
         }
@@ -50,227 +66,1651 @@ public:
                 section.duration,
                 throughput
             );
+#if MEASURE_COUNTERS
+            // the estimated bytes above are hand computed, the measured ones tell whether the section is 
+            // really bandwidth bound
+            printf("        %20s  %s\n", "", section.counters.to_string(section.duration).c_str());
+#endif
         }
     }
 };
 std::vector<Section> Section::all_sections;
 
+using query_watch_t = stop_watch<std::allocator<stop_watch_round>>;
+
 /**
- * returns (
- *    your result (from your optimized implementation),
- *    the unoptimized, but reliable result,
- *    the time it took to run your implementation
- * )
+ * Faults in all pages of column on the cores of the consumer thread group
+ * (split like the consumer splits it), so the first touch of the
+ * intermediate is not part of a timed section.
+ */
+template <typename T, size_t S>
+void prefault_for(ThreadManager &tm, const std::string &consumer,
+                  const std::string &name, VamPointer<T, S> &column) {
+  const std::string group_id = "prefault_" + name;
+  tm.create_thread_group<false, false>(
+      group_id, tm.get_thread_count(consumer), prefault<T, S>,
+      SplitWrapper<0, VamPointer<T, S>>(&column));
+  tm.pin_threads_like(group_id, consumer);
+  tm.run({group_id});
+}
+
+/**
+ * Zeroes the part of column that vam_pool handed out with data of an earlier
+ * run (see clear_dirty) with the threads, and on the cores, of the consumer
+ * thread group. Does nothing for fresh memory.
  */
-std::tuple<int64_t, int64_t, double> query(table_r &r, table_s &s) {
+template <typename T, size_t S>
+void clear_for(ThreadManager &tm, const std::string &consumer,
+               const std::string &name, VamPointer<T, S> &column) {
+  const AllocationInfo *info = column.allocation_info();
+  if (info == nullptr || info->dirty_bytes == 0)
+    return;
+  const std::string group_id = "clear_" + name;
+  tm.create_thread_group<false, false>(
+      group_id, tm.get_thread_count(consumer), clear_dirty<T, S>,
+      SplitWrapper<0, VamPointer<T, S>>(&column));
+  tm.pin_threads_like(group_id, consumer);
+  tm.run({group_id});
+}
+
+/**
+ * Runs probe, materialize, multiply and reduce as separate thread groups, each
+ * stage writing a full-size intermediate column.
+ * returns the final sum
+ */
+int64_t query_staged(ThreadManager &tm, uint32_t thread_count,
+                     const query_config &config,
+                     join_intermediate &intermediate_join_buffer, table_r &r,
+                     table_s &s, query_watch_t &query_stop_watch) {
+
+  // threads of a stage (see query_config::placement)
+  auto threads = [&](const std::string &group_id) {
+    return config.placement.thread_count(group_id, thread_count);
+  };
 
   // create intermediate buffers
   // #### MODIFY: feel free to adjust access patterns
-  join_intermediate intermediate_join_buffer;
-  intermediate_join_buffer.keys =
-      vmalloc<uint32_t, 2048>(s.data_amount * 2, AccessPattern::LINEAR);
-  intermediate_join_buffer.used =
-      vmalloc<uint64_t, 4096>(s.data_amount * 2, AccessPattern::LINEAR);
-
   join_result join_res;
-  join_res.positions =
-      vmalloc<size_t, 4096>(r.fk.size(), AccessPattern::LINEAR);
+  // positions and column_a_times_b are written before they are read, reused
+  // memory is not zeroed for them
+  join_res.positions = vmalloc<size_t, 4096>(
+      r.fk.size(), AccessPattern::LINEAR, config.intermediate_pages, false);
   join_res.lengths = vmalloc<size_t, sizeof(size_t)>(r.fk.segment_count(),
                                                      AccessPattern::LINEAR);
 
   auto mat_offset = vmalloc<size_t, sizeof(size_t)>(r.fk.segment_count(),
                                                     AccessPattern::LINEAR);
+  // per prober thread: segments hit by its sliver, then its sliver's offset
+  auto sliver_offsets = vmalloc<size_t, sizeof(size_t)>(
+      threads("prober_group"), AccessPattern::LINEAR);
 
-  auto joint_a = vmalloc<int64_t, 4096>(r.data_amount, AccessPattern::LINEAR);
-  auto joint_b = vmalloc<int64_t, 4096>(r.data_amount, AccessPattern::LINEAR);
+  // written once and read once by the next stage: streaming stores. multiply
+  // also reads the rows behind the matches, which have to be zero (reused
+  // memory is cleared by the materialize threads, see clear_for)
+  auto joint_a = vmalloc<int64_t, 4096>(r.data_amount,
+                                        AccessPattern::STREAM_WRITE,
+                                        config.intermediate_pages, false);
+  auto joint_b = vmalloc<int64_t, 4096>(r.data_amount,
+                                        AccessPattern::STREAM_WRITE,
+                                        config.intermediate_pages, false);
 
-  auto column_a_times_b =
-      vmalloc<int64_t, 4096>(r.data_amount, AccessPattern::LINEAR);
+  auto column_a_times_b = vmalloc<int64_t, 4096>(
+      r.data_amount, AccessPattern::STREAM_WRITE, config.intermediate_pages,
+      false);
 
   auto reduced_ab = vmalloc<int64_t, sizeof(int64_t)>(r.a.segment_count(),
                                                       AccessPattern::LINEAR);
 
   // #### end MODIFY
 
-  uint32_t thread_count = 5;
-
-  std::vector<std::pair<int, int>> pinning_ranges;
-  #if TESTING
-    pinning_ranges = Crobat::get_testing_pinning_ranges();
-  #else
-    pinning_ranges = Crobat::get_benchmarking_pinning_ranges();
-  #endif
-
-  ThreadManager tm(thread_pin_policy::automatic, pinning_ranges);
+  // zones of the fk segments, empty (nothing is skipped) if disabled
+  ZoneMap<uint32_t> fk_zones =
+      config.use_zone_maps ? r.fk_zones : ZoneMap<uint32_t>();
 
   // Create threads
+  // with morsels the stages are connected per morsel (see add_dependency
+  // below) instead of separated by barriers
+  const bool overlap = config.morsel_segments > 0;
+  size_t offset = 0;
   // #### MODIFY: adjust thread_count per thread group as needed
-  // #### MODIFY: you may also change to ThreadManager pinning to manually and
-  // pin
-  // #### the threadgroups by hand (hard)
-  tm.create_thread_group<true, false>(
-      "prober_group", thread_count, probing, intermediate_join_buffer.keys,
-      intermediate_join_buffer.used, SplitWrapper<0, typeof(r.fk)>(&r.fk),
-      SplitWrapper<0, typeof(join_res.positions)>(&join_res.positions),
-      SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths));
+  if (overlap) {
+    tm.create_dynamic_thread_group<true, false>(
+        "prober_group", threads("prober_group"), config.morsel_segments,
+        probing,
+        intermediate_join_buffer, SplitWrapper<0, typeof(r.fk)>(&r.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&fk_zones),
+        SplitWrapper<0, typeof(join_res.positions)>(&join_res.positions),
+        SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths));
+    // a single thread takes its morsels in order, carrying the offset
+    tm.create_dynamic_thread_group<true, false>(
+        "mat_offset", 1, config.morsel_segments, prefix_offsets,
+        SplitWrapper<0, typeof(mat_offset)>(&mat_offset),
+        SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths),
+        &offset);
+  } else {
+    // the probe threads scan the lengths of their slivers on the fly, the
+    // fixup adds the sliver offsets
+    tm.create_thread_group<true, false>(
+        "prober_group", threads("prober_group"), probing_with_offsets,
+        intermediate_join_buffer, SplitWrapper<0, typeof(r.fk)>(&r.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&fk_zones),
+        SplitWrapper<0, typeof(join_res.positions)>(&join_res.positions),
+        SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths),
+        SplitWrapper<0, typeof(mat_offset)>(&mat_offset),
+        SplitWrapper<0, typeof(sliver_offsets)>(&sliver_offsets));
+    // one sliver base per prober thread
+    tm.create_thread_group<true, false>(
+        "mat_offset", threads("prober_group"), add_sliver_base,
+        SplitWrapper<0, typeof(mat_offset)>(&mat_offset),
+        SplitWrapper<0, typeof(sliver_offsets)>(&sliver_offsets));
+  }
 
-  tm.create_thread_group<true, false>(
-      "materialize_a", thread_count, materialize_position_list, joint_a,
-      SplitWrapper<0, typeof(r.a)>(&r.a),
-      SplitWrapper<0, typeof(join_res.positions)>(&join_res.positions),
-      SplitWrapper<0, typeof(mat_offset)>(&mat_offset),
-      SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths));
+  for (auto [group_id, column, joint] :
+       {std::make_tuple("materialize_a", &r.a, &joint_a),
+        std::make_tuple("materialize_b", &r.b, &joint_b)}) {
+    if (overlap)
+      tm.create_dynamic_thread_group<true, false>(
+          group_id, threads(group_id), config.morsel_segments,
+          materialize_position_list<int64_t, 4096>, *joint,
+          SplitWrapper<0, typeof(r.a)>(column),
+          SplitWrapper<0, typeof(join_res.positions)>(&join_res.positions),
+          SplitWrapper<0, typeof(mat_offset)>(&mat_offset),
+          SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths));
+    else
+      tm.create_thread_group<true, false>(
+          group_id, threads(group_id),
+          materialize_position_list<int64_t, 4096>, *joint,
+          SplitWrapper<0, typeof(r.a)>(column),
+          SplitWrapper<0, typeof(join_res.positions)>(&join_res.positions),
+          SplitWrapper<0, typeof(mat_offset)>(&mat_offset),
+          SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths));
+  }
 
+  if (overlap) {
+    tm.create_dynamic_thread_group<true, false>(
+        "multiply", threads("multiply"), config.morsel_segments,
+        multiply<int64_t, 4096>,
+        SplitWrapper<0, typeof(column_a_times_b)>(&column_a_times_b),
+        SplitWrapper<0, typeof(joint_a)>(&joint_a),
+        SplitWrapper<0, typeof(joint_b)>(&joint_b));
+    tm.create_dynamic_thread_group<true, false>(
+        "reduce_add", threads("reduce_add"), config.morsel_segments,
+        reduce_add<int64_t, 4096>,
+        SplitWrapper<0, typeof(reduced_ab)>(&reduced_ab),
+        SplitWrapper<0, typeof(column_a_times_b)>(&column_a_times_b));
+  } else {
+    tm.create_thread_group<true, false>(
+        "multiply", threads("multiply"), multiply<int64_t, 4096>,
+        SplitWrapper<0, typeof(column_a_times_b)>(&column_a_times_b),
+        SplitWrapper<0, typeof(joint_a)>(&joint_a),
+        SplitWrapper<0, typeof(joint_b)>(&joint_b));
+    tm.create_thread_group<true, false>(
+        "reduce_add", threads("reduce_add"), reduce_add<int64_t, 4096>,
+        SplitWrapper<0, typeof(reduced_ab)>(&reduced_ab),
+        SplitWrapper<0, typeof(column_a_times_b)>(&column_a_times_b));
+  }
+
+  // #### end MODIFY
+
+  if (overlap) {
+    // the offset of morsel i needs the lengths of morsels 0 .. i, the
+    // materialization of morsel i its offset (and thereby its positions)
+    tm.add_dependency("mat_offset", "prober_group",
+                      dependency_kind::previous_morsels);
+    tm.add_dependency("materialize_a", "mat_offset",
+                      dependency_kind::same_morsel);
+    tm.add_dependency("materialize_b", "mat_offset",
+                      dependency_kind::same_morsel);
+    tm.add_dependency("reduce_add", "multiply", dependency_kind::same_morsel);
+  }
+
+  clear_for(tm, "materialize_a", "joint_a", joint_a);
+  clear_for(tm, "materialize_b", "joint_b", joint_b);
+  if (config.prefault) {
+    prefault_for(tm, "prober_group", "positions",
+                 join_res.positions);
+    prefault_for(tm, "materialize_a", "joint_a", joint_a);
+    prefault_for(tm, "materialize_b", "joint_b", joint_b);
+    prefault_for(tm, "multiply", "column_a_times_b",
+                 column_a_times_b);
+  }
+
+  if (overlap) {
+    { Section sec("probe_offset_materialize",
+      r.data_amount * sizeof(uint32_t) +
+          3 * s.data_amount * sizeof(uint64_t) +
+          join_res.lengths.segment_count() * sizeof(size_t) +
+          2 * (r.data_amount * sizeof(uint64_t) + (
+              join_res.lengths.size() +
+              join_res.positions.size() +
+              join_res.lengths.segment_count()
+          ) * sizeof(size_t)),
+      query_stop_watch
+    );
+    tm.run({"prober_group", "mat_offset", "materialize_a", "materialize_b"});
+
+    }
+  } else {
+    { Section sec(
+      "prober_group",
+      r.data_amount * sizeof(uint32_t) + 3 * s.data_amount * sizeof(uint64_t),
+      query_stop_watch
+    );
+    tm.run({"prober_group"});
+
+    } { Section sec(
+      "mat_offset",
+      join_res.lengths.segment_count() * sizeof(size_t),
+      query_stop_watch
+    );
+    // prepare offsets for materialization
+    // (multiply is only possible with materialized columns)
+    offset = scan_sliver_totals(sliver_offsets);
+    tm.run({"mat_offset"});
+
+    } { Section sec("materialize_a_and_b",
+      2 * (r.data_amount * sizeof(uint64_t) + (
+          join_res.lengths.size() +
+          join_res.positions.size() +
+          join_res.lengths.segment_count()
+      ) * sizeof(size_t)),
+      query_stop_watch
+    );
+    tm.run({"materialize_a", "materialize_b"});
+
+    }
+  }
+  { Section sec("manipulate_size", 3 * sizeof(size_t), query_stop_watch);
+  // adjus size of preallocated columns after materialization
+  // (actual size is now known)
+  joint_a.manipulate_size(offset);
+  joint_b.manipulate_size(offset);
+  column_a_times_b.manipulate_size(offset);
+
+  }
+  if (overlap) {
+    { Section sec("multiply_reduce_add",
+      3 * r.data_amount * sizeof(uint64_t),
+      query_stop_watch
+    );
+    tm.run({"multiply", "reduce_add"});
+
+    }
+  } else {
+    { Section sec("multiply",
+      2 * r.data_amount * sizeof(uint64_t),
+      query_stop_watch
+    );
+    tm.run({"multiply"});
+
+    } { Section sec("reduce_add",
+      r.data_amount * sizeof(uint64_t),
+      query_stop_watch
+    );
+    tm.run({"reduce_add"});
+
+    }
+  }
+  int64_t final_sum = 0;
+  { Section sec("final_sum",
+      reduced_ab.segment_count() * sizeof(uint64_t),
+      query_stop_watch
+  );
+  // finalize reduce add (add up partial sums from each segment)
+  for (size_t i = 0; i < reduced_ab.segment_count(); i++) {
+    auto [res_ptr, res_size] = reduced_ab.get_segment(i);
+    final_sum += res_ptr[0];
+  }
+
+  }
+  return final_sum;
+}
+
+/**
+ * Staged pipeline with a selection bitmask as join result: probe writes one
+ * bit per row, multiply reads a and b in full and zeroes the unselected rows,
+ * so there is no position list and no materialization.
+ * returns the final sum
+ */
+int64_t query_staged_bitmask(ThreadManager &tm, uint32_t thread_count,
+                             const query_config &config,
+                             join_intermediate &intermediate_join_buffer,
+                             table_r &r, table_s &s,
+                             query_watch_t &query_stop_watch) {
+
+  auto threads = [&](const std::string &group_id) {
+    return config.placement.thread_count(group_id, thread_count);
+  };
+
+  // create intermediate buffers
+  // #### MODIFY: feel free to adjust access patterns
+  // 64 B segments -> 512 rows per segment, as many as per fk segment. Both
+  // are fully written by their stage, reused memory is not zeroed.
+  auto join_mask = vmalloc<uint64_t, 64>(mask_word_count(r.fk.size()),
+                                         AccessPattern::LINEAR, K4_Normal,
+                                         false);
+
+  auto column_a_times_b = vmalloc<int64_t, 4096>(
+      r.data_amount, AccessPattern::LINEAR, config.intermediate_pages, false);
+
+  auto reduced_ab = vmalloc<int64_t, sizeof(int64_t)>(r.a.segment_count(),
+                                                      AccessPattern::LINEAR);
+  // #### end MODIFY
+
+  // zones of the fk segments, empty (nothing is skipped) if disabled
+  ZoneMap<uint32_t> fk_zones =
+      config.use_zone_maps ? r.fk_zones : ZoneMap<uint32_t>();
+
+  // Create threads
+  // #### MODIFY: adjust thread_count per thread group as needed
   tm.create_thread_group<true, false>(
-      "materialize_b", thread_count, materialize_position_list, joint_b,
-      SplitWrapper<0, typeof(r.b)>(&r.b),
-      SplitWrapper<0, typeof(join_res.positions)>(&join_res.positions),
-      SplitWrapper<0, typeof(mat_offset)>(&mat_offset),
-      SplitWrapper<0, typeof(join_res.lengths)>(&join_res.lengths));
+      "mask_prober_group", threads("mask_prober_group"), probing_mask,
+      intermediate_join_buffer, SplitWrapper<0, typeof(r.fk)>(&r.fk),
+      SplitWrapper<0, ZoneMap<uint32_t>>(&fk_zones),
+      SplitWrapper<0, typeof(join_mask)>(&join_mask));
 
   tm.create_thread_group<true, false>(
-      "multiply", thread_count, multiply,
+      "multiply_masked", threads("multiply_masked"),
+      multiply_masked<int64_t, 4096>,
       SplitWrapper<0, typeof(column_a_times_b)>(&column_a_times_b),
-      SplitWrapper<0, typeof(joint_a)>(&joint_a),
-      SplitWrapper<0, typeof(joint_b)>(&joint_b));
+      SplitWrapper<0, typeof(r.a)>(&r.a), SplitWrapper<0, typeof(r.b)>(&r.b),
+      SplitWrapper<0, typeof(join_mask)>(&join_mask));
 
   tm.create_thread_group<true, false>(
-      "reduce_add", thread_count, reduce_add,
+      "reduce_add", threads("reduce_add"), reduce_add<int64_t, 4096>,
       SplitWrapper<0, typeof(reduced_ab)>(&reduced_ab),
       SplitWrapper<0, typeof(column_a_times_b)>(&column_a_times_b));
-
   // #### end MODIFY
 
-  stop_watch<std::allocator<stop_watch_round>> query_stop_watch{
-      clock_type::now(), 1};
-  // stop query time (without thread creation and datageneration
-  //    -> only compute throughput)
+  if (config.prefault) {
+    prefault_for(tm, "mask_prober_group", "join_mask",
+                 join_mask);
+    prefault_for(tm, "multiply_masked", "column_a_times_b",
+                 column_a_times_b);
+  }
+
   { Section sec(
-    "build_intermediate_join_buffer",
-    3 * s.data_amount * sizeof(uint64_t),
+    "mask_prober_group",
+    r.data_amount * sizeof(uint32_t) + 3 * s.data_amount * sizeof(uint64_t),
     query_stop_watch
   );
+  tm.run({"mask_prober_group"});
 
-  // build hastable single threaded, as it is hard to parallelize efficiently
-  building(intermediate_join_buffer, s);
+  } { Section sec("multiply_masked",
+    2 * r.data_amount * sizeof(uint64_t) + join_mask.size() * sizeof(uint64_t),
+    query_stop_watch
+  );
+  tm.run({"multiply_masked"});
 
-  } { Section sec(
-    "prober_group",
-    r.data_amount * sizeof(uint32_t) + 3 * s.data_amount * sizeof(uint64_t),
+  } { Section sec("reduce_add",
+    r.data_amount * sizeof(uint64_t),
     query_stop_watch
   );
-  tm.run({"prober_group"});
+  tm.run({"reduce_add"});
 
   }
-  size_t offset = 0;
+  int64_t final_sum = 0;
+  { Section sec("final_sum",
+      reduced_ab.segment_count() * sizeof(uint64_t),
+      query_stop_watch
+  );
+  for (size_t i = 0; i < reduced_ab.segment_count(); i++) {
+    final_sum += reduced_ab[i];
+  }
+
+  }
+  return final_sum;
+}
+
+/**
+ * Runs probe, materialize, multiply and reduce fused in one thread group. Each
+ * thread processes its segments end-to-end and emits one partial sum, so none
+ * of the full-size intermediate columns of the staged pipeline are allocated.
+ * returns the final sum
+ */
+int64_t query_fused(ThreadManager &tm, uint32_t thread_count,
+                    const query_config &config,
+                    join_intermediate &intermediate_join_buffer,
+                    JoinOutput output, table_r &r, table_s &s,
+                    query_watch_t &query_stop_watch) {
+  thread_count = config.placement.thread_count("fused_group", thread_count);
+
+  // #### MODIFY: feel free to adjust access patterns
+  auto partial_sums = vmalloc<int64_t, sizeof(int64_t)>(thread_count,
+                                                        AccessPattern::LINEAR);
+  // #### end MODIFY
+
+  const ColumnFormat format = config.resolve_format(r);
+
+  // zones of the fk segments, empty (nothing is skipped) if disabled
+  ZoneMap<uint32_t> fk_zones =
+      config.use_zone_maps ? r.fk_zones : ZoneMap<uint32_t>();
+
+  // #### MODIFY: adjust thread_count as needed
+  if (format == ColumnFormat::PACKED) {
+    packed_table_r &packed = r.packed;
+    tm.create_thread_group<true, false>(
+        "fused_group", thread_count,
+        fused_probe_aggregate<packed_fk_t, packed_ab_t>,
+        intermediate_join_buffer, output,
+        SplitWrapper<0, packed_fk_t>(&packed.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&fk_zones),
+        SplitWrapper<0, packed_ab_t>(&packed.a),
+        SplitWrapper<0, packed_ab_t>(&packed.b),
+        SplitWrapper<0, typeof(partial_sums)>(&partial_sums));
+  } else {
+    tm.create_thread_group<true, false>(
+        "fused_group", thread_count,
+        fused_probe_aggregate<typeof(r.fk), typeof(r.a)>,
+        intermediate_join_buffer, output,
+        SplitWrapper<0, typeof(r.fk)>(&r.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&fk_zones),
+        SplitWrapper<0, typeof(r.a)>(&r.a), SplitWrapper<0, typeof(r.b)>(&r.b),
+        SplitWrapper<0, typeof(partial_sums)>(&partial_sums));
+  }
+  // thread i processes sliver i of r, which main() placed local to the i-th
+  // cpu of the pinning ranges (unless the placement moves the group)
+  if (!config.placement.contains("fused_group"))
+    tm.pin_threads_for_group("fused_group", query_pinning_ranges());
+  // #### end MODIFY
+
   { Section sec(
-    "mat_offset",
-    join_res.lengths.segment_count() * sizeof(size_t),
+    "fused_group",
+    (format == ColumnFormat::PACKED
+         ? r.packed.size_bytes()
+         : r.data_amount * (sizeof(uint32_t) + 2 * sizeof(uint64_t))) +
+        3 * s.data_amount * sizeof(uint64_t),
     query_stop_watch
   );
-  // prepare offsets for materialization
-  // (multiply is only possible with materialized columns)
-  for (size_t i = 0; i < join_res.lengths.segment_count(); i++) {
-    mat_offset[i] = offset;
-    offset += std::get<0>(join_res.lengths.get_segment(i))[0];
-  }
-
-  } { Section sec("materialize_a_and_b",
-    2 * (r.data_amount * sizeof(uint64_t) + (
-        join_res.lengths.size() +
-        join_res.positions.size() +
-        join_res.lengths.segment_count()
-    ) * sizeof(size_t)),
-    query_stop_watch
+  tm.run({"fused_group"});
+
+  }
+  int64_t final_sum = 0;
+  { Section sec("final_sum",
+      partial_sums.segment_count() * sizeof(uint64_t),
+      query_stop_watch
   );
-  tm.run({"materialize_a", "materialize_b"});
+  // add up the partial sums of all threads
+  for (size_t i = 0; i < partial_sums.segment_count(); i++) {
+    final_sum += partial_sums[i];
+  }
 
-  } { Section sec("manipulate_size", 3 * sizeof(size_t), query_stop_watch);
-  // adjus size of preallocated columns after materialization
-  // (actual size is now known)
-  joint_a.manipulate_size(offset);
-  joint_b.manipulate_size(offset);
-  column_a_times_b.manipulate_size(offset);
+  }
+  return final_sum;
+}
+
+/**
+ * Creates the thread groups stats_group<suffix> and build_group<suffix>
+ * building the join structures of s in ji in parallel (for the build mode
+ * resolved in ji), nothing for a serial build. partial_stats has one element
+ * per thread of stats_group and outlives the groups.
+ */
+void create_build_groups(
+    ThreadManager &tm, table_s &s, join_intermediate &ji,
+    VamPointer<build_stats, sizeof(build_stats)> &partial_stats,
+    const query_config &config, uint32_t thread_count,
+    const std::string &suffix) {
+  if (ji.build_mode != BuildMode::PARALLEL)
+    return;
+  // #### MODIFY: adjust thread_count as needed
+  tm.create_thread_group<true, false>(
+      "stats_group" + suffix,
+      config.placement.thread_count("stats_group", thread_count),
+      collect_build_stats,
+      SplitWrapper<0, typeof(s.pk)>(&s.pk),
+      SplitWrapper<0, typeof(partial_stats)>(&partial_stats));
+  tm.create_thread_group<true, false>(
+      "build_group" + suffix,
+      config.placement.thread_count("build_group", thread_count),
+      building_concurrent,
+      &ji, SplitWrapper<0, typeof(s.pk)>(&s.pk));
+  // #### end MODIFY
+}
 
-  } { Section sec("multiply",
-    2 * r.data_amount * sizeof(uint64_t),
+/**
+ * Collects the build_stats of s, plans and builds the join structures of ji
+ * (with the groups of create_build_groups) and samples the selectivity of the
+ * join on r.fk, each in a section (names with suffix).
+ * returns the resolved join output
+ */
+JoinOutput
+build_join(ThreadManager &tm, table_r &r, table_s &s, join_intermediate &ji,
+           VamPointer<build_stats, sizeof(build_stats)> &partial_stats,
+           const query_config &config, const std::string &suffix,
+           query_watch_t &query_stop_watch) {
+  { Section sec(
+    "build_stats" + suffix,
+    s.data_amount * sizeof(uint32_t),
     query_stop_watch
   );
-  tm.run({"multiply"});
+  if (ji.build_mode == BuildMode::PARALLEL) {
+    tm.run({"stats_group" + suffix});
+    for (size_t i = 0; i < partial_stats.segment_count(); i++) {
+      ji.stats.merge(partial_stats[i]);
+    }
+  } else {
+    collect_build_stats(s.pk, partial_stats);
+    ji.stats = partial_stats[0];
+  }
+  // select the join engine and allocate its structures
+  plan_join(ji, config);
 
-  } { Section sec("reduce_add",
-    r.data_amount * sizeof(uint64_t),
+  } { Section sec(
+    "build_intermediate_join_buffer" + suffix,
+    3 * s.data_amount * sizeof(uint64_t),
     query_stop_watch
   );
-  tm.run({"reduce_add"});
 
+  if (ji.build_mode == BuildMode::PARALLEL) {
+    // reused memory of the table and filter is zeroed by the build threads
+    clear_for(tm, "build_group" + suffix, "keys" + suffix, ji.keys);
+    clear_for(tm, "build_group" + suffix, "used" + suffix, ji.used);
+    clear_for(tm, "build_group" + suffix, "filter" + suffix, ji.filter);
+    // all threads insert their sliver of s.pk into the same table (CAS)
+    tm.run({"build_group" + suffix});
+  } else {
+    clear_dirty(ji.keys);
+    clear_dirty(ji.used);
+    clear_dirty(ji.filter);
+    // build hastable single threaded (SIMDOps builder)
+    building(ji, s);
   }
-  int64_t final_sum = 0;
-  { Section sec("final_sum",
-      reduced_ab.segment_count() * sizeof(uint64_t),
-      query_stop_watch
+  finish_building(ji);
+
+  }
+  { Section sec(
+    "sample_selectivity" + suffix,
+    selectivity_sample_segments * 2048,
+    query_stop_watch
   );
-  // finalize reduce add (add up partial sums from each segment)
-  for (size_t i = 0; i < reduced_ab.segment_count(); i++) {
-    auto [res_ptr, res_size] = reduced_ab.get_segment(i);
-    final_sum += res_ptr[0];
+  // position list for selective joins, bitmask otherwise
+  return resolve_output(ji, r.fk, config.output);
+
+  }
+}
+
+/**
+ * returns (
+ *    your result (from your optimized implementation),
+ *    the unoptimized, but reliable result (see checksum),
+ *    the time it took to run your implementation
+ * )
+ */
+std::tuple<int64_t, checksum_result, double>
+query(ThreadManager &tm, table_r &r, table_s &s, const query_config &config) {
+
+  // all intermediates of this run are served by (and returned in bulk to)
+  // vam_pool, so repeated runs reuse already faulted memory
+  VamArena query_arena;
+
+  // the join structures are allocated by plan_join (engine dependent)
+  join_intermediate intermediate_join_buffer;
+
+  uint32_t thread_count = config.thread_count;
+
+  // the thread groups of a previous run reference its intermediates; the
+  // workers of tm are kept, so no threads are created for this run
+  tm.reset();
+  config.placement.apply(tm);
+
+  // #### MODIFY: feel free to adjust access patterns
+  auto partial_stats = vmalloc<build_stats, sizeof(build_stats)>(
+      config.placement.thread_count("stats_group", thread_count),
+      AccessPattern::LINEAR);
+  // #### end MODIFY
+
+  intermediate_join_buffer.build_mode = config.resolve_build(s.data_amount);
+  create_build_groups(tm, s, intermediate_join_buffer, partial_stats, config,
+                      thread_count, "");
+
+  query_watch_t query_stop_watch{clock_type::now(), 1};
+  // stop query time (without thread creation and datageneration
+  //    -> only compute throughput)
+  JoinOutput output =
+      build_join(tm, r, s, intermediate_join_buffer, partial_stats, config, "",
+                 query_stop_watch);
+
+  int64_t final_sum = 0;
+  if (config.execution == ExecutionMode::FUSED) {
+    final_sum = query_fused(tm, thread_count, config, intermediate_join_buffer,
+                            output, r, s, query_stop_watch);
+  } else if (output == JoinOutput::BITMASK) {
+    final_sum = query_staged_bitmask(tm, thread_count, config,
+                                     intermediate_join_buffer, r, s,
+                                     query_stop_watch);
+  } else {
+    final_sum = query_staged(tm, thread_count, config,
+                             intermediate_join_buffer, r, s, query_stop_watch);
   }
 
+  if (config.print_timings) {
+    Section::print();
+    tm.print_timings();
   }
-  Section::print();
-  tm.print_timings();
 
   double duration = query_stop_watch.get_duration_sum<std::chrono::seconds>();
 
-  int64_t safe_sum = checksum(r, s);
+  checksum_result safe_sum =
+      checksum(tm, r, s, thread_count, config.checksum_sample_stride);
   return std::make_tuple(final_sum, safe_sum, duration);
 }
 
-int main() {
-  PageType ptype = K4_Normal;
-  size_t data_amount = 1024 * 1024 * 128LL;
-  size_t size_special_1 = 1024;
-  size_t memory_amount = 2 * data_amount * sizeof(int64_t) +
-                         data_amount * sizeof(uint32_t) +
-                         size_special_1 * sizeof(uint32_t);
+/// @brief A batch of queries prepared by prepare_batch: the join structures
+/// of its build sides and the fused group scanning r for all of them, which
+/// references the members (a batch_run is not moved).
+struct batch_run {
+  std::vector<table_s> builds;
+  std::vector<batch_query> queries;
+  std::vector<VamPointer<build_stats, sizeof(build_stats)>> partial_stats;
+  VamPointer<batch_partial, sizeof(batch_partial)> partials;
+  ZoneMap<uint32_t> fk_zones;
+  std::string group_id;
+  /// bytes read by the fused group (r and the join structures)
+  size_t scan_bytes = 0;
+};
+
+/**
+ * Builds the join structures of every build side of builds (at most
+ * max_batch_queries, sections named build_stats<tag>_<q> etc.) and creates
+ * the group fused_group<tag> that probes every segment of r with all of them
+ * (see fused_batch_probe_aggregate), so r is read once for the whole batch.
+ * Batches always run fused (config.execution is ignored).
+ * @throws std::invalid_argument if builds is empty or too large
+ */
+std::unique_ptr<batch_run> prepare_batch(ThreadManager &tm, table_r &r,
+                                         std::vector<table_s> builds,
+                                         const query_config &config,
+                                         const std::string &tag,
+                                         query_watch_t &query_stop_watch) {
+  if (builds.empty() || builds.size() > max_batch_queries)
+    throw std::invalid_argument("A batch holds 1 to " +
+                                std::to_string(max_batch_queries) +
+                                " queries, not " +
+                                std::to_string(builds.size()));
+
+  auto run = std::make_unique<batch_run>();
+  run->builds = std::move(builds);
+  run->queries.resize(run->builds.size());
+  run->group_id = "fused_group" + tag;
+  uint32_t thread_count = config.thread_count;
+
+  // referenced by the build groups -> no reallocation after creating them
+  run->partial_stats.reserve(run->builds.size());
+  for (size_t q = 0; q < run->builds.size(); q++) {
+    // #### MODIFY: feel free to adjust access patterns
+    run->partial_stats.push_back(vmalloc<build_stats, sizeof(build_stats)>(
+        config.placement.thread_count("stats_group", thread_count),
+        AccessPattern::LINEAR));
+    // #### end MODIFY
+    run->queries[q].ji.build_mode =
+        config.resolve_build(run->builds[q].data_amount);
+    create_build_groups(tm, run->builds[q], run->queries[q].ji,
+                        run->partial_stats[q], config, thread_count,
+                        tag + "_" + std::to_string(q));
+  }
+
+  const uint32_t fused_threads =
+      config.placement.thread_count("fused_group", thread_count);
+  // #### MODIFY: feel free to adjust access patterns
+  run->partials = vmalloc<batch_partial, sizeof(batch_partial)>(
+      fused_threads, AccessPattern::LINEAR);
+  // #### end MODIFY
+  const ColumnFormat format = config.resolve_format(r);
+  run->fk_zones = config.use_zone_maps ? r.fk_zones : ZoneMap<uint32_t>();
+
+  // #### MODIFY: adjust thread_count as needed
+  if (format == ColumnFormat::PACKED) {
+    packed_table_r &packed = r.packed;
+    tm.create_thread_group<true, false>(
+        run->group_id, fused_threads,
+        fused_batch_probe_aggregate<packed_fk_t, packed_ab_t>, &run->queries,
+        SplitWrapper<0, packed_fk_t>(&packed.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&run->fk_zones),
+        SplitWrapper<0, packed_ab_t>(&packed.a),
+        SplitWrapper<0, packed_ab_t>(&packed.b),
+        SplitWrapper<0, typeof(run->partials)>(&run->partials));
+  } else {
+    tm.create_thread_group<true, false>(
+        run->group_id, fused_threads,
+        fused_batch_probe_aggregate<typeof(r.fk), typeof(r.a)>, &run->queries,
+        SplitWrapper<0, typeof(r.fk)>(&r.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&run->fk_zones),
+        SplitWrapper<0, typeof(r.a)>(&r.a), SplitWrapper<0, typeof(r.b)>(&r.b),
+        SplitWrapper<0, typeof(run->partials)>(&run->partials));
+  }
+  // the fused groups of all batches run on the cores of the fused_group
+  tm.pin_threads_for_group(
+      run->group_id,
+      config.placement.contains("fused_group")
+          ? config.placement.get_stages().at("fused_group").pinning_ranges()
+          : query_pinning_ranges());
+  // #### end MODIFY
+
+  run->scan_bytes = format == ColumnFormat::PACKED
+                        ? r.packed.size_bytes()
+                        : r.data_amount * (sizeof(uint32_t) +
+                                           2 * sizeof(uint64_t));
+  for (size_t q = 0; q < run->builds.size(); q++) {
+    run->queries[q].output =
+        build_join(tm, r, run->builds[q], run->queries[q].ji,
+                   run->partial_stats[q], config,
+                   tag + "_" + std::to_string(q), query_stop_watch);
+    run->scan_bytes += 3 * run->builds[q].data_amount * sizeof(uint64_t);
+  }
+  return run;
+}
+
+/**
+ * Starts the fused group of a prepared batch and returns immediately.
+ * returns the future of the result of every query of the batch (added up
+ * from the partial sums by the worker finishing last)
+ */
+Future<std::vector<int64_t>> start_batch(ThreadManager &tm, batch_run &run) {
+  return tm.run_future({run.group_id}).then([&run] {
+    std::vector<int64_t> final_sums(run.queries.size(), 0);
+    for (size_t i = 0; i < run.partials.segment_count(); i++) {
+      for (size_t q = 0; q < run.queries.size(); q++)
+        final_sums[q] += run.partials[i].sums[q];
+    }
+    return final_sums;
+  });
+}
+
+/**
+ * Checks every query of a batch (builds in order) against the checksum.
+ */
+std::vector<checksum_result> checksum_batch(ThreadManager &tm, table_r &r,
+                                            std::vector<table_s> &builds,
+                                            const query_config &config) {
+  std::vector<checksum_result> safe_sums;
+  for (table_s &s : builds) {
+    tm.reset();
+    safe_sums.push_back(checksum(tm, r, s, config.thread_count,
+                                 config.checksum_sample_stride));
+  }
+  return safe_sums;
+}
+
+/**
+ * Runs the query for every build side of builds (at most max_batch_queries)
+ * over one shared scan of r (see prepare_batch).
+ * returns (
+ *    the result of every query,
+ *    their reliable results (see checksum),
+ *    the time it took to run the batch
+ * )
+ */
+std::tuple<std::vector<int64_t>, std::vector<checksum_result>, double>
+query_batch(ThreadManager &tm, table_r &r, std::vector<table_s> &builds,
+            const query_config &config) {
+  VamArena query_arena;
+  tm.reset();
+  config.placement.apply(tm);
+
+  query_watch_t query_stop_watch{clock_type::now(), 1};
+  std::unique_ptr<batch_run> run =
+      prepare_batch(tm, r, builds, config, "", query_stop_watch);
+
+  std::vector<int64_t> final_sums;
+  { Section sec(
+    "fused_group",
+    run->scan_bytes,
+    query_stop_watch
+  );
+  final_sums = start_batch(tm, *run).get();
+
+  }
+
+  if (config.print_timings) {
+    Section::print();
+    tm.print_timings();
+  }
+
+  double duration = query_stop_watch.get_duration_sum<std::chrono::seconds>();
+  return std::make_tuple(final_sums, checksum_batch(tm, r, builds, config),
+                         duration);
+}
+
+/**
+ * Packs column into a new PackedColumn placed like it (sliver i on the node
+ * of sliver_cpus[i]), with one thread of tm per sliver on these cores.
+ * returns an empty column if a segment does not fit into P::bits
+ */
+template <class P, size_t S>
+P pack_column(ThreadManager &tm, const std::string &name,
+              VamPointer<typename P::value_t, S> &column,
+              const std::vector<int> &sliver_cpus, PageType ptype,
+              std::optional<Memory> memory) {
+  using header_t = typename P::segment_header;
+  P packed(vmalloc<typename P::word_t, P::segment_bytes>(
+               P::word_count_for(column.size()), AccessPattern::LINEAR,
+               sliver_cpus, ptype, memory),
+           vmalloc<header_t, sizeof(header_t)>(
+               P::segment_count_for(column.size()), AccessPattern::LINEAR,
+               sliver_cpus, K4_Normal, memory));
+
+  std::atomic<bool> fits = true;
+  const std::string group_id = "pack_" + name;
+  std::vector<std::pair<int, int>> range;
+  for (int cpu : sliver_cpus)
+    range.emplace_back(cpu, cpu + 1);
+  tm.create_thread_group<false, false>(
+      group_id, sliver_cpus.size(), P::template pack_sliver<S>,
+      SplitWrapper<0, VamPointer<typename P::value_t, S>>(&column),
+      SplitWrapper<0, P>(&packed), column.data(0), column.size(), &fits);
+  tm.pin_threads_for_group(group_id, range);
+  tm.run({group_id});
+  return fits ? packed : P();
+}
+
+/**
+ * Builds the zone map of column (one zone per segment, placed like the
+ * slivers of column), with one thread of tm per sliver on their cores.
+ */
+template <typename T, size_t S>
+ZoneMap<T> build_zone_map(ThreadManager &tm, const std::string &name,
+                          VamPointer<T, S> &column,
+                          const std::vector<int> &sliver_cpus) {
+  using zone_t = typename ZoneMap<T>::zone_t;
+  ZoneMap<T> zones(vmalloc<zone_t, sizeof(zone_t)>(
+      column.segment_count(), AccessPattern::LINEAR, sliver_cpus));
+
+  const std::string group_id = "zones_" + name;
+  std::vector<std::pair<int, int>> range;
+  for (int cpu : sliver_cpus)
+    range.emplace_back(cpu, cpu + 1);
+  tm.create_thread_group<false, false>(
+      group_id, sliver_cpus.size(), ZoneMap<T>::template fill_sliver<S>,
+      SplitWrapper<0, VamPointer<T, S>>(&column),
+      SplitWrapper<0, ZoneMap<T>>(&zones), column.data(0), column.size());
+  tm.pin_threads_for_group(group_id, range);
+  tm.run({group_id});
+  return zones;
+}
+
+/**
+ * Stores bit-packed copies of the columns of r in r.packed (scanned by the
+ * fused pipeline with ColumnFormat::PACKED), or leaves it empty if the values
+ * of a column do not fit.
+ */
+void pack_table(ThreadManager &tm, table_r &r,
+                const std::vector<int> &sliver_cpus, PageType ptype,
+                std::optional<Memory> memory) {
+  packed_table_r packed;
+  packed.fk = pack_column<packed_fk_t>(tm, "fk", r.fk, sliver_cpus, ptype,
+                                       memory);
+  if (!packed.fk.empty())
+    packed.a = pack_column<packed_ab_t>(tm, "a", r.a, sliver_cpus, ptype,
+                                        memory);
+  if (!packed.a.empty())
+    packed.b = pack_column<packed_ab_t>(tm, "b", r.b, sliver_cpus, ptype,
+                                        memory);
+  tm.reset();
+  if (packed.b.empty()) {
+    std::cerr << "r does not fit into the packed columns, scanning it plain"
+              << std::endl;
+    return;
+  }
+  r.packed = packed;
+}
+
+/**
+ * Allocates and fills the tables of w. The slivers of r are placed next to
+ * the threads of query() that scan them (config.thread_count threads, see
+ * query_pinning_ranges) and generated by threads of tm on these cores, so
+ * every page is first touched on its node (see ParallelDatagenerator).
+ */
+std::pair<table_r, table_s> generate_tables(ThreadManager &tm,
+                                            const workload &w,
+                                            uint32_t thread_count) {
+  PageType ptype = Transparent_HugePages;
 
   // create tables
   // #### MODIFY: feel free to adjust access patterns
-  auto r_a = vmalloc<int64_t, 4096>(data_amount, vampir::AccessPattern::LINEAR);
-  auto r_b = vmalloc<int64_t, 4096>(data_amount, vampir::AccessPattern::LINEAR);
+  // place each sliver of r next to the thread of the fused_group that scans it
+  const std::vector<int> sliver_cpus =
+      get_cpu_ids(0, thread_count, query_pinning_ranges());
+  auto r_a = vmalloc<int64_t, 4096>(w.data_amount,
+                                    vampir::AccessPattern::LINEAR,
+                                    sliver_cpus, ptype, w.memory);
+  auto r_b = vmalloc<int64_t, 4096>(w.data_amount,
+                                    vampir::AccessPattern::LINEAR,
+                                    sliver_cpus, ptype, w.memory);
 
-  auto r_fk =
-      vmalloc<uint32_t, 2048>(data_amount, vampir::AccessPattern::LINEAR);
-  auto s_pk =
-      vmalloc<uint32_t, 2048>(size_special_1, vampir::AccessPattern::LINEAR);
+  auto r_fk = vmalloc<uint32_t, 2048>(w.data_amount,
+                                      vampir::AccessPattern::LINEAR,
+                                      sliver_cpus, ptype, w.memory);
+  auto s_pk = vmalloc<uint32_t, 2048>(w.size_special_1,
+                                      vampir::AccessPattern::LINEAR);
   // #### end MODIFY
 
-  // Generate data
-  Datagenerator datagen;
-  datagen.generate<int64_t>(r_a.data(0), r_a.size(), BASIC_UNIFORM, 1, 10000);
-  datagen.generate<int64_t>(r_b.data(0), r_b.size(), BASIC_UNIFORM, 1, 10000);
-  datagen.generate<uint32_t>(r_fk.data(0), r_fk.size(), BASIC_UNIFORM, 0,
-                             size_special_1 * 3);
+  // Generate data (the same tables for a seed with any thread_count)
+  ParallelDatagenerator datagen =
+      w.seed ? ParallelDatagenerator(*w.seed) : ParallelDatagenerator();
+  datagen.generate<int64_t>(tm, r_a, sliver_cpus, BASIC_UNIFORM, 1, 10000);
+  datagen.generate<int64_t>(tm, r_b, sliver_cpus, BASIC_UNIFORM, 1, 10000);
+  datagen.generate<uint32_t>(tm, r_fk, sliver_cpus, BASIC_UNIFORM, 0,
+                             w.size_special_1 * w.fk_range_factor);
+
+  datagen.generate<uint32_t>(tm, s_pk, {sliver_cpus.front()}, ID);
+  tm.reset();
 
-  datagen.generate<uint32_t>(s_pk.data(0), s_pk.size(), ID);
+  print_page_info(r_a.data(0), r_a.size());
+  print_page_info(r_b.data(0), r_b.size());
+  print_page_info(r_fk.data(0), r_fk.size());
 
   // Assemble tables
-  table_r r{r_a, r_b, r_fk, data_amount};
-  table_s s{s_pk, size_special_1};
+  table_r r{r_a, r_b, r_fk, w.data_amount};
+  r.fk_zones = build_zone_map(tm, "fk", r.fk, sliver_cpus);
+  tm.reset();
+  if (w.pack)
+    pack_table(tm, r, sliver_cpus, ptype, w.memory);
+  return {r, table_s{s_pk, w.size_special_1}};
+}
+
+/// column files of the tables in dir (see column_file.hpp)
+struct table_files {
+  std::string r_a, r_b, r_fk, s_pk;
+
+  explicit table_files(const std::string &dir)
+      : r_a(dir + "/r_a.col"), r_b(dir + "/r_b.col"), r_fk(dir + "/r_fk.col"),
+        s_pk(dir + "/s_pk.col") {}
+
+  bool exist() const {
+    for (const auto &path : {r_a, r_b, r_fk, s_pk})
+      if (!std::ifstream(path).good())
+        return false;
+    return true;
+  }
+};
+
+/**
+ * Saves the columns of r and s to dir (which has to exist), see
+ * column_file.hpp.
+ */
+void save_tables(const std::string &dir, const table_r &r, const table_s &s) {
+  const table_files files(dir);
+  write_column(files.r_a, r.a, r.data_amount);
+  write_column(files.r_b, r.b, r.data_amount);
+  write_column(files.r_fk, r.fk, r.data_amount);
+  write_column(files.s_pk, s.pk, s.data_amount);
+}
+
+/**
+ * Reads the zone map of a column from the segment statistics of its column
+ * file (placed like the slivers of the column, see build_zone_map).
+ */
+template <typename T, size_t S>
+ZoneMap<T> load_zone_map(const std::string &path,
+                         const std::vector<int> &sliver_cpus) {
+  using zone_t = typename ZoneMap<T>::zone_t;
+  const auto stats = read_segment_stats(path);
+  auto zones = vmalloc<zone_t, sizeof(zone_t)>(
+      stats.size(), AccessPattern::LINEAR, sliver_cpus);
+  for (size_t i = 0; i < stats.size(); i++)
+    *zones.data(i) = zone_t{static_cast<T>(stats[i].min),
+                            static_cast<T>(stats[i].max), stats[i].rows == 0};
+  return ZoneMap<T>(zones);
+}
+
+/**
+ * Maps the tables saved by save_tables from w.table_dir (zero copy, every
+ * sliver of r bound to the node generate_tables would place it on) and sets
+ * the table sizes of w to the loaded ones.
+ * throws std::invalid_argument if the columns of r differ in size
+ */
+std::pair<table_r, table_s> load_tables(ThreadManager &tm, workload &w,
+                                        uint32_t thread_count) {
+  const table_files files(w.table_dir);
+  const std::vector<int> sliver_cpus =
+      get_cpu_ids(0, thread_count, query_pinning_ranges());
+  auto r_a = vmap<int64_t, 4096>(files.r_a, AccessPattern::LINEAR, sliver_cpus,
+                                 w.populate, w.memory);
+  auto r_b = vmap<int64_t, 4096>(files.r_b, AccessPattern::LINEAR, sliver_cpus,
+                                 w.populate, w.memory);
+  auto r_fk = vmap<uint32_t, 2048>(files.r_fk, AccessPattern::LINEAR,
+                                   sliver_cpus, w.populate, w.memory);
+  auto s_pk = vmap<uint32_t, 2048>(files.s_pk, AccessPattern::LINEAR,
+                                   {sliver_cpus.front()}, w.populate);
+  if (r_b.size() != r_a.size() || r_fk.size() != r_a.size())
+    throw std::invalid_argument("The columns of r in " + w.table_dir +
+                                " differ in size");
+  w.data_amount = r_a.size();
+  w.size_special_1 = s_pk.size();
+
+  table_r r{r_a, r_b, r_fk, w.data_amount};
+  r.fk_zones = load_zone_map<uint32_t, 2048>(files.r_fk, sliver_cpus);
+  if (w.pack)
+    pack_table(tm, r, sliver_cpus, Transparent_HugePages, w.memory);
+  return {r, table_s{s_pk, w.size_special_1}};
+}
+
+/**
+ * The tables of w: loaded from w.table_dir if it holds them, generated
+ * otherwise (and saved to w.table_dir if set).
+ */
+std::pair<table_r, table_s> open_tables(ThreadManager &tm, workload &w,
+                                        uint32_t thread_count) {
+  if (!w.table_dir.empty() && table_files(w.table_dir).exist()) {
+    std::cout << "Loading tables from " << w.table_dir << std::endl;
+    return load_tables(tm, w, thread_count);
+  }
+  auto tables = generate_tables(tm, w, thread_count);
+  if (!w.table_dir.empty()) {
+    save_tables(w.table_dir, tables.first, tables.second);
+    std::cout << "Tables saved to " << w.table_dir << std::endl;
+  }
+  return tables;
+}
+
+/**
+ * count build sides for a batch (see query_batch): side q holds the first
+ * (q + 1) / count of the keys of s, so the queries of the batch join
+ * different shares of r; the last one is s itself.
+ */
+std::vector<table_s> batch_build_sides(const table_s &s, size_t count) {
+  std::vector<table_s> builds;
+  for (size_t q = 0; q + 1 < count; q++) {
+    const size_t keys = std::max<size_t>(1, s.data_amount * (q + 1) / count);
+    // #### MODIFY: feel free to adjust access patterns
+    auto pk = vmalloc<uint32_t, 2048>(keys, vampir::AccessPattern::LINEAR);
+    // #### end MODIFY
+    std::copy(s.pk.data(0), s.pk.data(0) + keys, pk.data(0));
+    builds.push_back(table_s{pk, keys});
+  }
+  builds.push_back(s);
+  return builds;
+}
+
+/**
+ * Runs count queries (BATCH_QUERIES) on r in batches of max_batch_queries
+ * sharing a scan of r and prints the result of every query. The batches are
+ * pipelined: the join structures of batch k + 1 are built (by this thread)
+ * while the workers scan r for batch k, whose fused group the one of batch
+ * k + 1 follows on the same workers without a barrier. The aggregate
+ * throughput (count times the bytes of the base tables per second) is printed
+ * on a labeled line. The last four lines are the sums of the results and, as
+ * throughput, the bytes of the base tables counted once per second of the
+ * whole run, so the results file of a batch does not rank count times faster
+ * than a single query.
+ */
+int run_batch(ThreadManager &tm, table_r &r, table_s &s,
+              const query_config &config, const workload &w, size_t count) {
+  if (count == 0)
+    throw std::invalid_argument("BATCH_QUERIES must be > 0");
+  std::vector<table_s> builds = batch_build_sides(s, count);
+
+  VamArena query_arena;
+  tm.reset();
+  config.placement.apply(tm);
+
+  // the build sections of all batches and the whole pipeline
+  query_watch_t build_stop_watch{clock_type::now(), 1};
+  query_watch_t pipeline_stop_watch{clock_type::now(), 1};
+  std::vector<std::unique_ptr<batch_run>> runs;
+  std::vector<Future<std::vector<int64_t>>> batch_sums;
+  std::vector<std::vector<int64_t>> fast_results;
+  { Section sec(
+    "batch_pipeline",
+    count * w.memory_amount(),
+    pipeline_stop_watch
+  );
+  try {
+    for (size_t begin = 0; begin < builds.size();
+         begin += max_batch_queries) {
+      std::vector<table_s> batch(
+          builds.begin() + begin,
+          builds.begin() +
+              std::min(builds.size(), begin + max_batch_queries));
+      runs.push_back(prepare_batch(tm, r, batch, config,
+                                   "_b" + std::to_string(runs.size()),
+                                   build_stop_watch));
+      batch_sums.push_back(start_batch(tm, *runs.back()));
+    }
+  } catch (...) {
+    // the started fused groups still scan the members of runs, which must
+    // outlive them
+    when_all(batch_sums).wait();
+    throw;
+  }
+  fast_results = when_all(batch_sums).get();
+
+  }
+  const double seconds =
+      pipeline_stop_watch.get_duration_sum<std::chrono::seconds>();
+
+  if (config.print_timings) {
+    Section::print();
+    tm.print_timings();
+  }
+
+  const std::vector<checksum_result> safe_results =
+      checksum_batch(tm, r, builds, config);
+  int64_t fast_total = 0;
+  // sampled if any query's checksum is (the tolerance is relative)
+  checksum_result safe_total;
+  bool matches = true;
+  for (size_t q = 0; q < builds.size(); q++) {
+    const int64_t fast_result =
+        fast_results[q / max_batch_queries][q % max_batch_queries];
+    std::cout << "query " << q << " (" << builds[q].data_amount
+              << " keys): " << fast_result << " / "
+              << safe_results[q].to_string() << std::endl;
+    fast_total += fast_result;
+    safe_total.sum += safe_results[q].sum;
+    safe_total.sampled_fraction = std::min(safe_total.sampled_fraction,
+                                           safe_results[q].sampled_fraction);
+    matches = matches && safe_results[q].matches(fast_result);
+  }
+
+  std::cout << "batch throughput (" << count
+            << " queries): " << count * w.memory_amount() / seconds
+            << std::endl;
+  const double throughput_Bps = w.memory_amount() / seconds;
+  std::cout << fast_total << std::endl
+            << safe_total.to_string() << std::endl
+            << throughput_Bps << std::endl
+            << throughput_Bps << std::endl;
+
+  if (matches)
+    return 0;
+  std::cerr << "Checksum and query result do not match!" << std::endl;
+  return 1;
+}
+
+/**
+ * The grouped variant of the query, SUM(a * b) GROUP BY fk over the rows of r
+ * joining s: builds the join structures like query(), then group_aggregate
+ * probes, materializes and multiplies the segments of r like the fused group
+ * and adds every product to the group of its fk in thread-local state, which
+ * group_merge aggregates by key range partition (see GroupedSum). Whether the
+ * threads aggregate into hash tables or partition their rows is planned from
+ * the key domain of s once it is known (config.group_strategy).
+ * returns (
+ *    the groups ascending by key,
+ *    the reference groups (see checksum_group_by),
+ *    the time it took to run the grouped query
+ * )
+ */
+std::tuple<grouped_sums, grouped_sums, double>
+query_group_by(ThreadManager &tm, table_r &r, table_s &s,
+               const query_config &config) {
+  VamArena query_arena;
+  join_intermediate intermediate_join_buffer;
+  uint32_t thread_count = config.thread_count;
+
+  tm.reset();
+  config.placement.apply(tm);
+
+  // #### MODIFY: feel free to adjust access patterns
+  auto partial_stats = vmalloc<build_stats, sizeof(build_stats)>(
+      config.placement.thread_count("stats_group", thread_count),
+      AccessPattern::LINEAR);
+  // #### end MODIFY
+  intermediate_join_buffer.build_mode = config.resolve_build(s.data_amount);
+  create_build_groups(tm, s, intermediate_join_buffer, partial_stats, config,
+                      thread_count, "");
+
+  const uint32_t aggregate_threads =
+      config.placement.thread_count("group_aggregate", thread_count);
+  const uint32_t merge_threads =
+      config.placement.thread_count("group_merge", thread_count);
+  GroupedSum groups(aggregate_threads, merge_threads);
+  // #### MODIFY: feel free to adjust access patterns
+  auto thread_ids = vmalloc<size_t, sizeof(size_t)>(aggregate_threads,
+                                                    AccessPattern::LINEAR);
+  auto partition_ids =
+      vmalloc<size_t, sizeof(size_t)>(merge_threads, AccessPattern::LINEAR);
+  // #### end MODIFY
+  for (size_t i = 0; i < aggregate_threads; i++)
+    thread_ids[i] = i;
+  for (size_t i = 0; i < merge_threads; i++)
+    partition_ids[i] = i;
+
+  const ColumnFormat format = config.resolve_format(r);
+  ZoneMap<uint32_t> fk_zones =
+      config.use_zone_maps ? r.fk_zones : ZoneMap<uint32_t>();
+
+  // #### MODIFY: adjust thread_count as needed
+  if (format == ColumnFormat::PACKED) {
+    packed_table_r &packed = r.packed;
+    tm.create_thread_group<true, false>(
+        "group_aggregate", aggregate_threads,
+        group_aggregate_sliver<packed_fk_t, packed_ab_t>,
+        intermediate_join_buffer, SplitWrapper<0, packed_fk_t>(&packed.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&fk_zones),
+        SplitWrapper<0, packed_ab_t>(&packed.a),
+        SplitWrapper<0, packed_ab_t>(&packed.b), &groups,
+        SplitWrapper<0, typeof(thread_ids)>(&thread_ids));
+  } else {
+    tm.create_thread_group<true, false>(
+        "group_aggregate", aggregate_threads,
+        group_aggregate_sliver<typeof(r.fk), typeof(r.a)>,
+        intermediate_join_buffer, SplitWrapper<0, typeof(r.fk)>(&r.fk),
+        SplitWrapper<0, ZoneMap<uint32_t>>(&fk_zones),
+        SplitWrapper<0, typeof(r.a)>(&r.a), SplitWrapper<0, typeof(r.b)>(&r.b),
+        &groups, SplitWrapper<0, typeof(thread_ids)>(&thread_ids));
+  }
+  // merge thread p aggregates partition p over the state of all threads
+  tm.create_thread_group<true, false>(
+      "group_merge", merge_threads, group_merge_sliver, &groups,
+      SplitWrapper<0, typeof(partition_ids)>(&partition_ids));
+  // like the fused group: thread i aggregates the sliver of r local to it
+  if (!config.placement.contains("group_aggregate"))
+    tm.pin_threads_for_group("group_aggregate", query_pinning_ranges());
+  // #### end MODIFY
+
+  query_watch_t query_stop_watch{clock_type::now(), 1};
+  build_join(tm, r, s, intermediate_join_buffer, partial_stats, config, "",
+             query_stop_watch);
+  // every key of s is a potential group
+  groups.plan(config.group_strategy, intermediate_join_buffer.stats.min_key,
+              intermediate_join_buffer.stats.max_key,
+              intermediate_join_buffer.stats.count);
+
+  { Section sec(
+    "group_aggregate",
+    (format == ColumnFormat::PACKED
+         ? r.packed.size_bytes()
+         : r.data_amount * (sizeof(uint32_t) + 2 * sizeof(uint64_t))) +
+        3 * s.data_amount * sizeof(uint64_t),
+    query_stop_watch
+  );
+  tm.run({"group_aggregate"});
+
+  } { Section sec(
+    "group_merge",
+    groups.local_bytes(),
+    query_stop_watch
+  );
+  tm.run({"group_merge"});
+
+  }
+  grouped_sums result = groups.result();
+
+  if (config.print_timings) {
+    Section::print();
+    tm.print_timings();
+  }
+
+  double duration = query_stop_watch.get_duration_sum<std::chrono::seconds>();
+  std::cout << "group strategy: "
+            << (groups.get_strategy() == GroupStrategy::LOCAL ? "local"
+                                                               : "partitioned")
+            << std::endl;
+
+  grouped_sums safe_result = checksum_group_by(tm, r, s, thread_count);
+  return std::make_tuple(std::move(result), std::move(safe_result), duration);
+}
+
+/**
+ * Runs the grouped query (see query_group_by) and prints the number of
+ * groups; the last four lines are the sums over all groups of the result and
+ * of the reference and the throughput, like the output of query().
+ */
+int run_group_by(ThreadManager &tm, table_r &r, table_s &s,
+                 const query_config &config, const workload &w) {
+  const auto [fast_result, safe_result, seconds] =
+      query_group_by(tm, r, s, config);
+
+  int64_t fast_total = 0;
+  int64_t safe_total = 0;
+  for (int64_t sum : fast_result.sums)
+    fast_total += sum;
+  for (int64_t sum : safe_result.sums)
+    safe_total += sum;
+
+  const double throughput_Bps = w.memory_amount() / seconds;
+  std::cout << "groups: " << fast_result.size() << " / " << safe_result.size()
+            << std::endl
+            << fast_total << std::endl
+            << safe_total << std::endl
+            << throughput_Bps << std::endl
+            << throughput_Bps << std::endl;
+
+  if (fast_result == safe_result)
+    return 0;
+  std::cerr << "Grouped checksum and query result do not match!" << std::endl;
+  return 1;
+}
+
+/**
+ * Compares the sections of the last query run against the bandwidth the
+ * threads of the query reach (see roofline.hpp), prints the comparison and
+ * writes it to roofline.json_path.
+ */
+void report_roofline(ThreadManager &tm, const query_config &config,
+                     const workload &w, double seconds,
+                     const roofline_config &roofline) {
+  // sections may be entered several times per run (e.g. in a loop)
+  std::vector<section_measurement> sections;
+  std::map<std::string, size_t> section_index;
+  for (const auto &section : Section::all_sections) {
+    const auto [it, inserted] =
+        section_index.emplace(section.name, sections.size());
+    if (inserted)
+      sections.push_back({section.name});
+    section_measurement &measurement = sections[it->second];
+    measurement.bytes += section.bytes;
+    measurement.duration += section.duration;
+    measurement.counters += section.counters;
+  }
+
+  const roofline_calibration calibration = calibrate_roofline(
+      tm, config.thread_count, query_pinning_ranges(), w.memory, roofline);
+  const nlohmann::json report = roofline_report(
+      sections, w.memory_amount(), seconds, calibration,
+      {{"isa", isa_to_string(compiled_isa)},
+       {"thread_count", config.thread_count},
+       {"data_amount", w.data_amount},
+       {"memory_amount", w.memory_amount()},
+       {"measure_counters", MEASURE_COUNTERS != 0}});
+  print_roofline(std::cout, report);
+  write_roofline(roofline.json_path, report);
+}
+
+#if BENCHMARK_DRIVER
+/**
+ * Runs the query bench.warmup + bench.repetitions times on the same tables
+ * (see benchmark.hpp) and collects the durations of the measured runs.
+ * throws std::runtime_error if a run does not match the checksum
+ */
+BenchmarkStats measure_query(ThreadManager &tm, table_r &r, table_s &s,
+                             query_config config,
+                             const benchmark_config &bench) {
+  config.print_timings = false;
+  BenchmarkStats stats;
+
+  for (size_t i = 0; i < bench.warmup + bench.repetitions; i++) {
+    Section::all_sections.clear();
+    const auto [fast_result, safe_result, seconds] = query(tm, r, s, config);
+    if (!safe_result.matches(fast_result))
+      throw std::runtime_error(
+          "Checksum and query result do not match in run " +
+          std::to_string(i) + "!");
+    if (i < bench.warmup)
+      continue;
+
+    stats.add("query", "query", seconds);
+    // sections may be entered several times per run (e.g. in a loop)
+    std::map<std::string, double> section_durations;
+    for (const auto &section : Section::all_sections)
+      section_durations[section.name] += section.duration;
+    for (const auto &[name, duration] : section_durations)
+      stats.add("section", name, duration);
+    for (const auto &[id, duration] : tm.get_group_durations())
+      stats.add("group", id, duration);
+  }
+  return stats;
+}
+
+/**
+ * Prints (and writes) the statistics of repeated runs of the query instead
+ * of the single result of main.
+ */
+int run_benchmark(ThreadManager &tm, table_r &r, table_s &s,
+                  const query_config &config, size_t memory_amount) {
+  const benchmark_config bench = benchmark_config::from_env();
+  BenchmarkStats stats;
+  try {
+    stats = measure_query(tm, r, s, config, bench);
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "Benchmark: " << bench.warmup << " warm-up, "
+            << bench.repetitions << " measured runs" << std::endl;
+  stats.print(std::cout);
+  const sample_stats query_stats = stats.stats("query", "query");
+  std::cout << "median throughput: "
+            << memory_amount / query_stats.median / (1ull << 30) << " GiB/s"
+            << std::endl;
+
+  if (!bench.csv_path.empty())
+    stats.write_csv(bench.csv_path);
+  if (!bench.json_path.empty())
+    stats.write_json(bench.json_path,
+                     {{"warmup", bench.warmup},
+                      {"repetitions", bench.repetitions},
+                      {"memory_amount", memory_amount}});
+  return 0;
+}
+
+/**
+ * Measures the query on every point of the sweep grid (see sweep_grid) and
+ * writes one row per point and measurement to BENCH_CSV (default
+ * sweep.csv). The tables are generated again for every data point, the
+ * thread count and morsel size only change the query_config.
+ */
+int run_sweep(ThreadManager &tm, query_config config, const workload &base) {
+  const benchmark_config bench = benchmark_config::from_env();
+  const sweep_grid grid = sweep_grid::from_env(
+      base.data_amount, base.fk_range_factor, config.thread_count,
+      config.morsel_segments);
+  const std::string path =
+      bench.csv_path.empty() ? "sweep.csv" : bench.csv_path;
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "Could not write sweep results " << path << std::endl;
+    return 1;
+  }
+  file << "data_amount,fk_range_factor,memory,thread_count,morsel_segments,"
+       << BenchmarkStats::csv_header << '\n';
+
+  for (size_t data_amount : grid.data_amounts)
+    for (size_t fk_range_factor : grid.fk_range_factors)
+      for (const std::string &memory : grid.memories)
+        for (uint32_t thread_count : grid.thread_counts) {
+          workload w = base;
+          w.data_amount = data_amount;
+          w.fk_range_factor = fk_range_factor;
+          w.memory = memory == "AUTO"
+                         ? std::nullopt
+                         : std::optional<Memory>(memory_from_string(memory));
+          auto [r, s] = generate_tables(tm, w, thread_count);
+
+          for (size_t morsel_segments : grid.morsel_segments) {
+            config.thread_count = thread_count;
+            config.morsel_segments = morsel_segments;
+            const std::string point =
+                std::to_string(data_amount) + ',' +
+                std::to_string(fk_range_factor) + ',' + memory + ',' +
+                std::to_string(thread_count) + ',' +
+                std::to_string(morsel_segments);
+            std::cout << "Sweep point " << point << std::endl;
+            try {
+              measure_query(tm, r, s, config, bench).write_csv_rows(file,
+                                                                    point);
+            } catch (const std::runtime_error &e) {
+              std::cerr << e.what() << std::endl;
+              return 1;
+            }
+            file.flush();
+          }
+          // the groups of the last run and the cached intermediates refer to
+          // or are sized for these tables: release them (and the tables at
+          // the end of the scope) before the next point's tables are built
+          tm.reset();
+          vam_pool.trim();
+        }
+  return 0;
+}
+
+/**
+ * Auto tunes the placement of the stages (see PlacementPlan): measures the
+ * query with every candidate placement (thread count, exec nodes and
+ * hyperthreads, the same for all stages) and picks for every stage the
+ * smallest candidate within 5% of its fastest one, so more threads, nodes or
+ * hyperthreads are only used where they help. The plan is saved to path and
+ * used by later runs (PLACEMENT_FILE, see main).
+ */
+int run_tuning(ThreadManager &tm, query_config config, workload w,
+               const std::string &path) {
+  constexpr double tolerance = 1.05;
+  const benchmark_config bench = benchmark_config::from_env();
+  config.placement = PlacementPlan();
+  auto [r, s] = open_tables(tm, w, config.thread_count);
+
+  // candidates, cheapest first (fewer threads, no hyperthreads, fewer nodes)
+  const std::vector<int> nodes = query_exec_nodes();
+  std::vector<stage_placement> candidates;
+  for (size_t node_count : {size_t(1), nodes.size()})
+    for (bool hyperthreads : {false, true})
+      for (uint32_t threads : {1, 2, 4, 8, 12, 24, 48, 96}) {
+        stage_placement candidate;
+        candidate.thread_count = threads;
+        candidate.exec_nodes.assign(nodes.begin(), nodes.begin() + node_count);
+        candidate.hyperthreads = hyperthreads;
+        const uint32_t physical = node_count * Crobat::cpus_per_node;
+        // hyperthreads are only used beyond the physical cores, one thread is
+        // on the first node anyway
+        if (threads > candidate.cpu_count() ||
+            (hyperthreads && threads <= physical) ||
+            (node_count > 1 && threads == 1))
+          continue;
+        candidates.push_back(candidate);
+      }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const stage_placement &a, const stage_placement &b) {
+                     return std::make_tuple(a.thread_count, a.hyperthreads,
+                                            a.exec_nodes.size()) <
+                            std::make_tuple(b.thread_count, b.hyperthreads,
+                                            b.exec_nodes.size());
+                   });
+
+  // median duration of every stage (thread group) per candidate
+  std::map<std::string, std::vector<double>> stage_durations;
+  try {
+    benchmark_config probe = bench;
+    probe.warmup = 0;
+    probe.repetitions = 1;
+    for (const auto &stage : measure_query(tm, r, s, config, probe).names("group"))
+      stage_durations[stage];
+
+    for (const auto &candidate : candidates) {
+      for (const auto &[stage, durations] : stage_durations)
+        config.placement.set(stage, candidate);
+      std::cout << "Calibrating " << candidate.to_string() << std::endl;
+      const BenchmarkStats stats = measure_query(tm, r, s, config, bench);
+      for (auto &[stage, durations] : stage_durations)
+        durations.push_back(stats.stats("group", stage).median);
+    }
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  PlacementPlan plan;
+  for (const auto &[stage, durations] : stage_durations) {
+    const double fastest = *std::min_element(durations.begin(), durations.end());
+    size_t chosen = 0;
+    while (durations[chosen] > fastest * tolerance)
+      chosen++;
+    plan.set(stage, candidates[chosen]);
+    printf("stage %20s: %s, %12.8f s (fastest %12.8f s)\n", stage.c_str(),
+           candidates[chosen].to_string().c_str(), durations[chosen], fastest);
+  }
+  plan.save(path);
+  std::cout << "Placement saved to " << path << std::endl;
+  return 0;
+}
+#endif
+
+int main() {
+  std::cout << "ISA: " << isa_to_string(compiled_isa) << std::endl;
+
+  // #### MODIFY: size of the tables (see workload)
+  workload w;
+  // #### end MODIFY
+  if (const char *seed = std::getenv("DATA_SEED"))
+    w.seed = std::stoull(seed);
+  if (const char *dir = std::getenv("TABLE_DIR"))
+    w.table_dir = dir;
+  if (const char *populate = std::getenv("TABLE_POPULATE"))
+    w.populate = std::string(populate) != "0";
+
+  // the workers of tm are created once and reused by every run of query()
+  // #### MODIFY: you may also change to ThreadManager pinning to manually and
+  // pin
+  // #### the threadgroups by hand (hard)
+  ThreadManager tm(thread_pin_policy::automatic, query_pinning_ranges());
+  // #### end MODIFY
+
+  // #### MODIFY: select execution strategies (see query_config)
+  query_config config;
+  config.execution = ExecutionMode::FUSED;
+  config.build = BuildMode::AUTO;
+  config.prefilter = PreFilter::AUTO;
+  config.join_engine = JoinEngine::AUTO;
+  config.output = JoinOutput::AUTO;
+  config.format = ColumnFormat::AUTO;
+  // #### end MODIFY
+  // sampled validation for large tables (see checksum)
+  if (const char *stride = std::getenv("CHECKSUM_SAMPLE"))
+    config.checksum_sample_stride = std::stoul(stride);
+  // segments the kernels prefetch ahead (see segment_range.hpp)
+  if (const char *distance = std::getenv("PREFETCH_DISTANCE"))
+    segment_prefetch_distance = std::stoul(distance);
+
+  // stage placement of a previous tuning run (see run_tuning)
+  const char *placement_file = std::getenv("PLACEMENT_FILE");
+#if BENCHMARK_DRIVER
+  if (std::getenv("BENCH_TUNE") != nullptr)
+    return run_tuning(tm, config, w,
+                      placement_file != nullptr ? placement_file
+                                                : "placement.json");
+#endif
+  if (placement_file != nullptr && std::ifstream(placement_file).good())
+    config.placement = PlacementPlan::load(placement_file);
+
+#if BENCHMARK_DRIVER
+  if (std::getenv("BENCH_SWEEP") != nullptr)
+    return run_sweep(tm, config, w);
+#endif
+
+  auto [r, s] = open_tables(tm, w, config.thread_count);
+
+  // queries over the same r sharing its scans (see query_batch)
+  if (const char *batch = std::getenv("BATCH_QUERIES"))
+    return run_batch(tm, r, s, config, w, std::stoul(batch));
+  // SUM(a * b) GROUP BY fk instead of the sum (see query_group_by); the value
+  // selects the strategy: local, partitioned or auto
+  if (const char *group_by = std::getenv("GROUP_BY")) {
+    const std::string strategy = group_by;
+    if (strategy == "local")
+      config.group_strategy = GroupStrategy::LOCAL;
+    else if (strategy == "partitioned")
+      config.group_strategy = GroupStrategy::PARTITIONED;
+    else if (strategy != "auto" && !strategy.empty()) {
+      std::cerr << "Unknown GROUP_BY strategy: " << strategy
+                << " (local, partitioned or auto)" << std::endl;
+      return 1;
+    }
+    return run_group_by(tm, r, s, config, w);
+  }
 
   // Run query
-  const auto [fast_result, safe_result, seconds] = query(r, s);
+#if BENCHMARK_DRIVER
+  return run_benchmark(tm, r, s, config, w.memory_amount());
+#endif
+  const auto [fast_result, safe_result, seconds] = query(tm, r, s, config);
   // Query finished
 
-  const double throughput_Bps = memory_amount / seconds;
+  // how far the stages are from the memory bound (see roofline.hpp)
+  const roofline_config roofline = roofline_config::from_env();
+  if (!roofline.json_path.empty())
+    report_roofline(tm, config, w, seconds, roofline);
+
+  const double throughput_Bps = w.memory_amount() / seconds;
 
   std::cout << fast_result << std::endl
-            << safe_result << std::endl
+            << safe_result.to_string() << std::endl
             << throughput_Bps << std::endl
             << throughput_Bps // the sescond throughput is for compatibility
             << std::endl;
 
-  if (fast_result == safe_result)
+  if (safe_result.matches(fast_result))
     return 0;
   else {
     std::cerr << "Checksum and query result do not match!" << std::endl;
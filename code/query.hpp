@@ -1,10 +1,15 @@
 #include "allocator.hpp"
 #include "generator.hpp"
+#include "isa.hpp"
+#include "parallel_generator.hpp"
+#include <cmath>
 #include <cstdint>
+#include <optional>
 #include <tuple>
 #include <unordered_map>
 
 #include <iostream>
+#include <memory>
 #include <ostream>
 
 #include "algorithms/dbops/arithmetic/arithmetic.hpp"
@@ -12,19 +17,79 @@
 #include "algorithms/dbops/join/hash_join.hpp"
 #include "algorithms/dbops/join/hash_semi_join_simd_linear_probing.hpp"
 #include "algorithms/dbops/materialize/materialize.hpp"
+#include "operators/concurrent_linear_probing.hpp"
+#include "operators/exclusive_scan.hpp"
+#include "operators/group_aggregate.hpp"
+#include "operators/masked_aggregate.hpp"
+#include "operators/packed_column.hpp"
+#include "operators/semi_join_filter.hpp"
+#include "operators/stream_store.hpp"
+#include "operators/zone_map.hpp"
+#include "placement.hpp"
 #include "threads/ThreadManager.hpp"
 #include "vmalloc/VamPointer.hpp"
+#include "vmalloc/column_file.hpp"
+#include "vmalloc/segment_range.hpp"
 #include "vmalloc/vmalloc.hpp"
 #include <chrono>
 
 using namespace vampir;
 using namespace tuddbs;
 
+/// @brief TSL processing extension of all kernels of the query (the
+/// instruction set variant, see isa.hpp).
+using query_ext = tsl::QUERY_ISA;
+template <typename T> using query_style = tsl::simd<T, query_ext>;
+
+/// number of threads per thread group in query()
+constexpr uint32_t query_thread_count = 5;
+
+/// @brief CPU ranges the thread groups of query() are pinned to.
+std::vector<std::pair<int, int>> query_pinning_ranges() {
+  #if TESTING
+    return Crobat::get_testing_pinning_ranges();
+  #else
+    return Crobat::get_benchmarking_pinning_ranges();
+  #endif
+}
+
+/// @brief Exec nodes of query_pinning_ranges (candidates of the placement
+/// tuner, see PlacementPlan).
+std::vector<int> query_exec_nodes() {
+  #if TESTING
+    return {0, 1, 2, 3};
+  #else
+    return {4, 5, 6, 7};
+  #endif
+}
+
+/// bit-packed columns of r: a and b are in [1, 10000), fk in
+/// [0, fk_range_factor * size_special_1] (see workload)
+using packed_ab_t = PackedColumn<int64_t, 14>;
+using packed_fk_t = PackedColumn<uint32_t, 12>;
+
+/// @brief Packed copy of the columns of r (see pack_table), empty if r does
+/// not fit into the bits of packed_ab_t / packed_fk_t.
+struct packed_table_r {
+  packed_ab_t a;
+  packed_ab_t b;
+  packed_fk_t fk;
+
+  bool empty() const { return fk.empty(); }
+
+  size_t size_bytes() const {
+    return a.size_bytes() + b.size_bytes() + fk.size_bytes();
+  }
+};
+
 struct table_r {
   VamPointer<int64_t, 4096> a;
   VamPointer<int64_t, 4096> b;
   VamPointer<uint32_t, 2048> fk;
   size_t data_amount;
+  packed_table_r packed;
+  /// min / max of every fk segment (see build_zone_map), empty if unknown
+  ZoneMap<uint32_t> fk_zones;
 };
 
 struct table_s {
@@ -32,57 +97,751 @@ struct table_s {
   size_t data_amount;
 };
 
+enum class BuildMode {
+  SERIAL,   ///< SIMDOps linear probing builder, single threaded
+  PARALLEL, ///< concurrent (CAS) linear probing insert from a thread group
+  AUTO      ///< PARALLEL for build sides above parallel_build_threshold
+};
+
+/// @brief Minimum number of build side keys for BuildMode::AUTO to build in
+/// parallel (below, starting the thread group costs more than it saves).
+constexpr size_t parallel_build_threshold = 1 << 16;
+
+enum class PreFilter {
+  NONE,   ///< probe the hash table with every key
+  BLOOM,  ///< blocked Bloom filter in front of the hash table
+  BITMAP, ///< exact bitmap over [min, max] of the build side, no table probe
+  AUTO    ///< BITMAP for dense key domains, BLOOM for tables beyond L2
+};
+
+/// @brief PreFilter::AUTO uses a bitmap when the key domain of the build side
+/// needs at most this many bits per key.
+constexpr size_t bitmap_bits_per_key = 32;
+/// @brief PreFilter::AUTO puts a Bloom filter in front of hash tables of more
+/// than this many bytes (smaller ones are cache resident anyway).
+constexpr size_t bloom_table_threshold_bytes = 1 << 20;
+
+using bloom_filter_t = Blocked_Bloom_Filter<query_style<uint32_t>>;
+using bitmap_filter_t = Dense_Bitmap_Filter<query_style<uint32_t>>;
+using simd_join_t = tuddbs::Hash_Semi_Join_RightSide_SIMD_Linear_Probing<
+    query_style<uint32_t>, size_t>;
+using concurrent_join_t =
+    Hash_Semi_Join_RightSide_Concurrent_Linear_Probing<query_style<uint32_t>,
+                                                       size_t>;
+
+enum class JoinEngine {
+  HASH,  ///< linear probing hash table (optionally behind a PreFilter)
+  DENSE, ///< direct-indexed bitmap over [min, max] of the build side
+  RANGE, ///< DENSE build side that covers all of [min, max] -> range test
+  AUTO   ///< DENSE (RANGE if possible) for dense build sides, HASH otherwise
+};
+
+using range_filter_t = Dense_Range_Filter<query_style<uint32_t>>;
+
+/// @brief Statistics of the build side keys, collected in a first pass of the
+/// build and used to select the JoinEngine.
+struct build_stats {
+  uint32_t min_key = std::numeric_limits<uint32_t>::max();
+  uint32_t max_key = 0;
+  size_t count = 0;
+
+  void add(const uint32_t *keys, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      min_key = std::min(min_key, keys[i]);
+      max_key = std::max(max_key, keys[i]);
+    }
+    count += size;
+  }
+
+  void merge(const build_stats &other) {
+    if (other.count == 0)
+      return;
+    min_key = std::min(min_key, other.min_key);
+    max_key = std::max(max_key, other.max_key);
+    count += other.count;
+  }
+
+  /// @brief Size of the key domain [min_key, max_key].
+  size_t key_range() const {
+    return count == 0 ? 0 : static_cast<size_t>(max_key - min_key) + 1;
+  }
+};
+
 struct join_intermediate {
+  /// HASH, DENSE or RANGE (resolved by plan_join)
+  JoinEngine engine = JoinEngine::HASH;
+  build_stats stats;
+
+  /// hash table (JoinEngine::HASH only)
   VamPointer<uint32_t, 2048> keys;
   VamPointer<uint64_t, 4096> used;
+  /// SERIAL or PARALLEL, determines the table layout (and thereby the prober)
+  BuildMode build_mode = BuildMode::SERIAL;
+
+  /// NONE, BLOOM or BITMAP, filter is empty for NONE. The DENSE engine uses
+  /// the BITMAP as its only lookup structure.
+  PreFilter prefilter = PreFilter::NONE;
+  VamPointer<uint32_t, 4096> filter;
+  /// BLOOM: the filter has 1 << filter_log2_words words
+  uint32_t filter_log2_words = 0;
+  /// BITMAP/RANGE: the key domain is [filter_min_key, filter_min_key + range)
+  uint32_t filter_min_key = 0;
+  uint32_t filter_key_range = 0;
 };
 
+/// @brief Whether segment i of the fk sliver described by fk_zones may have
+/// a join partner, i.e. its zone overlaps the key range of the build side
+/// (always true without a zone map).
+inline bool may_join(const join_intermediate &ji,
+                     const ZoneMap<uint32_t> &fk_zones, size_t i) {
+  return fk_zones.may_contain(i, ji.stats.min_key, ji.stats.max_key);
+}
+
 struct join_result {
   VamPointer<size_t, 4096> positions;
   VamPointer<size_t, sizeof(size_t)> lengths;
 };
 
-int64_t checksum(table_r &r, table_s &s) {
-  // original compute code for validation
-  std::unordered_map<uint32_t, bool> map;
-  map.reserve(s.pk.size());
-  for (size_t j = 0; j < s.pk.size(); j++) {
-    map[s.pk[j]] = 1;
+enum class ExecutionMode {
+  STAGED, ///< one thread group and one full-size intermediate per operator
+  FUSED   ///< probe, materialize, multiply and reduce per segment in one thread
+};
+
+enum class JoinOutput {
+  POSITION_LIST, ///< size_t positions of the hits, a and b are gathered
+  BITMASK,       ///< one bit per row, a and b are read in full (masked)
+  AUTO           ///< BITMASK above bitmask_min_selectivity (sampled)
+};
+
+/// above this share of qualifying rows nearly every cache line of a and b is
+/// touched by the gather anyway (8 int64 per line), so reading them in full
+/// with a bitmask is cheaper than writing and gathering through positions
+constexpr double bitmask_min_selectivity = 1.0 / 8;
+/// number of leading fk segments probed to estimate the selectivity
+constexpr size_t selectivity_sample_segments = 16;
+
+/// @brief Storage of r scanned by the fused pipeline (the staged pipelines
+/// always scan the plain columns).
+enum class ColumnFormat {
+  PLAIN,  ///< int64_t a and b, uint32_t fk
+  PACKED, ///< bit-packed copies of r (see packed_table_r), decoded per segment
+  AUTO    ///< PACKED if r has been packed
+};
+
+/// @brief Selects between the implemented strategies of query().
+struct query_config {
+  ExecutionMode execution = ExecutionMode::FUSED;
+  BuildMode build = BuildMode::AUTO;
+  PreFilter prefilter = PreFilter::AUTO;
+  /// a forced RANGE is treated as DENSE (it is only safe for verified domains)
+  JoinEngine join_engine = JoinEngine::AUTO;
+  JoinOutput output = JoinOutput::AUTO;
+  ColumnFormat format = ColumnFormat::AUTO;
+  /// page type of the full-size intermediate columns
+  PageType intermediate_pages = Transparent_HugePages;
+  /// fault in the intermediate columns before the timed sections
+  bool prefault = true;
+  /// segments per morsel of the dynamically scheduled stages of the staged
+  /// pipeline, which then overlap per morsel (materialize also balances the
+  /// uneven join_res.lengths); 0 for statically split stages with barriers
+  size_t morsel_segments = 64;
+  /// print the sections and thread group timings after the run (the
+  /// benchmark driver collects them itself)
+  bool print_timings = true;
+  /// threads per thread group
+  uint32_t thread_count = query_thread_count;
+  /// skip fk segments outside of the build side's key range (see
+  /// table_r::fk_zones)
+  bool use_zone_maps = true;
+  /// check only every n-th block of r against the query result (see
+  /// checksum), 1 for the exact checksum
+  size_t checksum_sample_stride = 1;
+  /// thread count and cores of individual thread groups, overrides
+  /// thread_count (see PlacementPlan)
+  PlacementPlan placement;
+  /// thread-local tables or partitions of the grouped query (see
+  /// query_group_by)
+  GroupStrategy group_strategy = GroupStrategy::AUTO;
+
+  /// @throws std::invalid_argument if PACKED is forced, but r is not packed
+  ColumnFormat resolve_format(const table_r &r) const {
+    if (format == ColumnFormat::PACKED && r.packed.empty())
+      throw std::invalid_argument("ColumnFormat::PACKED needs a packed r");
+    if (format == ColumnFormat::AUTO)
+      return r.packed.empty() ? ColumnFormat::PLAIN : ColumnFormat::PACKED;
+    return format;
+  }
+
+  BuildMode resolve_build(size_t build_side_size) const {
+    if (build != BuildMode::AUTO)
+      return build;
+    return build_side_size >= parallel_build_threshold ? BuildMode::PARALLEL
+                                                       : BuildMode::SERIAL;
+  }
+};
+
+/// @brief Size and shape of the tables generated by main (see
+/// generate_tables), varied by the sweep of the benchmark driver.
+struct workload {
+  size_t data_amount = 1024 * 1024 * 128LL;
+  size_t size_special_1 = 1024;
+  /// r.fk is uniform in [0, fk_range_factor * size_special_1], so about
+  /// 1 / fk_range_factor of r joins
+  size_t fk_range_factor = 3;
+  /// memory type of the columns of r, empty for the predicted one
+  std::optional<Memory> memory;
+  /// also store bit-packed copies of r (see ColumnFormat)
+  bool pack = true;
+  /// seed of the generated data (DATA_SEED), empty for a random one
+  std::optional<uint64_t> seed;
+  /// directory of the column files of the tables (TABLE_DIR), loaded from
+  /// there if they exist and saved there after generating them otherwise;
+  /// empty to always generate (see open_tables)
+  std::string table_dir;
+  /// read loaded tables in up front (TABLE_POPULATE), otherwise the first
+  /// query faults them in
+  bool populate = true;
+
+  /// bytes of the base tables (the throughput reported by main)
+  size_t memory_amount() const {
+    return 2 * data_amount * sizeof(int64_t) + data_amount * sizeof(uint32_t) +
+           size_special_1 * sizeof(uint32_t);
+  }
+};
+
+/**
+ * @brief Collects the build_stats of one sliver of the build side into
+ * stats[0]. Is run by a thread group with pk and stats wrapped in a
+ * SplitWrapper (one stats element per thread), or on the whole build side.
+ */
+void collect_build_stats(VamPointer<uint32_t, 2048> pk,
+                         VamPointer<build_stats, sizeof(build_stats)> stats) {
+  build_stats result;
+  for (size_t i = 0; i < pk.segment_count(); i++) {
+    auto [ptr, size] = pk.get_segment(i);
+    result.add(ptr, size);
+  }
+  stats[0] = result;
+}
+
+/**
+ * @brief Selects the join engine and pre-filter of ji from ji.stats and
+ * allocates the structures they need (hash table and/or filter words). The
+ * bits and keys are inserted by building()/building_concurrent().
+ */
+void plan_join(join_intermediate &ji, const query_config &config) {
+  const build_stats &stats = ji.stats;
+  const size_t key_range = stats.key_range();
+  // the range of a bitmap over the full 32 bit domain does not fit 32 bits
+  const bool bitmap_possible =
+      stats.count > 0 && key_range <= std::numeric_limits<uint32_t>::max();
+
+  JoinEngine engine = config.join_engine;
+  if (engine == JoinEngine::AUTO) {
+    engine = (bitmap_possible && key_range <= bitmap_bits_per_key * stats.count)
+                 ? JoinEngine::DENSE
+                 : JoinEngine::HASH;
+  } else if (engine == JoinEngine::RANGE) {
+    engine = JoinEngine::DENSE; // promoted by finish_building if it holds
+  }
+  if (engine == JoinEngine::DENSE && !bitmap_possible)
+    engine = JoinEngine::HASH;
+  ji.engine = engine;
+
+  PreFilter prefilter = config.prefilter;
+  if (engine == JoinEngine::DENSE) {
+    prefilter = PreFilter::BITMAP;
+  } else {
+    // the table and the filters have to be zero before the build, reused
+    // memory is cleared per sliver by the builders (see build_join)
+    // the concurrent table needs a power of two slot count
+    const size_t slots = ji.build_mode == BuildMode::PARALLEL
+                             ? concurrent_join_t::bucket_count_for(stats.count)
+                             : stats.count * 2;
+    ji.keys = vmalloc<uint32_t, 2048>(slots, AccessPattern::LINEAR, K4_Normal,
+                                      false);
+    ji.used = vmalloc<uint64_t, 4096>(slots, AccessPattern::LINEAR, K4_Normal,
+                                      false);
+
+    if (prefilter == PreFilter::AUTO) {
+      const size_t table_bytes = ji.keys.size() * sizeof(uint32_t) +
+                                 ji.used.size() * sizeof(uint64_t);
+      if (bitmap_possible && key_range <= bitmap_bits_per_key * stats.count)
+        prefilter = PreFilter::BITMAP;
+      else if (table_bytes > bloom_table_threshold_bytes)
+        prefilter = PreFilter::BLOOM;
+      else
+        prefilter = PreFilter::NONE;
+    }
+    if (prefilter == PreFilter::BITMAP && !bitmap_possible)
+      prefilter = PreFilter::BLOOM;
+  }
+  if (stats.count == 0)
+    prefilter = PreFilter::NONE;
+
+  ji.prefilter = prefilter;
+  if (prefilter == PreFilter::BITMAP) {
+    ji.filter_min_key = stats.min_key;
+    ji.filter_key_range = key_range;
+    ji.filter = vmalloc<uint32_t, 4096>(bitmap_filter_t::word_count(key_range),
+                                        AccessPattern::RANDOM, K4_Normal,
+                                        false);
+  } else if (prefilter == PreFilter::BLOOM) {
+    ji.filter_log2_words = bloom_filter_t::log2_word_count(stats.count);
+    ji.filter = vmalloc<uint32_t, 4096>(size_t(1) << ji.filter_log2_words,
+                                        AccessPattern::RANDOM, K4_Normal,
+                                        false);
+  }
+}
+
+/**
+ * @brief Finalizes the join structures after all keys are inserted. A DENSE
+ * bitmap with all bits of its domain set is replaced by a plain range test.
+ */
+void finish_building(join_intermediate &ji) {
+  if (ji.engine != JoinEngine::DENSE)
+    return;
+
+  size_t set_bits = 0;
+  for (size_t i = 0; i < ji.filter.segment_count(); i++) {
+    auto [ptr, size] = ji.filter.get_segment(i);
+    for (size_t j = 0; j < size; j++)
+      set_bits += std::popcount(ptr[j]);
+  }
+  if (set_bits == ji.filter_key_range)
+    ji.engine = JoinEngine::RANGE;
+}
+
+/**
+ * @brief Sets the pre-filter bits of count build side keys.
+ * @tparam CONCURRENT - whether other threads insert into the same filter
+ */
+template <bool CONCURRENT>
+void insert_prefilter(join_intermediate &ji, const uint32_t *keys,
+                      size_t count) {
+  if (ji.prefilter == PreFilter::BLOOM) {
+    bloom_filter_t::builder_t(ji.filter.data(0), ji.filter_log2_words)
+        .insert<CONCURRENT>(keys, count);
+  } else if (ji.prefilter == PreFilter::BITMAP) {
+    bitmap_filter_t::builder_t(ji.filter.data(0), ji.filter_min_key)
+        .insert<CONCURRENT>(keys, count);
+  }
+}
+
+/// @brief Probes a join_intermediate with the lookup structure of its engine:
+/// the hash table matching the builder it was filled with (see
+/// join_intermediate::build_mode), the dense bitmap or the range test. If a
+/// hash table has a pre-filter, keys are tested against it first and only the
+/// candidates probe the table (none for the exact bitmap).
+class semi_join_prober {
+private:
+  /// keys are filtered in chunks of this size (one fk segment)
+  static constexpr size_t chunk_size = 2048 / sizeof(uint32_t);
+
+  enum class probe_kind { TABLE, BLOOM_TABLE, BITMAP, RANGE };
+
+  probe_kind kind;
+  BuildMode build_mode;
+  simd_join_t::prober_t simd_prober;
+  concurrent_join_t::prober_t concurrent_prober;
+  bloom_filter_t::prober_t bloom_prober;
+  bitmap_filter_t::prober_t bitmap_prober;
+  range_filter_t::prober_t range_prober;
+
+  alignas(64) uint32_t candidate_keys[chunk_size];
+  alignas(64) uint32_t candidate_positions[chunk_size];
+  alignas(64) size_t candidate_hits[chunk_size];
+  alignas(64) size_t mask_positions[chunk_size];
+
+  template <typename T, size_t S> static T *first(const VamPointer<T, S> &ptr) {
+    return ptr.size() == 0 ? nullptr : ptr.data(0);
+  }
+
+  static probe_kind kind_of(const join_intermediate &ji) {
+    if (ji.engine == JoinEngine::RANGE)
+      return probe_kind::RANGE;
+    if (ji.engine == JoinEngine::DENSE || ji.prefilter == PreFilter::BITMAP)
+      return probe_kind::BITMAP;
+    if (ji.prefilter == PreFilter::BLOOM)
+      return probe_kind::BLOOM_TABLE;
+    return probe_kind::TABLE;
+  }
+
+  size_t probe_table(size_t *positions, uint32_t *keys, size_t count) {
+    if (build_mode == BuildMode::PARALLEL)
+      return concurrent_prober(positions, keys, count);
+    else
+      return simd_prober(positions, keys, count);
+  }
+
+public:
+  semi_join_prober(const join_intermediate &ji)
+      : kind(kind_of(ji)), build_mode(ji.build_mode),
+        simd_prober(first(ji.keys), first(ji.used), ji.used.size()),
+        concurrent_prober(first(ji.keys), first(ji.used), ji.keys.size()),
+        bloom_prober(first(ji.filter), ji.filter_log2_words),
+        bitmap_prober(first(ji.filter), ji.filter_min_key,
+                      ji.filter_key_range),
+        range_prober(ji.filter_min_key, ji.filter_key_range) {}
+
+  /// @brief Writes the positions (relative to keys) of all matching keys.
+  /// @return number of written positions
+  size_t operator()(size_t *positions, uint32_t *keys, size_t count) {
+    if (kind == probe_kind::TABLE)
+      return probe_table(positions, keys, count);
+
+    size_t hits = 0;
+    for (size_t begin = 0; begin < count; begin += chunk_size) {
+      const size_t chunk = std::min(chunk_size, count - begin);
+
+      if (kind == probe_kind::BLOOM_TABLE) {
+        size_t candidates = bloom_prober(candidate_keys, candidate_positions,
+                                         keys + begin, chunk);
+        size_t found = probe_table(candidate_hits, candidate_keys, candidates);
+        for (size_t j = 0; j < found; j++)
+          positions[hits + j] = begin + candidate_positions[candidate_hits[j]];
+        hits += found;
+      } else {
+        // exact -> every candidate is a hit
+        size_t candidates =
+            kind == probe_kind::RANGE
+                ? range_prober(candidate_keys, candidate_positions,
+                               keys + begin, chunk)
+                : bitmap_prober(candidate_keys, candidate_positions,
+                                keys + begin, chunk);
+        for (size_t j = 0; j < candidates; j++)
+          positions[hits + j] = begin + candidate_positions[j];
+        hits += candidates;
+      }
+    }
+    return hits;
+  }
+
+  /// @brief Writes the selection bitmask of keys (bit i is set if keys[i]
+  /// matches, see clear_mask).
+  /// @return number of matching keys
+  size_t mask(uint64_t *mask, uint32_t *keys, size_t count) {
+    if (kind == probe_kind::RANGE)
+      return range_prober.mask(mask, keys, count);
+    if (kind == probe_kind::BITMAP)
+      return bitmap_prober.mask(mask, keys, count);
+
+    // hash table probers only emit positions -> set their bits
+    clear_mask(mask, count);
+    size_t hits = 0;
+    for (size_t begin = 0; begin < count; begin += chunk_size) {
+      const size_t chunk = std::min(chunk_size, count - begin);
+      const size_t found = (*this)(mask_positions, keys + begin, chunk);
+      for (size_t j = 0; j < found; j++) {
+        const size_t row = begin + mask_positions[j];
+        mask[row >> 6] |= uint64_t(1) << (row & 63);
+      }
+      hits += found;
+    }
+    return hits;
+  }
+};
+
+/// rows of a block of the sampled checksum (64 segments of r.fk)
+constexpr size_t checksum_sample_block_rows = 64 * 512;
+/// maximum relative error of the query result to the extrapolated sum of
+/// the sampled checksum
+constexpr double checksum_sample_tolerance = 0.01;
+
+/// @brief Reference result of the query (see checksum): exact, or the sum of
+/// a sample of the blocks of r extrapolated to all rows.
+struct checksum_result {
+  int64_t sum = 0;
+  /// share of the rows of r summed up (1 for the exact checksum)
+  double sampled_fraction = 1.0;
+
+  bool exact() const { return sampled_fraction >= 1.0; }
+
+  /**
+   * @brief Whether result is the sum (exact) or within
+   * checksum_sample_tolerance of the extrapolated sum (sampled). A 1%
+   * tolerance does not detect small errors, e.g. a skipped segment of a
+   * large r, so the sampled checksum is only meant for inputs too large for
+   * the exact one.
+   */
+  bool matches(int64_t result) const {
+    if (exact())
+      return result == sum;
+    const double difference = std::abs(static_cast<double>(result) - sum);
+    return difference <= checksum_sample_tolerance * std::abs(double(sum));
+  }
+
+  /// @brief The checksum line of the results: the sum, followed by
+  /// " ~<relative tolerance>" if sampled (read by competition.py).
+  std::string to_string() const {
+    if (exact())
+      return std::to_string(sum);
+    return std::to_string(sum) + " ~" +
+           std::to_string(checksum_sample_tolerance);
+  }
+};
+
+/// @brief Sum and rows of one sliver of the checksum.
+struct checksum_partial {
+  int64_t sum = 0;
+  size_t rows = 0;
+};
+
+/**
+ * @brief Sums a * b over the rows of a sliver of r whose fk is set in
+ * pk_bitmap, scalar and without the bounds checks of VamPointer::operator[].
+ * With a sample_stride > 1 only every sample_stride-th block of
+ * checksum_sample_block_rows rows of r is summed up (counted from the start
+ * of the column at a_base, so the sample does not depend on the split).
+ * @param count rows of r (the last sliver may extend past them, see
+ * VamPointer::split)
+ */
+void checksum_sliver(VamPointer<int64_t, 4096> a, VamPointer<int64_t, 4096> b,
+                     VamPointer<uint32_t, 2048> fk,
+                     VamPointer<checksum_partial, sizeof(checksum_partial)>
+                         partial,
+                     const int64_t *a_base, size_t count,
+                     const std::vector<uint64_t> *pk_bitmap,
+                     size_t sample_stride) {
+  if (a.size() == 0)
+    return;
+  const int64_t *a_data = a.data(0);
+  const int64_t *b_data = b.data(0);
+  const uint32_t *fk_data = fk.data(0);
+  const size_t begin = a_data - a_base;
+  if (begin >= count)
+    return;
+  const size_t end = std::min(begin + a.size(), count);
+  const uint64_t *bitmap = pk_bitmap->data();
+  const size_t bitmap_keys = pk_bitmap->size() * 64;
+
+  checksum_partial result;
+  const size_t first_block =
+      begin / checksum_sample_block_rows * checksum_sample_block_rows;
+  for (size_t block = first_block; block < end;
+       block += checksum_sample_block_rows) {
+    if ((block / checksum_sample_block_rows) % sample_stride != 0)
+      continue;
+    const size_t first = std::max(block, begin) - begin;
+    const size_t last =
+        std::min(block + checksum_sample_block_rows, end) - begin;
+    for (size_t i = first; i < last; i++) {
+      const uint32_t key = fk_data[i];
+      if (key < bitmap_keys && (bitmap[key >> 6] >> (key & 63) & 1))
+        result.sum += a_data[i] * b_data[i];
+    }
+    result.rows += last - first;
+  }
+  partial[0] = result;
+}
+
+/// @brief Flat bitmap of the keys of s.pk (bit k is set if k is a key).
+std::vector<uint64_t> pk_bitmap_of(const table_s &s) {
+  uint32_t max_key = 0;
+  const uint32_t *pk = s.pk.size() > 0 ? s.pk.data(0) : nullptr;
+  for (size_t j = 0; j < s.pk.size(); j++)
+    max_key = std::max(max_key, pk[j]);
+  std::vector<uint64_t> pk_bitmap((size_t(max_key) >> 6) + 1, 0);
+  for (size_t j = 0; j < s.pk.size(); j++)
+    pk_bitmap[pk[j] >> 6] |= uint64_t(1) << (pk[j] & 63);
+  return pk_bitmap;
+}
+
+/**
+ * @brief Reference implementation of the query for validation: the keys of
+ * s.pk are collected in a flat bitmap, then thread_count threads of tm (on
+ * the cores of query_pinning_ranges, i.e. next to the slivers of r) sum up
+ * their sliver of r (see checksum_sliver). sample_stride > 1 only sums up
+ * every sample_stride-th block of r and extrapolates the sum.
+ */
+checksum_result checksum(ThreadManager &tm, table_r &r, table_s &s,
+                         uint32_t thread_count, size_t sample_stride = 1) {
+  if (sample_stride == 0)
+    throw std::invalid_argument("Checksum sample stride must be > 0");
+  checksum_result result;
+  if (r.a.size() == 0)
+    return result;
+
+  const std::vector<uint64_t> pk_bitmap = pk_bitmap_of(s);
+
+  auto partials = vmalloc<checksum_partial, sizeof(checksum_partial)>(
+      thread_count, AccessPattern::LINEAR);
+  for (size_t i = 0; i < thread_count; i++)
+    partials[i] = checksum_partial();
+  tm.create_thread_group<false, false>(
+      "checksum_group", thread_count, checksum_sliver,
+      SplitWrapper<0, typeof(r.a)>(&r.a), SplitWrapper<0, typeof(r.b)>(&r.b),
+      SplitWrapper<0, typeof(r.fk)>(&r.fk),
+      SplitWrapper<0, typeof(partials)>(&partials), r.a.data(0),
+      r.data_amount, &pk_bitmap, sample_stride);
+  tm.pin_threads_for_group("checksum_group", query_pinning_ranges());
+  tm.run({"checksum_group"});
+
+  size_t rows = 0;
+  for (size_t i = 0; i < thread_count; i++) {
+    result.sum += partials[i].sum;
+    rows += partials[i].rows;
+  }
+  if (rows < r.data_amount && rows > 0) {
+    result.sampled_fraction = static_cast<double>(rows) / r.data_amount;
+    result.sum = static_cast<int64_t>(result.sum / result.sampled_fraction);
+  }
+  return result;
+}
+
+/**
+ * @brief Sums a * b and counts the rows by fk over the rows of a sliver of r
+ * whose fk is set in pk_bitmap, like checksum_sliver, into the dense
+ * (*sums)[t] and (*rows)[t] (indexed by key) of thread t = thread_id[0].
+ */
+void checksum_group_sliver(VamPointer<int64_t, 4096> a,
+                           VamPointer<int64_t, 4096> b,
+                           VamPointer<uint32_t, 2048> fk,
+                           VamPointer<size_t, sizeof(size_t)> thread_id,
+                           const int64_t *a_base, size_t count,
+                           const std::vector<uint64_t> *pk_bitmap,
+                           std::vector<std::vector<int64_t>> *sums,
+                           std::vector<std::vector<uint64_t>> *rows) {
+  if (a.size() == 0)
+    return;
+  const int64_t *a_data = a.data(0);
+  const int64_t *b_data = b.data(0);
+  const uint32_t *fk_data = fk.data(0);
+  const size_t begin = a_data - a_base;
+  if (begin >= count)
+    return;
+  const size_t end = std::min(begin + a.size(), count);
+  const uint64_t *bitmap = pk_bitmap->data();
+  const size_t bitmap_keys = pk_bitmap->size() * 64;
+
+  std::vector<int64_t> &key_sums = (*sums)[thread_id[0]];
+  std::vector<uint64_t> &key_rows = (*rows)[thread_id[0]];
+  key_sums.assign(bitmap_keys, 0);
+  key_rows.assign(bitmap_keys, 0);
+  for (size_t i = 0; i < end - begin; i++) {
+    const uint32_t key = fk_data[i];
+    if (key < bitmap_keys && (bitmap[key >> 6] >> (key & 63) & 1)) {
+      key_sums[key] += a_data[i] * b_data[i];
+      key_rows[key]++;
+    }
+  }
+}
+
+/**
+ * @brief Reference implementation of the grouped query (SUM(a * b) GROUP BY
+ * fk over the rows of r joining s) for validation: thread_count threads sum
+ * up their sliver of r by key into dense arrays over the keys of s (see
+ * checksum_group_sliver), which are added up here.
+ */
+grouped_sums checksum_group_by(ThreadManager &tm, table_r &r, table_s &s,
+                               uint32_t thread_count) {
+  grouped_sums result;
+  if (r.a.size() == 0)
+    return result;
+
+  const std::vector<uint64_t> pk_bitmap = pk_bitmap_of(s);
+  std::vector<std::vector<int64_t>> sums(thread_count);
+  std::vector<std::vector<uint64_t>> rows(thread_count);
+  auto thread_ids =
+      vmalloc<size_t, sizeof(size_t)>(thread_count, AccessPattern::LINEAR);
+  for (size_t i = 0; i < thread_count; i++)
+    thread_ids[i] = i;
+  tm.create_thread_group<false, false>(
+      "checksum_group_by", thread_count, checksum_group_sliver,
+      SplitWrapper<0, typeof(r.a)>(&r.a), SplitWrapper<0, typeof(r.b)>(&r.b),
+      SplitWrapper<0, typeof(r.fk)>(&r.fk),
+      SplitWrapper<0, typeof(thread_ids)>(&thread_ids), r.a.data(0),
+      r.data_amount, &pk_bitmap, &sums, &rows);
+  tm.pin_threads_for_group("checksum_group_by", query_pinning_ranges());
+  tm.run({"checksum_group_by"});
+
+  const size_t bitmap_keys = pk_bitmap.size() * 64;
+  for (size_t key = 0; key < bitmap_keys; key++) {
+    int64_t sum = 0;
+    uint64_t key_rows = 0;
+    for (size_t t = 0; t < thread_count; t++) {
+      if (rows[t].empty())
+        continue;
+      sum += sums[t][key];
+      key_rows += rows[t][key];
+    }
+    if (key_rows > 0) {
+      result.keys.push_back(key);
+      result.sums.push_back(sum);
+    }
   }
-  int64_t safe_sum = 0;
-  for (size_t i = 0; i < r.a.size(); i++) {
-    safe_sum += (r.a[i] * r.b[i]) * map[r.fk[i]];
+  return result;
+}
+
+/**
+ * @brief Writes the materialization offset of each probed segment (exclusive
+ * prefix sum of lengths) to offsets, starting at *carry, which holds the total
+ * afterwards. Consecutive slivers have to be passed in order, e.g. by a single
+ * threaded dynamic thread group that follows the probe morsel by morsel.
+ */
+void prefix_offsets(VamPointer<size_t, sizeof(size_t)> offsets,
+                    VamPointer<size_t, sizeof(size_t)> lengths,
+                    size_t *carry) {
+  for (size_t i = 0; i < lengths.segment_count(); i++) {
+    offsets[i] = *carry;
+    *carry += std::get<0>(lengths.get_segment(i))[0];
   }
-  return safe_sum;
 }
 
-void materialize_position_list(VamPointer<int64_t, 4096> result,
-                               VamPointer<int64_t, 4096> data,
-                               VamPointer<size_t, 4096> positions,
-                               VamPointer<size_t, sizeof(size_t)> offset,
-                               VamPointer<size_t, sizeof(size_t)> size) {
+/// @brief Gathers the rows of data at the positions of every position list
+/// segment to result (at the segment's offset). positions has the same rows
+/// per segment as data.
+template <typename T, size_t S>
+void materialize_position_list(
+    VamPointer<T, S> result, VamPointer<T, S> data,
+    VamPointer<size_t, S / sizeof(T) * sizeof(size_t)> positions,
+    VamPointer<size_t, sizeof(size_t)> offset,
+    VamPointer<size_t, sizeof(size_t)> size) {
 
-  Materialize<tsl::simd<int64_t, tsl::avx512>,
+  Materialize<query_style<T>,
               OperatorHintSet<hints::intermediate::position_list>>
       mat;
-  for (size_t i = 0; i < positions.segment_count(); i++) {
-    auto [size_ptr, size_size] = size.get_segment(i);
-    auto [offset_ptr, offset_size] = offset.get_segment(i);
-    auto [pos_ptr, pos_size] = positions.get_segment(i);
-    auto [data_ptr, data_size] = data.get_segment(i);
+  Stream_Materialize<query_style<T>> stream_mat;
+  const bool stream = result.access_pattern() == AccessPattern::STREAM_WRITE;
+  // data is gathered: prefetch the rows of the upcoming position lists
+  // instead of whole data segments
+  const auto segments = lockstep(positions, no_prefetch(data), offset, size);
+  for (auto [i, pos, data_seg, off, len] : segments) {
+    const size_t ahead = i + segments.prefetch_distance();
+    if (segments.prefetch_distance() > 0 && ahead < segments.size())
+      prefetch_gather(segments.template column<1>(ahead).data,
+                      segments.template column<0>(ahead).data,
+                      segments.template column<3>(ahead).data[0]);
 
-    mat(result.data(offset_ptr[0]), data_ptr, data_ptr + data_size, pos_ptr,
-        size_ptr[0]);
+    if (stream)
+      stream_mat(result.data(off.data[0]), data_seg.data, pos.data,
+                 len.data[0]);
+    else
+      mat(result.data(off.data[0]), data_seg.data,
+          data_seg.data + data_seg.size, pos.data, len.data[0]);
   }
+  if (stream)
+    stream_fence();
 }
 
+/**
+ * @brief Inserts the build side into the structures selected by plan_join,
+ * single threaded (hash table with the SIMDOps builder).
+ */
 void building(join_intermediate &ji, table_s &right_side) {
-  using join_t = tuddbs::Hash_Semi_Join_RightSide_SIMD_Linear_Probing<
-      tsl::simd<uint32_t, tsl::avx512>, size_t>;
+  ji.build_mode = BuildMode::SERIAL;
+
+  for (size_t i = 0; i < right_side.pk.segment_count(); i++) {
+    auto [ptr, size] = right_side.pk.get_segment(i);
+    insert_prefilter<false>(ji, ptr, size);
+  }
+  if (ji.engine != JoinEngine::HASH)
+    return;
 
   auto [key_ptr, key_size] = ji.keys.get_segment(0);
   auto [used_ptr, used_size] = ji.used.get_segment(0);
-  join_t::builder_t builder(key_ptr, used_ptr, ji.keys.size(), ji.used.size());
+  simd_join_t::builder_t builder(key_ptr, used_ptr, ji.keys.size(),
+                                 ji.used.size());
 
   for (size_t i = 0; i < right_side.pk.segment_count(); i++) {
     auto [ptr, size] = right_side.pk.get_segment(i);
@@ -90,47 +849,446 @@ void building(join_intermediate &ji, table_s &right_side) {
   }
 }
 
-void probing(VamPointer<uint32_t, 2048> keys, VamPointer<uint64_t, 4096> used,
-             VamPointer<uint32_t, 2048> fk, VamPointer<size_t, 4096> positions,
+/**
+ * @brief Inserts one sliver of the build side into the structures selected by
+ * plan_join (hash table with concurrent inserts). Is run by all threads of a
+ * thread group at once with pk wrapped in a SplitWrapper. ji is passed by
+ * pointer as plan_join fills it after the thread group is created;
+ * ji->build_mode has to be BuildMode::PARALLEL.
+ */
+void building_concurrent(join_intermediate *ji,
+                         VamPointer<uint32_t, 2048> pk) {
+  for (size_t i = 0; i < pk.segment_count(); i++) {
+    auto [ptr, size] = pk.get_segment(i);
+    insert_prefilter<true>(*ji, ptr, size);
+  }
+  if (ji->engine != JoinEngine::HASH)
+    return;
+
+  auto [key_ptr, key_size] = ji->keys.get_segment(0);
+  auto [used_ptr, used_size] = ji->used.get_segment(0);
+  concurrent_join_t::builder_t builder(key_ptr, used_ptr, ji->keys.size());
+
+  for (size_t i = 0; i < pk.segment_count(); i++) {
+    auto [ptr, size] = pk.get_segment(i);
+    if (!builder(ptr, size))
+      throw std::runtime_error("concurrent hash table is full");
+  }
+}
+
+void probing(join_intermediate ji, VamPointer<uint32_t, 2048> fk,
+             ZoneMap<uint32_t> fk_zones, VamPointer<size_t, 4096> positions,
              VamPointer<size_t, sizeof(size_t)> lengths) {
-  using join_t = tuddbs::Hash_Semi_Join_RightSide_SIMD_Linear_Probing<
-      tsl::simd<uint32_t, tsl::avx512>, size_t>;
+  semi_join_prober prober(ji);
 
-  auto [key_ptr, key_size] = keys.get_segment(0);
-  auto [used_ptr, used_size] = used.get_segment(0);
-  join_t::prober_t prober(key_ptr, used_ptr, used.size());
+  for (auto [i, keys, pos, len] : lockstep(fk, positions, lengths)) {
+    len.data[0] = may_join(ji, fk_zones, i)
+                      ? prober(pos.data, keys.data, keys.size)
+                      : 0;
+  }
+}
 
-  for (size_t i = 0; i < fk.segment_count(); i++) {
+/**
+ * @brief probing fused with the first pass of the offset scan: additionally
+ * writes the offset of each segment within the sliver (exclusive prefix sum
+ * of lengths) to offsets and the sliver total to sliver_total[0], so only the
+ * sliver bases are left to add (see add_sliver_base).
+ */
+void probing_with_offsets(join_intermediate ji, VamPointer<uint32_t, 2048> fk,
+                          ZoneMap<uint32_t> fk_zones,
+                          VamPointer<size_t, 4096> positions,
+                          VamPointer<size_t, sizeof(size_t)> lengths,
+                          VamPointer<size_t, sizeof(size_t)> offsets,
+                          VamPointer<size_t, sizeof(size_t)> sliver_total) {
+  semi_join_prober prober(ji);
+
+  size_t offset = 0;
+  for (auto [i, keys, pos, len, off] :
+       lockstep(fk, positions, lengths, offsets)) {
+    len.data[0] = may_join(ji, fk_zones, i)
+                      ? prober(pos.data, keys.data, keys.size)
+                      : 0;
+    off.data[0] = offset;
+    offset += len.data[0];
+  }
+  sliver_total[0] = offset;
+}
+
+/**
+ * @brief Probes fk and writes a selection bitmask (one bit per row) instead of
+ * a position list. The mask segments (64 B) cover the same 512 rows as the fk
+ * segments.
+ */
+void probing_mask(join_intermediate ji, VamPointer<uint32_t, 2048> fk,
+                  ZoneMap<uint32_t> fk_zones, VamPointer<uint64_t, 64> mask) {
+  semi_join_prober prober(ji);
+
+  for (auto [i, keys, bits] : lockstep(fk, mask)) {
+    if (may_join(ji, fk_zones, i))
+      prober.mask(bits.data, keys.data, keys.size);
+    else
+      clear_mask(bits.data, keys.size);
+  }
+}
+
+/**
+ * @brief Estimates the share of fk rows with a join partner by probing the
+ * first selectivity_sample_segments segments.
+ */
+double sample_selectivity(const join_intermediate &ji,
+                          VamPointer<uint32_t, 2048> &fk) {
+  semi_join_prober prober(ji);
+  alignas(64) size_t pos_buf[2048 / sizeof(uint32_t)];
+
+  size_t rows = 0;
+  size_t hits = 0;
+  const size_t segments =
+      std::min(selectivity_sample_segments, fk.segment_count());
+  for (size_t i = 0; i < segments; i++) {
     auto [ptr, size] = fk.get_segment(i);
-    auto [pos_ptr, pos_size] = positions.get_segment(i);
-    auto [len_ptr, len_size] = lengths.get_segment(i);
-    len_ptr[0] = prober(pos_ptr, ptr, size);
+    hits += prober(pos_buf, ptr, size);
+    rows += size;
   }
+  return rows == 0 ? 0.0 : static_cast<double>(hits) / rows;
+}
+
+/// @brief Resolves JoinOutput::AUTO from the sampled selectivity.
+JoinOutput resolve_output(const join_intermediate &ji,
+                          VamPointer<uint32_t, 2048> &fk, JoinOutput output) {
+  if (output != JoinOutput::AUTO)
+    return output;
+  return sample_selectivity(ji, fk) >= bitmask_min_selectivity
+             ? JoinOutput::BITMASK
+             : JoinOutput::POSITION_LIST;
 }
 
-void multiply(VamPointer<int64_t, 4096> result, VamPointer<int64_t, 4096> col_a,
-              VamPointer<int64_t, 4096> col_b) {
+template <typename T, size_t S>
+void multiply(VamPointer<T, S> result, VamPointer<T, S> col_a,
+              VamPointer<T, S> col_b) {
+
+  if (result.access_pattern() == AccessPattern::STREAM_WRITE) {
+    Stream_Multiply<query_style<T>> multiplier;
+    // streamed lines are not read, prefetching them would only pollute
+    for (auto [i, a, b, res] : lockstep(col_a, col_b, no_prefetch(result)))
+      multiplier(res.data, a.data, a.size, b.data);
+    stream_fence();
+    return;
+  }
+
+  col_multiplier_t<query_style<T>> multiplier;
+
+  for (auto [i, a, b, res] : lockstep(col_a, col_b, result))
+    multiplier(res.data, a.data, a.size, b.data);
+}
 
-  col_multiplier_t<tsl::simd<int64_t, tsl::avx512>> multiplier;
+/**
+ * @brief Multiplies the base columns a and b for the rows selected by mask
+ * (0 for all other rows), so no materialization is needed.
+ */
+template <typename T, size_t S>
+void multiply_masked(VamPointer<T, S> result, VamPointer<T, S> col_a,
+                     VamPointer<T, S> col_b,
+                     VamPointer<uint64_t, S / sizeof(T) / 8> mask) {
 
-  for (size_t i = 0; i < col_a.segment_count(); i++) {
-    auto [a_ptr, a_size] = col_a.get_segment(i);
-    auto [b_ptr, b_size] = col_b.get_segment(i);
-    auto [res_ptr, res_size] = result.get_segment(i);
+  Masked_Multiply<query_style<T>> multiplier;
 
-    multiplier(res_ptr, a_ptr, a_size, b_ptr);
+  for (auto [i, a, b, res, bits] : lockstep(col_a, col_b, result, mask)) {
+    // segments without hits (e.g. skipped by the zone map) are not read
+    if (std::all_of(bits.data, bits.data + bits.size,
+                    [](uint64_t word) { return word == 0; })) {
+      std::fill(res.data, res.data + res.size, T(0));
+      continue;
+    }
+    multiplier(res.data, a.data, a.size, b.data, bits.data);
   }
 }
 
-void reduce_add(VamPointer<int64_t, sizeof(int64_t)> result,
-                VamPointer<int64_t, 4096> data) {
+template <typename T, size_t S>
+void reduce_add(VamPointer<T, sizeof(T)> result, VamPointer<T, S> data) {
 
-  col_sum_t<tsl::simd<int64_t, tsl::avx512>> reducer;
+  col_sum_t<query_style<T>> reducer;
 
-  for (size_t i = 0; i < data.segment_count(); i++) {
-    auto [data_ptr, data_size] = data.get_segment(i);
-    auto [res_ptr, res_size] = result.get_segment(i);
+  for (auto [i, values, res] : lockstep(data, result))
+    reducer(res.data, values.data, values.size);
+}
+
+/// @brief Segment i of a plain column (buffer is not used).
+template <typename T, size_t S>
+std::tuple<T *, size_t> scan_segment(const VamPointer<T, S> &column, size_t i,
+                                     T *buffer) {
+  return column.get_segment(i);
+}
 
-    reducer(res_ptr, data_ptr, data_size);
+/// @brief Segment i of a packed column, decoded into buffer (segment_rows
+/// elements).
+template <typename T, size_t BITS>
+std::tuple<T *, size_t> scan_segment(const PackedColumn<T, BITS> &column,
+                                     size_t i, T *buffer) {
+  using unpack_style = query_style<std::make_unsigned_t<T>>;
+  return {buffer, column.template unpack_segment<unpack_style>(i, buffer)};
+}
+
+/**
+ * @brief Fused probe -> materialize -> multiply -> reduce over the segments of
+ * one sliver. Every segment is processed end-to-end before the next one is
+ * touched, so the intermediates (position list, gathered a and b, a*b) stay in
+ * small per-thread buffers instead of full-size columns.
+ *
+ * The segments of fk (2048 B of uint32_t) and a/b (4096 B of int64_t) hold the
+ * same number of elements, so segment i of all three columns covers the same
+ * rows.
+ *
+ * With JoinOutput::BITMASK the probe writes a selection bitmask and a*b is
+ * computed on the whole segment and summed masked (no gather).
+ *
+ * The columns are either the plain columns of r or their packed versions
+ * (ColumnFormat::PACKED), whose segments are decoded into per-thread buffers
+ * right before they are used (a and b only for segments with hits).
+ * Segments whose fk zone lies outside of the build side's key range are
+ * skipped without being read.
+ *
+ * @param partial_sum - one element per thread, receives the sum of this sliver
+ */
+template <class FK, class AB>
+void fused_probe_aggregate(join_intermediate ji, JoinOutput output, FK fk,
+                           ZoneMap<uint32_t> fk_zones, AB col_a, AB col_b,
+                           VamPointer<int64_t, sizeof(int64_t)> partial_sum) {
+  constexpr size_t segment_elements = 2048 / sizeof(uint32_t);
+  static_assert(segment_elements == 4096 / sizeof(int64_t) &&
+                    segment_elements == packed_fk_t::segment_rows &&
+                    segment_elements == packed_ab_t::segment_rows,
+                "fk and a/b segments have to cover the same rows");
+
+  semi_join_prober prober(ji);
+
+  Materialize<query_style<int64_t>,
+              OperatorHintSet<hints::intermediate::position_list>>
+      mat;
+  col_multiplier_t<query_style<int64_t>> multiplier;
+  col_sum_t<query_style<int64_t>> reducer;
+  Masked_Sum<query_style<int64_t>> masked_reducer;
+
+  // per-thread intermediates, one segment each (16 KiB in total -> L1/L2)
+  alignas(64) size_t pos_buf[segment_elements];
+  alignas(64) int64_t a_buf[segment_elements];
+  alignas(64) int64_t b_buf[segment_elements];
+  alignas(64) int64_t ab_buf[segment_elements];
+  alignas(64) uint64_t mask_buf[segment_elements / 64];
+  // decoded segments of packed columns (unused for plain ones)
+  alignas(64) uint32_t fk_decoded[segment_elements];
+  alignas(64) int64_t a_decoded[segment_elements];
+  alignas(64) int64_t b_decoded[segment_elements];
+
+  int64_t sum = 0;
+  if (output == JoinOutput::BITMASK) {
+    for (size_t i = 0; i < fk.segment_count(); i++) {
+      if (!may_join(ji, fk_zones, i))
+        continue;
+      auto [fk_ptr, fk_size] = scan_segment(fk, i, fk_decoded);
+      if (prober.mask(mask_buf, fk_ptr, fk_size) == 0)
+        continue;
+
+      auto [a_ptr, a_size] = scan_segment(col_a, i, a_decoded);
+      auto [b_ptr, b_size] = scan_segment(col_b, i, b_decoded);
+      multiplier(ab_buf, a_ptr, a_size, b_ptr);
+
+      int64_t segment_sum = 0;
+      masked_reducer(&segment_sum, ab_buf, a_size, mask_buf);
+      sum += segment_sum;
+    }
+    partial_sum[0] = sum;
+    return;
+  }
+
+  for (size_t i = 0; i < fk.segment_count(); i++) {
+    if (!may_join(ji, fk_zones, i))
+      continue;
+    auto [fk_ptr, fk_size] = scan_segment(fk, i, fk_decoded);
+    size_t hits = prober(pos_buf, fk_ptr, fk_size);
+    if (hits == 0)
+      continue;
+
+    auto [a_ptr, a_size] = scan_segment(col_a, i, a_decoded);
+    auto [b_ptr, b_size] = scan_segment(col_b, i, b_decoded);
+    mat(a_buf, a_ptr, a_ptr + a_size, pos_buf, hits);
+    mat(b_buf, b_ptr, b_ptr + b_size, pos_buf, hits);
+
+    multiplier(ab_buf, a_buf, hits, b_buf);
+
+    int64_t segment_sum = 0;
+    reducer(&segment_sum, ab_buf, hits);
+    sum += segment_sum;
+  }
+
+  partial_sum[0] = sum;
+}
+
+/// queries of one batch sharing a scan of r (see query_batch)
+constexpr size_t max_batch_queries = 16;
+
+/// @brief One query of a batch: the join structures of its build side and
+/// its resolved output.
+struct batch_query {
+  join_intermediate ji;
+  JoinOutput output = JoinOutput::POSITION_LIST;
+};
+
+/// @brief Sums of one sliver of r for every query of a batch.
+struct batch_partial {
+  int64_t sums[max_batch_queries] = {};
+};
+
+/**
+ * @brief fused_probe_aggregate for all queries of a batch in one pass over
+ * the segments of one sliver: each fk segment is read (and decoded) once and
+ * probed by every query whose build side's key range overlaps its zone, a and
+ * b are read once per segment for the first query with hits. The product
+ * a*b of the whole segment, once computed for a BITMASK query, is shared by
+ * the following queries (POSITION_LIST queries then gather from it instead
+ * of gathering a and b).
+ *
+ * @param queries - at most max_batch_queries
+ * @param partial - one element per thread, receives the sum of every query
+ * over this sliver
+ */
+template <class FK, class AB>
+void fused_batch_probe_aggregate(
+    const std::vector<batch_query> *queries, FK fk,
+    ZoneMap<uint32_t> fk_zones, AB col_a, AB col_b,
+    VamPointer<batch_partial, sizeof(batch_partial)> partial) {
+  constexpr size_t segment_elements = 2048 / sizeof(uint32_t);
+
+  // the probers hold per-thread candidate buffers, so one each
+  std::vector<std::unique_ptr<semi_join_prober>> probers;
+  for (const batch_query &query : *queries)
+    probers.push_back(std::make_unique<semi_join_prober>(query.ji));
+
+  Materialize<query_style<int64_t>,
+              OperatorHintSet<hints::intermediate::position_list>>
+      mat;
+  col_multiplier_t<query_style<int64_t>> multiplier;
+  col_sum_t<query_style<int64_t>> reducer;
+  Masked_Sum<query_style<int64_t>> masked_reducer;
+
+  alignas(64) size_t pos_buf[segment_elements];
+  alignas(64) int64_t a_buf[segment_elements];
+  alignas(64) int64_t b_buf[segment_elements];
+  alignas(64) int64_t ab_buf[segment_elements];
+  // a*b of the whole segment (shared by the queries of the segment)
+  alignas(64) int64_t ab_segment[segment_elements];
+  alignas(64) uint64_t mask_buf[segment_elements / 64];
+  alignas(64) uint32_t fk_decoded[segment_elements];
+  alignas(64) int64_t a_decoded[segment_elements];
+  alignas(64) int64_t b_decoded[segment_elements];
+
+  batch_partial result;
+  for (size_t i = 0; i < fk.segment_count(); i++) {
+    bool any_join = false;
+    for (const batch_query &query : *queries)
+      any_join = any_join || may_join(query.ji, fk_zones, i);
+    if (!any_join)
+      continue;
+    auto [fk_ptr, fk_size] = scan_segment(fk, i, fk_decoded);
+
+    int64_t *a_ptr = nullptr;
+    int64_t *b_ptr = nullptr;
+    size_t ab_size = 0;
+    bool has_product = false;
+    for (size_t q = 0; q < queries->size(); q++) {
+      const batch_query &query = (*queries)[q];
+      if (!may_join(query.ji, fk_zones, i))
+        continue;
+      const size_t hits =
+          query.output == JoinOutput::BITMASK
+              ? probers[q]->mask(mask_buf, fk_ptr, fk_size)
+              : (*probers[q])(pos_buf, fk_ptr, fk_size);
+      if (hits == 0)
+        continue;
+
+      if (a_ptr == nullptr) {
+        std::tie(a_ptr, ab_size) = scan_segment(col_a, i, a_decoded);
+        b_ptr = std::get<0>(scan_segment(col_b, i, b_decoded));
+      }
+
+      int64_t segment_sum = 0;
+      if (query.output == JoinOutput::BITMASK) {
+        if (!has_product) {
+          multiplier(ab_segment, a_ptr, ab_size, b_ptr);
+          has_product = true;
+        }
+        masked_reducer(&segment_sum, ab_segment, ab_size, mask_buf);
+      } else if (has_product) {
+        mat(ab_buf, ab_segment, ab_segment + ab_size, pos_buf, hits);
+        reducer(&segment_sum, ab_buf, hits);
+      } else {
+        mat(a_buf, a_ptr, a_ptr + ab_size, pos_buf, hits);
+        mat(b_buf, b_ptr, b_ptr + ab_size, pos_buf, hits);
+        multiplier(ab_buf, a_buf, hits, b_buf);
+        reducer(&segment_sum, ab_buf, hits);
+      }
+      result.sums[q] += segment_sum;
+    }
   }
+
+  partial[0] = result;
+}
+
+/**
+ * @brief Probe -> materialize -> multiply over the segments of one sliver
+ * like fused_probe_aggregate, but a*b of every hit is added to the group of
+ * its fk (SUM(a * b) GROUP BY fk, see GroupedSum) instead of to one sum.
+ *
+ * @param thread_id - one element per thread, the aggregation thread of this
+ * sliver in groups
+ */
+template <class FK, class AB>
+void group_aggregate_sliver(join_intermediate ji, FK fk,
+                            ZoneMap<uint32_t> fk_zones, AB col_a, AB col_b,
+                            GroupedSum *groups,
+                            VamPointer<size_t, sizeof(size_t)> thread_id) {
+  constexpr size_t segment_elements = 2048 / sizeof(uint32_t);
+  const size_t thread = thread_id[0];
+
+  semi_join_prober prober(ji);
+
+  Materialize<query_style<int64_t>,
+              OperatorHintSet<hints::intermediate::position_list>>
+      mat;
+  col_multiplier_t<query_style<int64_t>> multiplier;
+
+  alignas(64) size_t pos_buf[segment_elements];
+  alignas(64) uint32_t key_buf[segment_elements];
+  alignas(64) int64_t a_buf[segment_elements];
+  alignas(64) int64_t b_buf[segment_elements];
+  alignas(64) int64_t ab_buf[segment_elements];
+  alignas(64) uint32_t fk_decoded[segment_elements];
+  alignas(64) int64_t a_decoded[segment_elements];
+  alignas(64) int64_t b_decoded[segment_elements];
+
+  for (size_t i = 0; i < fk.segment_count(); i++) {
+    if (!may_join(ji, fk_zones, i))
+      continue;
+    auto [fk_ptr, fk_size] = scan_segment(fk, i, fk_decoded);
+    const size_t hits = prober(pos_buf, fk_ptr, fk_size);
+    if (hits == 0)
+      continue;
+
+    auto [a_ptr, a_size] = scan_segment(col_a, i, a_decoded);
+    auto [b_ptr, b_size] = scan_segment(col_b, i, b_decoded);
+    mat(a_buf, a_ptr, a_ptr + a_size, pos_buf, hits);
+    mat(b_buf, b_ptr, b_ptr + b_size, pos_buf, hits);
+    multiplier(ab_buf, a_buf, hits, b_buf);
+
+    for (size_t j = 0; j < hits; j++)
+      key_buf[j] = fk_ptr[pos_buf[j]];
+    groups->add(thread, key_buf, ab_buf, hits);
+  }
+  groups->finish(thread);
+}
+
+/// @brief Merges partition partition[0] of groups (one element per merge
+/// thread, see GroupedSum::merge_partition).
+void group_merge_sliver(GroupedSum *groups,
+                        VamPointer<size_t, sizeof(size_t)> partition) {
+  groups->merge_partition(partition[0]);
 }
@@ -0,0 +1,50 @@
+// Launcher of the ISA_DISPATCH build (see isa.hpp): bin/<name> runs
+// bin/<name>_<isa> with the same arguments and environment, for the variant
+// selected by select_isa. Narrower variants are tried if a variant was not
+// built, unless QUERY_ISA requests one.
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+#include "isa.hpp"
+
+using namespace vampir;
+
+int main(int, char **argv) {
+  char self[PATH_MAX];
+  const ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (length < 0) {
+    std::cerr << "Could not resolve the launcher path: " << std::strerror(errno)
+              << std::endl;
+    return 1;
+  }
+  self[length] = '\0';
+
+  const char *requested = std::getenv("QUERY_ISA");
+  Isa isa;
+  try {
+    isa = select_isa(requested);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  for (int level = static_cast<int>(isa); level >= 0; level--) {
+    const std::string variant =
+        std::string(self) + "_" + isa_to_string(static_cast<Isa>(level));
+    if (access(variant.c_str(), X_OK) == 0) {
+      execv(variant.c_str(), argv);
+      std::cerr << "Could not run " << variant << ": " << std::strerror(errno)
+                << std::endl;
+      return 1;
+    }
+    if (requested != nullptr && *requested != '\0')
+      break;
+  }
+  std::cerr << "No query variant found for " << isa_to_string(isa) << " next to "
+            << self << std::endl;
+  return 1;
+}
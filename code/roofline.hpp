@@ -0,0 +1,372 @@
+/**
+ * @file roofline.hpp
+ * @brief Performance model report of a query run (ROOFLINE_JSON set): a
+ * STREAM like calibration measures the bandwidth the threads of the query
+ * reach on every configured NUMA node (DRAM and HBM, see MemoryConfig) and on
+ * arrays placed like the columns of r, then every section of the run is
+ * compared against that roof. The report shows how far each stage is from
+ * the memory bound and how much time it could gain at most (headroom), i.e.
+ * which stage to attack next. With MEASURE_COUNTERS the instructions (the
+ * ops) and the measured memory traffic of the sections are reported as well.
+ *
+ * ROOFLINE_STREAM_MIB (default 256) sets the size of each of the three
+ * arrays, which should be several times the last level cache, and
+ * ROOFLINE_REPETITIONS (default 5) the runs of every kernel, of which the
+ * best counts (like STREAM).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "perf_counters.hpp"
+#include "threads/ThreadManager.hpp"
+#include "vmalloc/vmalloc.hpp"
+
+#include "../modules/json/single_include/nlohmann/json.hpp"
+
+namespace vampir {
+
+/// @brief Settings of the roofline report, read from the environment.
+struct roofline_config {
+  /// output file, empty for no report
+  std::string json_path;
+  size_t array_bytes = 256ull << 20;
+  size_t repetitions = 5;
+
+  static roofline_config from_env() {
+    roofline_config config;
+    if (const char *value = std::getenv("ROOFLINE_JSON"))
+      config.json_path = value;
+    if (const char *value = std::getenv("ROOFLINE_STREAM_MIB"))
+      config.array_bytes = std::stoull(value) << 20;
+    if (const char *value = std::getenv("ROOFLINE_REPETITIONS"))
+      config.repetitions = std::stoul(value);
+    if (config.array_bytes == 0 || config.repetitions == 0)
+      throw std::invalid_argument(
+          "ROOFLINE_STREAM_MIB and ROOFLINE_REPETITIONS must be > 0");
+    return config;
+  }
+};
+
+/// @brief Best bandwidth of the STREAM kernels in bytes per second, counted
+/// like STREAM: read a (8 B), copy c = a (16 B), triad a = b + 3 * c (24 B
+/// per element), without the reads for ownership of the written lines.
+struct stream_bandwidth {
+  double read_Bps = 0.0;
+  double copy_Bps = 0.0;
+  double triad_Bps = 0.0;
+
+  nlohmann::json to_json() const {
+    return {{"read_Bps", read_Bps},
+            {"copy_Bps", copy_Bps},
+            {"triad_Bps", triad_Bps}};
+  }
+};
+
+using stream_column_t = VamPointer<int64_t, 4096>;
+
+/// @brief Writes every array of a sliver once, so the measured runs do not
+/// read the shared zero page or fault in pages.
+inline void stream_fill_sliver(stream_column_t a, stream_column_t b,
+                               stream_column_t c) {
+  if (a.size() == 0)
+    return;
+  int64_t *a_data = a.data(0);
+  int64_t *b_data = b.data(0);
+  int64_t *c_data = c.data(0);
+  for (size_t i = 0; i < a.size(); i++) {
+    a_data[i] = 1;
+    b_data[i] = 2;
+    c_data[i] = 0;
+  }
+}
+
+/// @param partial - one element per thread, receives the sum of the sliver
+/// (so the loads are not optimized away)
+inline void stream_read_sliver(stream_column_t a,
+                               VamPointer<int64_t, sizeof(int64_t)> partial) {
+  int64_t sum = 0;
+  if (a.size() > 0) {
+    const int64_t *a_data = a.data(0);
+    for (size_t i = 0; i < a.size(); i++)
+      sum += a_data[i];
+  }
+  partial[0] = sum;
+}
+
+inline void stream_copy_sliver(stream_column_t c, stream_column_t a) {
+  if (c.size() == 0)
+    return;
+  int64_t *c_data = c.data(0);
+  const int64_t *a_data = a.data(0);
+  for (size_t i = 0; i < c.size(); i++)
+    c_data[i] = a_data[i];
+}
+
+inline void stream_triad_sliver(stream_column_t a, stream_column_t b,
+                                stream_column_t c) {
+  if (a.size() == 0)
+    return;
+  int64_t *a_data = a.data(0);
+  const int64_t *b_data = b.data(0);
+  const int64_t *c_data = c.data(0);
+  for (size_t i = 0; i < a.size(); i++)
+    a_data[i] = b_data[i] + 3 * c_data[i];
+}
+
+/**
+ * @brief Runs the STREAM kernels on a, b and c (of the same size) with
+ * thread_count threads on the cpus of pinning_ranges (groups stream_*<tag>)
+ * and returns the best of repetitions runs of each kernel.
+ */
+inline stream_bandwidth
+measure_stream(ThreadManager &tm, const std::string &tag, stream_column_t &a,
+               stream_column_t &b, stream_column_t &c, uint32_t thread_count,
+               const std::vector<std::pair<int, int>> &pinning_ranges,
+               size_t repetitions) {
+  auto partials = vmalloc<int64_t, sizeof(int64_t)>(thread_count,
+                                                    AccessPattern::LINEAR);
+  tm.create_thread_group<false, false>(
+      "stream_fill" + tag, thread_count, stream_fill_sliver,
+      SplitWrapper<0, stream_column_t>(&a), SplitWrapper<0, stream_column_t>(&b),
+      SplitWrapper<0, stream_column_t>(&c));
+  tm.create_thread_group<false, false>(
+      "stream_read" + tag, thread_count, stream_read_sliver,
+      SplitWrapper<0, stream_column_t>(&a),
+      SplitWrapper<0, typeof(partials)>(&partials));
+  tm.create_thread_group<false, false>(
+      "stream_copy" + tag, thread_count, stream_copy_sliver,
+      SplitWrapper<0, stream_column_t>(&c),
+      SplitWrapper<0, stream_column_t>(&a));
+  tm.create_thread_group<false, false>(
+      "stream_triad" + tag, thread_count, stream_triad_sliver,
+      SplitWrapper<0, stream_column_t>(&a), SplitWrapper<0, stream_column_t>(&b),
+      SplitWrapper<0, stream_column_t>(&c));
+  for (const std::string kernel : {"fill", "read", "copy", "triad"})
+    tm.pin_threads_for_group("stream_" + kernel + tag, pinning_ranges);
+
+  tm.run({"stream_fill" + tag});
+  const auto best_Bps = [&](const std::string &kernel, size_t bytes) {
+    double best = 0.0;
+    for (size_t i = 0; i < repetitions; i++) {
+      const auto start = std::chrono::steady_clock::now();
+      tm.run({"stream_" + kernel + tag});
+      const std::chrono::duration<double> seconds =
+          std::chrono::steady_clock::now() - start;
+      best = std::max(best, bytes / seconds.count());
+    }
+    return best;
+  };
+  const size_t array_bytes = a.size() * sizeof(int64_t);
+  stream_bandwidth result;
+  result.read_Bps = best_Bps("read", array_bytes);
+  result.copy_Bps = best_Bps("copy", 2 * array_bytes);
+  result.triad_Bps = best_Bps("triad", 3 * array_bytes);
+  return result;
+}
+
+/// @brief Bandwidth the threads of the query reach on every configured NUMA
+/// node and on arrays placed like the columns of r.
+struct roofline_calibration {
+  std::map<NumaId, stream_bandwidth> nodes;
+  stream_bandwidth placement;
+  size_t array_bytes = 0;
+  size_t repetitions = 0;
+  uint32_t thread_count = 0;
+
+  /// @brief Roof of the sections: the best bandwidth of any kernel on the
+  /// placement of r (the sections mix reads and writes differently).
+  double roof_Bps() const {
+    return std::max({placement.read_Bps, placement.copy_Bps,
+                     placement.triad_Bps});
+  }
+
+  nlohmann::json to_json() const {
+    nlohmann::json result = {{"array_bytes", array_bytes},
+                             {"repetitions", repetitions},
+                             {"thread_count", thread_count},
+                             {"placement", placement.to_json()},
+                             {"nodes", nlohmann::json::array()}};
+    for (const auto &[node, bandwidth] : nodes) {
+      nlohmann::json entry = bandwidth.to_json();
+      const NodeInfo &info = mem_config.get_node(node);
+      entry["node"] = node;
+      entry["mem_type"] = memory_to_string(info.mem_type);
+      // GB/s of the configuration, 0 if unknown
+      entry["configured_Bps"] = info.bandwidth_gbs * 1e9;
+      result["nodes"].push_back(entry);
+    }
+    return result;
+  }
+};
+
+/**
+ * @brief Measures the STREAM bandwidth (see measure_stream) of every NUMA
+ * node of mem_config that exists on this machine, and of arrays placed like
+ * the columns of r (slivers next to the cpus of pinning_ranges, on memory if
+ * set). Resets tm before and after.
+ */
+inline roofline_calibration
+calibrate_roofline(ThreadManager &tm, uint32_t thread_count,
+                   const std::vector<std::pair<int, int>> &pinning_ranges,
+                   std::optional<Memory> memory,
+                   const roofline_config &config) {
+  roofline_calibration calibration;
+  calibration.array_bytes = config.array_bytes;
+  calibration.repetitions = config.repetitions;
+  calibration.thread_count = thread_count;
+  const size_t elements = config.array_bytes / sizeof(int64_t);
+
+  tm.reset();
+  for (const auto &[node, info] : mem_config.get_nodes()) {
+    if (node > numa_max_node() || numa_node_size64(node, nullptr) <= 0) {
+      std::cerr << "Roofline: skipping NUMA node " << node
+                << " (not available)" << std::endl;
+      continue;
+    }
+    stream_column_t a = account(
+        stream_column_t(elements, node, Transparent_HugePages));
+    stream_column_t b = account(
+        stream_column_t(elements, node, Transparent_HugePages));
+    stream_column_t c = account(
+        stream_column_t(elements, node, Transparent_HugePages));
+    calibration.nodes[node] =
+        measure_stream(tm, "_n" + std::to_string(node), a, b, c, thread_count,
+                       pinning_ranges, config.repetitions);
+    tm.reset();
+  }
+
+  const std::vector<int> sliver_cpus =
+      get_cpu_ids(0, thread_count, pinning_ranges);
+  stream_column_t a = vmalloc<int64_t, 4096>(elements, AccessPattern::LINEAR,
+                                             sliver_cpus,
+                                             Transparent_HugePages, memory);
+  stream_column_t b = vmalloc<int64_t, 4096>(elements, AccessPattern::LINEAR,
+                                             sliver_cpus,
+                                             Transparent_HugePages, memory);
+  stream_column_t c = vmalloc<int64_t, 4096>(elements, AccessPattern::LINEAR,
+                                             sliver_cpus,
+                                             Transparent_HugePages, memory);
+  calibration.placement = measure_stream(tm, "_placement", a, b, c,
+                                         thread_count, pinning_ranges,
+                                         config.repetitions);
+  tm.reset();
+  return calibration;
+}
+
+/// @brief Measurement of one stage of a run (a Section of query.cpp, summed
+/// over its entries).
+struct section_measurement {
+  std::string name;
+  size_t bytes = 0;
+  double duration = 0.0;
+  perf::counter_values counters;
+};
+
+/**
+ * @brief Compares every section and the whole query against the roof of the
+ * calibration: achieved bytes/s (of the estimated bytes of the section) and
+ * their fraction of the roof, the time the section would take at the roof
+ * (bound_s) and the difference (headroom_s). next_target is the section with
+ * the largest headroom. With valid counters, the instructions per second and
+ * per byte and the measured bandwidth are added.
+ */
+inline nlohmann::json
+roofline_report(const std::vector<section_measurement> &sections,
+                size_t query_bytes, double query_seconds,
+                const roofline_calibration &calibration,
+                const nlohmann::json &meta = nlohmann::json::object()) {
+  const double roof = calibration.roof_Bps();
+  const auto compare = [roof](size_t bytes, double duration) {
+    const double achieved = duration > 0.0 ? bytes / duration : 0.0;
+    const double bound = roof > 0.0 ? bytes / roof : 0.0;
+    return nlohmann::json{
+        {"bytes", bytes},
+        {"duration_s", duration},
+        {"achieved_Bps", achieved},
+        {"roof_Bps", roof},
+        {"fraction_of_roof", roof > 0.0 ? achieved / roof : 0.0},
+        {"bound_s", bound},
+        {"headroom_s", std::max(0.0, duration - bound)}};
+  };
+
+  nlohmann::json result = {{"meta", meta},
+                           {"calibration", calibration.to_json()},
+                           {"query", compare(query_bytes, query_seconds)},
+                           {"sections", nlohmann::json::array()},
+                           {"next_target", nullptr}};
+  double max_headroom = 0.0;
+  for (const section_measurement &section : sections) {
+    nlohmann::json entry = compare(section.bytes, section.duration);
+    entry["name"] = section.name;
+    const perf::counter_values &counters = section.counters;
+    if (counters.core_valid && section.duration > 0.0) {
+      entry["instructions"] = counters.instructions;
+      entry["ipc"] = counters.ipc();
+      entry["instructions_per_s"] = counters.instructions / section.duration;
+      entry["instructions_per_byte"] =
+          section.bytes > 0
+              ? static_cast<double>(counters.instructions) / section.bytes
+              : 0.0;
+    }
+    if (counters.memory_valid && section.duration > 0.0) {
+      const double measured =
+          (counters.read_bytes + counters.write_bytes) / section.duration;
+      entry["measured_Bps"] = measured;
+      entry["measured_fraction_of_roof"] = roof > 0.0 ? measured / roof : 0.0;
+    }
+    if (entry["headroom_s"].get<double>() > max_headroom) {
+      max_headroom = entry["headroom_s"].get<double>();
+      result["next_target"] = section.name;
+    }
+    result["sections"].push_back(entry);
+  }
+  return result;
+}
+
+/// @brief One line per section of a roofline_report: achieved and roof
+/// bandwidth and the headroom.
+inline void print_roofline(std::ostream &out, const nlohmann::json &report) {
+  char line[256];
+  const auto print_entry = [&](const std::string &name,
+                               const nlohmann::json &entry) {
+    std::snprintf(line, sizeof(line),
+                  "roofline %20s: %8.3f of %8.3f GiB/s (%5.1f %%), "
+                  "headroom %12.8f s\n",
+                  name.c_str(),
+                  entry["achieved_Bps"].get<double>() / (1ull << 30),
+                  entry["roof_Bps"].get<double>() / (1ull << 30),
+                  100.0 * entry["fraction_of_roof"].get<double>(),
+                  entry["headroom_s"].get<double>());
+    out << line;
+  };
+  out << "Roofline:" << std::endl;
+  for (const auto &section : report["sections"])
+    print_entry(section["name"].get<std::string>(), section);
+  print_entry("query", report["query"]);
+  if (!report["next_target"].is_null())
+    out << "next target: " << report["next_target"].get<std::string>()
+        << std::endl;
+}
+
+inline void write_roofline(const std::string &path,
+                           const nlohmann::json &report) {
+  std::ofstream file(path);
+  if (!file)
+    throw std::runtime_error("Could not write roofline report " + path);
+  file << report.dump(2) << std::endl;
+}
+
+} // namespace vampir
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 #include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
 
 #ifdef LINUX
     #include <sys/mman.h>
@@ -24,8 +29,60 @@ enum PageType {
     Transparent_HugePages
 };
 
+/**
+ * Returns the number of bytes of [begin, begin + bytes) that are backed by huge
+ * pages according to /proc/self/smaps (hugetlbfs mappings and THP). For THP
+ * the AnonHugePages of a mapping are attributed proportionally to the part of
+ * the mapping inside the range. Returns -1 if smaps cannot be read.
+ */
+inline int64_t smaps_huge_page_bytes(const void *begin, size_t bytes) {
+    std::ifstream smaps("/proc/self/smaps");
+    if (!smaps.is_open()) return -1;
+
+    const uintptr_t range_begin = reinterpret_cast<uintptr_t>(begin);
+    const uintptr_t range_end = range_begin + bytes;
+
+    double huge_bytes = 0;
+    uintptr_t vma_begin = 0, vma_end = 0;
+    size_t overlap = 0;
+    std::string line;
+    while (std::getline(smaps, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+        if (key.find('-') != std::string::npos && key.back() != ':') {
+            // header line of the next mapping: "begin-end perms ..."
+            vma_begin = std::stoull(key.substr(0, key.find('-')), nullptr, 16);
+            vma_end = std::stoull(key.substr(key.find('-') + 1), nullptr, 16);
+            const uintptr_t lo = std::max(vma_begin, range_begin);
+            const uintptr_t hi = std::min(vma_end, range_end);
+            overlap = hi > lo ? hi - lo : 0;
+            continue;
+        }
+        if (overlap == 0) continue;
+
+        size_t kb = 0;
+        fields >> kb;
+        if (key == "KernelPageSize:" && kb > 4) {
+            // hugetlbfs mapping: all of it is huge
+            huge_bytes += overlap;
+            overlap = 0;
+        } else if (key == "AnonHugePages:" && kb > 0) {
+            huge_bytes += static_cast<double>(kb) * 1024 * overlap / (vma_end - vma_begin);
+        }
+    }
+    return static_cast<int64_t>(huge_bytes);
+}
+
 template<typename T>
 void print_page_info(T *array, size_t length) {
+    const int64_t huge_bytes = smaps_huge_page_bytes(array, length * sizeof(T));
+    if (huge_bytes >= 0 && length > 0) {
+        std::cout << "\033[32m";
+        std::cout << "Pages backed by hugepages (smaps): "
+            << 100.0 * huge_bytes / (length * sizeof(T))
+            << "% of " << length * sizeof(T) << " B\033[0m" << std::endl;
+    }
     #ifdef LINUX
     constexpr int KPF_THP = 22;
     page_info_array pinfo = get_info_for_range(array, array + length);
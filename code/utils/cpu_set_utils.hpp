@@ -95,6 +95,20 @@ inline int get_cpu_id(int thread_id, const cpu_id::Range auto& range) {
     return thread_id + cpu_id::start(range[i]);
 }
 
+/**
+ * Returns the cpu ids of count threads pinned in order, starting at the
+ * start_index-th cpu of the given (multi)range (see get_cpu_id). These are
+ * the cpus of a thread group pinned automatically at that core index.
+*/
+inline std::vector<int> get_cpu_ids(int start_index, int count, const cpu_id::Range auto& range) {
+    std::vector<int> result;
+    result.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        result.push_back(get_cpu_id(start_index + i, range));
+    }
+    return result;
+}
+
 /*inline void cpu_set_between(cpu_set_t* set, uint32_t low, uint32_t high) {
     assert(low != high);
     if (low > high) std::swap(low, high);
@@ -178,6 +192,27 @@ namespace Crobat {
 		return result;
 	}
 
+	/**
+	 * Pinning ranges that spread threads round robin over the given exec
+	 * nodes: thread i runs on node exec_nodes[i % n], the physical cores of
+	 * all nodes are used before their hyperthreads (only if hyperthreads).
+	 */
+	inline
+	std::vector<std::pair<int, int>>
+	get_spread_pinning_ranges (const std::vector<int>& exec_nodes, bool hyperthreads) {
+		std::vector<std::pair<int, int>> result;
+		for (int hyperthread = 0; hyperthread <= (hyperthreads ? 1 : 0); hyperthread++) {
+			for (uint64_t core = 0; core < cpus_per_node; core++) {
+				for (int exec_node : exec_nodes) {
+					const uint64_t node_number = hyperthread * exec_nodes_count + exec_node;
+					const int cpu = cpus_per_node * node_number + core;
+					result.emplace_back(cpu, cpu + 1);
+				}
+			}
+		}
+		return result;
+	}
+
 	static constexpr
 	std::vector<std::pair<int, int>>
 	get_testing_pinning_ranges () {
@@ -0,0 +1,224 @@
+/**
+ * @file parallel_generator.hpp
+ * @brief Parallel counterpart of Datagenerator for VamPointer columns: every
+ * sliver is generated by a thread group pinned to the CPUs the slivers were
+ * placed for, so the pages are first touched on their NUMA node. Every
+ * element only depends on the seed and its index (counter based Philox
+ * stream, keyed Feistel permutation instead of a shuffle), so the result for
+ * a seed is the same for any thread count.
+ */
+
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "generator.hpp"
+#include "threads/ThreadManager.hpp"
+#include "vmalloc/VamPointer.hpp"
+
+namespace rng {
+
+/// @brief Philox4x32-10 block (Salmon et al., "Parallel Random Numbers: As
+/// Easy as 1, 2, 3"): 128 random bits for a 128 bit counter and 64 bit key.
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter,
+                                          std::array<uint32_t, 2> key) {
+  constexpr uint32_t multiplier_0 = 0xD2511F53;
+  constexpr uint32_t multiplier_1 = 0xCD9E8D57;
+  constexpr uint32_t weyl_0 = 0x9E3779B9;
+  constexpr uint32_t weyl_1 = 0xBB67AE85;
+  for (int round = 0; round < 10; round++) {
+    const uint64_t product_0 = uint64_t(multiplier_0) * counter[0];
+    const uint64_t product_1 = uint64_t(multiplier_1) * counter[2];
+    counter = {uint32_t(product_1 >> 32) ^ counter[1] ^ key[0],
+               uint32_t(product_1),
+               uint32_t(product_0 >> 32) ^ counter[3] ^ key[1],
+               uint32_t(product_0)};
+    key[0] += weyl_0;
+    key[1] += weyl_1;
+  }
+  return counter;
+}
+
+/// @brief Two random 64 bit words of the stream seed at position counter.
+inline std::array<uint64_t, 2> philox(uint64_t seed, uint64_t counter) {
+  const auto bits =
+      philox4x32({uint32_t(counter), uint32_t(counter >> 32), 0, 0},
+                 {uint32_t(seed), uint32_t(seed >> 32)});
+  return {uint64_t(bits[0]) | uint64_t(bits[1]) << 32,
+          uint64_t(bits[2]) | uint64_t(bits[3]) << 32};
+}
+
+/// @brief Pseudo random permutation of [0, n) for a seed: a balanced Feistel
+/// network over the smallest even power of two >= n, values outside of
+/// [0, n) are encrypted again (cycle walking, less than 4 rounds on
+/// average). Any index can be mapped independently of the others.
+class RandomPermutation {
+private:
+  static constexpr int rounds = 6;
+
+  uint64_t n;
+  int half_bits;
+  uint64_t half_mask;
+  std::array<uint64_t, rounds> round_keys;
+
+  /// murmur3 finalizer
+  static uint64_t _mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+  }
+
+  uint64_t _encrypt(uint64_t x) const {
+    uint64_t left = x >> half_bits;
+    uint64_t right = x & half_mask;
+    for (int round = 0; round < rounds; round++) {
+      const uint64_t next =
+          left ^ (_mix(right ^ round_keys[round]) & half_mask);
+      left = right;
+      right = next;
+    }
+    return left << half_bits | right;
+  }
+
+public:
+  RandomPermutation(uint64_t n, uint64_t seed) : n(n) {
+    const int bits = n > 1 ? std::bit_width(n - 1) : 1;
+    half_bits = (bits + 1) / 2;
+    half_mask = (uint64_t(1) << half_bits) - 1;
+    for (int round = 0; round < rounds; round += 2) {
+      const auto keys = philox(seed, round / 2);
+      round_keys[round] = keys[0];
+      round_keys[round + 1] = keys[1];
+    }
+  }
+
+  uint64_t operator()(uint64_t index) const {
+    uint64_t x = _encrypt(index);
+    while (x >= n)
+      x = _encrypt(x);
+    return x;
+  }
+};
+
+} // namespace rng
+
+/**
+ * @brief Parallel Datagenerator (see file comment). The generation types
+ * produce the same distributions as Datagenerator::generate (BASIC_UNIFORM
+ * is still a random permutation of (i % (max - min)) + min), but not the
+ * same sequences.
+ */
+class ParallelDatagenerator {
+public:
+  explicit ParallelDatagenerator(uint64_t seed) : _seed(seed) {}
+  ParallelDatagenerator() {
+    std::random_device rd;
+    _seed = uint64_t(rd()) << 32 | rd();
+  }
+
+  /**
+   * @brief Fills column with thread group generate_<n> of tm, thread i
+   * generates sliver i of column.split(sliver_cpus.size()) pinned to
+   * sliver_cpus[i] (use the CPUs the column was placed for, see vmalloc).
+   * Every call uses the next stream of the seed, like Datagenerator.
+   * @return the seed of the stream used for column
+   * @throws std::invalid_argument for SHUFFEL (the parallel generator only
+   * generates, it does not transform existing data)
+   */
+  template <typename T, std::size_t S>
+  uint64_t generate(ThreadManager &tm, vampir::VamPointer<T, S> &column,
+                    const std::vector<int> &sliver_cpus, GenerationType type,
+                    T min_value, T max_value) {
+    if (type == SHUFFEL)
+      throw std::invalid_argument(
+          "SHUFFEL is not supported by the parallel generator");
+    if (column.size() == 0)
+      return _seed;
+    const uint64_t seed = ++_seed;
+
+    const std::string group_id = "generate_" + std::to_string(_calls++);
+    std::vector<std::pair<int, int>> range;
+    for (int cpu : sliver_cpus)
+      range.emplace_back(cpu, cpu + 1);
+    tm.create_thread_group<false, false>(
+        group_id, sliver_cpus.size(), generate_sliver<T, S>,
+        SplitWrapper<0, vampir::VamPointer<T, S>>(&column), column.data(0),
+        column.size(), type, min_value, max_value, seed);
+    tm.pin_threads_for_group(group_id, range);
+    tm.run({group_id});
+    return seed;
+  }
+
+  template <typename T, std::size_t S>
+  uint64_t generate(ThreadManager &tm, vampir::VamPointer<T, S> &column,
+                    const std::vector<int> &sliver_cpus, GenerationType type) {
+    return generate<T, S>(tm, column, sliver_cpus, type, T(0), T(100));
+  }
+
+  /**
+   * @brief Generates one sliver of a column: element i of the column (at
+   * base + i) only depends on seed and i.
+   * @param count size of the whole column (the last sliver may extend past
+   * it, see VamPointer::split)
+   */
+  template <typename T, std::size_t S>
+  static void generate_sliver(vampir::VamPointer<T, S> sliver, T *base,
+                              std::size_t count, GenerationType type,
+                              T min_value, T max_value, uint64_t seed) {
+    if (sliver.size() == 0)
+      return;
+    T *data = sliver.data(0);
+    const std::size_t begin = data - base;
+    if (begin >= count)
+      return;
+    const std::size_t end = std::min(begin + sliver.size(), count);
+    const uint64_t dif = uint64_t(max_value) - uint64_t(min_value);
+
+    switch (type) {
+    case UNIFORM:
+      // one Philox block per two elements, uniform in [min, max)
+      for (std::size_t i = begin; i < end; i++) {
+        const uint64_t word = rng::philox(seed, i / 2)[i % 2];
+        data[i - begin] = static_cast<T>(
+            uint64_t(min_value) +
+            uint64_t((static_cast<unsigned __int128>(word) * dif) >> 64));
+      }
+      break;
+    case BASIC_UNIFORM: {
+      // the permutation of i % dif + min instead of generating and shuffling
+      const rng::RandomPermutation permutation(count, seed);
+      for (std::size_t i = begin; i < end; i++)
+        data[i - begin] = static_cast<T>(permutation(i) % dif + min_value);
+      break;
+    }
+    case INCREASING:
+      for (std::size_t i = begin; i < end; i++)
+        data[i - begin] = static_cast<T>(i + min_value);
+      break;
+    case ONE:
+      for (std::size_t i = begin; i < end; i++)
+        data[i - begin] = 1;
+      break;
+    case ID:
+      for (std::size_t i = begin; i < end; i++)
+        data[i - begin] = static_cast<T>(i);
+      break;
+    case SHUFFEL:
+      break;
+    }
+  }
+
+private:
+  uint64_t _seed = 0;
+  /// number of generated columns (unique thread group IDs)
+  uint64_t _calls = 0;
+};
@@ -0,0 +1,345 @@
+/**
+ * @file perf_counters.hpp
+ * @brief Hardware performance counters (perf_event_open) for the sections of
+ * a query and the threads of a thread group: cycles, instructions, LLC misses,
+ * dTLB misses and, where the uncore IMC PMUs are exposed, the bytes read from
+ * and written to memory (counted per socket, reported as the sum over all
+ * sockets). Enabled with -DMEASURE_COUNTERS=1 (CMake option
+ * MEASURE_COUNTERS), otherwise nothing is opened.
+ *
+ * Counters that cannot be opened (no PMU in a VM, perf_event_paranoid too
+ * high, fd limit) are reported as not available instead of failing the run.
+ * Thread counters only need perf_event_paranoid <= 2, the system wide
+ * counters of the sections (core events on every online CPU and the uncore
+ * events) need perf_event_paranoid <= 0 or CAP_PERFMON.
+ */
+
+#pragma once
+
+#ifndef MEASURE_COUNTERS
+#define MEASURE_COUNTERS 0
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <numa.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace perf {
+
+/// @brief Counter values of one measurement (or the sum of several). A group
+/// of values is only meaningful if its valid flag is set.
+struct counter_values {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t llc_misses = 0;
+  uint64_t dtlb_misses = 0;
+  bool core_valid = false;
+
+  /// memory traffic measured by the uncore IMC counters, summed over sockets
+  uint64_t read_bytes = 0;
+  uint64_t write_bytes = 0;
+  bool memory_valid = false;
+
+  double ipc() const {
+    return cycles > 0 ? static_cast<double>(instructions) / cycles : 0.0;
+  }
+
+  counter_values &operator+=(const counter_values &other) {
+    cycles += other.cycles;
+    instructions += other.instructions;
+    llc_misses += other.llc_misses;
+    dtlb_misses += other.dtlb_misses;
+    core_valid = core_valid || other.core_valid;
+    read_bytes += other.read_bytes;
+    write_bytes += other.write_bytes;
+    memory_valid = memory_valid || other.memory_valid;
+    return *this;
+  }
+
+  /// @brief "IPC 1.23, LLC misses 456, ..." or "counters not available".
+  std::string to_string(double duration = 0.0) const {
+    char buffer[256];
+    int length = 0;
+    if (core_valid)
+      length += std::snprintf(
+          buffer + length, sizeof(buffer) - length,
+          "IPC %5.2f, LLC misses %12lu, dTLB misses %10lu", ipc(), llc_misses,
+          dtlb_misses);
+    if (memory_valid && duration > 0.0)
+      length += std::snprintf(
+          buffer + length, sizeof(buffer) - length,
+          "%smeasured %8.3f GiB/s (read %.3f GiB, write %.3f GiB)",
+          length > 0 ? ", " : "",
+          static_cast<double>(read_bytes + write_bytes) / (1ull << 30) /
+              duration,
+          static_cast<double>(read_bytes) / (1ull << 30),
+          static_cast<double>(write_bytes) / (1ull << 30));
+    if (length == 0)
+      return "counters not available";
+    return std::string(buffer, length);
+  }
+};
+
+/// @brief One opened counter. The value is scaled by enabled / running time,
+/// in case the kernel had to multiplex the hardware counters.
+class Counter {
+private:
+  int fd = -1;
+
+public:
+  Counter() = default;
+  Counter(perf_event_attr attr, pid_t pid, int cpu) {
+    attr.size = sizeof(perf_event_attr);
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fd = syscall(__NR_perf_event_open, &attr, pid, cpu, -1, 0);
+  }
+  Counter(const Counter &) = delete;
+  Counter &operator=(const Counter &) = delete;
+  Counter(Counter &&other) noexcept : fd(other.fd) { other.fd = -1; }
+  Counter &operator=(Counter &&other) noexcept {
+    std::swap(fd, other.fd);
+    return *this;
+  }
+  ~Counter() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool valid() const { return fd >= 0; }
+
+  uint64_t read_value() const {
+    uint64_t data[3] = {0, 0, 0}; // value, time enabled, time running
+    if (fd < 0 || ::read(fd, data, sizeof(data)) != sizeof(data) ||
+        data[2] == 0)
+      return 0;
+    if (data[1] == data[2])
+      return data[0];
+    return static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] /
+                                 data[2]);
+  }
+};
+
+/// @brief cycles, instructions, LLC misses and dTLB misses, either of the
+/// calling thread (on whatever CPU it runs) or of all online CPUs (system wide).
+class CoreCounters {
+private:
+  /// four counters per measured thread / CPU
+  std::vector<Counter> counters;
+  bool valid = false;
+
+  static perf_event_attr _attr(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return attr;
+  }
+
+  static std::vector<perf_event_attr> _attrs() {
+    constexpr uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    return {
+        _attr(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES),
+        _attr(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS),
+        _attr(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read_miss),
+        _attr(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | read_miss),
+    };
+  }
+
+  void _open(pid_t pid, int cpu) {
+    for (const auto &attr : _attrs()) {
+      counters.emplace_back(attr, pid, cpu);
+      if (!counters.back().valid()) {
+        counters.clear();
+        valid = false;
+        return;
+      }
+    }
+  }
+
+public:
+  /// @brief Opens the counters of the calling thread.
+  static CoreCounters for_this_thread() {
+    CoreCounters result;
+    result.valid = true;
+    result._open(0, -1);
+    return result;
+  }
+
+  /// @brief Opens the counters of all online CPUs (all processes).
+  static CoreCounters system_wide() {
+    CoreCounters result;
+    result.valid = true;
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int cpu = 0; cpu < cpus && result.valid; ++cpu)
+      result._open(-1, cpu);
+    return result;
+  }
+
+  /// @brief Adds the current totals to values (subtract two reads to get the
+  /// counts of the code between them).
+  void read(counter_values &values) const {
+    if (!valid)
+      return;
+    for (std::size_t i = 0; i < counters.size(); i += 4) {
+      values.cycles += counters[i].read_value();
+      values.instructions += counters[i + 1].read_value();
+      values.llc_misses += counters[i + 2].read_value();
+      values.dtlb_misses += counters[i + 3].read_value();
+    }
+    values.core_valid = true;
+  }
+};
+
+/// @brief Bytes read from / written to memory, measured by the CAS count
+/// events of the uncore memory controller PMUs (uncore_imc_*, Intel server
+/// CPUs) on one CPU per socket. Not available on other CPUs or in most VMs.
+class MemoryCounters {
+private:
+  static constexpr uint64_t bytes_per_cas = 64;
+
+  std::vector<Counter> read_counters;
+  std::vector<Counter> write_counters;
+
+  static std::string _read_file(const std::string &path) {
+    std::ifstream file(path);
+    std::string content;
+    std::getline(file, content);
+    return content;
+  }
+
+  /// @brief Translates an event description of sysfs ("event=0x04,umask=0x03")
+  /// into the config value using the format files of the PMU
+  /// ("config:8-15" for umask). Returns false for unknown terms.
+  static bool _parse_event(const std::string &pmu, const std::string &event,
+                           uint64_t &config) {
+    config = 0;
+    std::size_t pos = 0;
+    while (pos < event.size()) {
+      std::size_t end = event.find(',', pos);
+      if (end == std::string::npos)
+        end = event.size();
+      const std::string term = event.substr(pos, end - pos);
+      pos = end + 1;
+
+      const std::size_t equals = term.find('=');
+      const std::string key = term.substr(0, equals);
+      const uint64_t value =
+          equals == std::string::npos
+              ? 1
+              : std::strtoull(term.c_str() + equals + 1, nullptr, 0);
+      const std::string format = _read_file(pmu + "/format/" + key);
+      if (format.rfind("config:", 0) != 0)
+        return false;
+      config |= value << std::strtoul(format.c_str() + 7, nullptr, 10);
+    }
+    return true;
+  }
+
+public:
+  MemoryCounters() {
+    const std::string devices = "/sys/bus/event_source/devices";
+    DIR *dir = opendir(devices.c_str());
+    if (dir == nullptr)
+      return;
+    while (dirent *entry = readdir(dir)) {
+      if (std::strncmp(entry->d_name, "uncore_imc", 10) != 0)
+        continue;
+      const std::string pmu = devices + "/" + entry->d_name;
+      const uint32_t type = std::strtoul(_read_file(pmu + "/type").c_str(),
+                                         nullptr, 10);
+
+      uint64_t read_config, write_config;
+      if (!_parse_event(pmu, _read_file(pmu + "/events/cas_count_read"),
+                        read_config) ||
+          !_parse_event(pmu, _read_file(pmu + "/events/cas_count_write"),
+                        write_config))
+        continue;
+
+      // uncore events are counted per socket on the CPUs of the cpumask
+      // ("0,28" for two sockets)
+      const std::string cpumask = _read_file(pmu + "/cpumask");
+      for (const char *cpu = cpumask.c_str(); *cpu != '\0';) {
+        char *end;
+        const int cpu_id = std::strtol(cpu, &end, 10);
+        if (end == cpu)
+          break;
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = type;
+        attr.config = read_config;
+        read_counters.emplace_back(attr, -1, cpu_id);
+        attr.config = write_config;
+        write_counters.emplace_back(attr, -1, cpu_id);
+        if (!read_counters.back().valid() || !write_counters.back().valid()) {
+          read_counters.clear();
+          write_counters.clear();
+          closedir(dir);
+          return;
+        }
+        cpu = *end == ',' ? end + 1 : end;
+      }
+    }
+    closedir(dir);
+  }
+
+  bool valid() const { return !read_counters.empty(); }
+
+  /// @brief Adds the current totals to values.
+  void read(counter_values &values) const {
+    if (!valid())
+      return;
+    for (const auto &counter : read_counters)
+      values.read_bytes += counter.read_value() * bytes_per_cas;
+    for (const auto &counter : write_counters)
+      values.write_bytes += counter.read_value() * bytes_per_cas;
+    values.memory_valid = true;
+  }
+};
+
+/// @brief Difference of two reads, keeps the valid flags of the later one.
+inline counter_values operator-(counter_values end,
+                                const counter_values &start) {
+  end.cycles -= start.cycles;
+  end.instructions -= start.instructions;
+  end.llc_misses -= start.llc_misses;
+  end.dtlb_misses -= start.dtlb_misses;
+  end.read_bytes -= start.read_bytes;
+  end.write_bytes -= start.write_bytes;
+  return end;
+}
+
+/// @brief Current totals of the system wide counters (used by the sections of
+/// a query, their work runs on the worker threads). Opened on first use.
+inline counter_values read_system() {
+  static const CoreCounters core = CoreCounters::system_wide();
+  static const MemoryCounters memory;
+  counter_values values;
+  core.read(values);
+  memory.read(values);
+  return values;
+}
+
+/// @brief Current totals of the counters of the calling thread (opened on its
+/// first call, i.e. the workers should call it once at startup).
+inline counter_values read_this_thread() {
+  thread_local const CoreCounters core = CoreCounters::for_this_thread();
+  counter_values values;
+  core.read(values);
+  return values;
+}
+
+} // namespace perf
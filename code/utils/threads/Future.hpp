@@ -0,0 +1,299 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Futures of the asynchronous runs of thread groups (see ThreadManager::run_future). Unlike std::future they take
+// continuations (Future::then, when_all), so dependent work is started when its inputs are ready instead of by a
+// thread blocking in join. A continuation runs on the thread that completes its future, for a group run the worker
+// of the last finished task, so it must be short and must not block on thread groups (use run_future, not run, to
+// start groups from a continuation; a continuation returning a Future is unwrapped).
+
+template<class T> class Future;
+template<class T> class Promise;
+
+namespace future_detail {
+    /// @brief Stands in for the value of a Future<void>.
+    struct unit {};
+
+    template<class T> struct stored { using type = T; };
+    template<> struct stored<void> { using type = unit; };
+
+    /// @brief Value type held by the shared state of a Future<T>.
+    template<class T> using stored_t = typename stored<T>::type;
+
+    template<class T> struct is_future : std::false_type {};
+    template<class T> struct is_future<Future<T>> : std::true_type {};
+
+    template<class T> struct unwrap { using type = T; };
+    template<class T> struct unwrap<Future<T>> { using type = T; };
+
+    /// @brief Value type of the Future returned by then for a continuation returning R.
+    template<class R> using unwrap_t = typename unwrap<R>::type;
+
+    /// @brief Shared state of a Promise and its Futures: the value or error, set once, and the continuations waiting
+    /// for it.
+    template<class T>
+    class SharedState {
+        private:
+            std::mutex mutex;
+            std::condition_variable ready_cv;
+            bool ready = false;
+            std::optional<stored_t<T>> value;
+            std::exception_ptr error;
+            std::vector<std::function<void()>> continuations;
+
+            /// @brief Marks the state ready (value or error is set) and runs the continuations outside of the lock.
+            void _complete(std::unique_lock<std::mutex> &lock) {
+                ready = true;
+                std::vector<std::function<void()>> waiting = std::move(continuations);
+                continuations.clear();
+                lock.unlock();
+                ready_cv.notify_all();
+                for(auto &continuation : waiting) continuation();
+            }
+
+            void _check_unset() const {
+                if(ready) throw std::logic_error("Promise already satisfied");
+            }
+
+        public:
+            /// @throws std::logic_error if the value or error is already set.
+            void set_value(stored_t<T> result) {
+                std::unique_lock<std::mutex> lock(mutex);
+                _check_unset();
+                value.emplace(std::move(result));
+                _complete(lock);
+            }
+
+            /// @throws std::logic_error if the value or error is already set.
+            void set_error(std::exception_ptr exception) {
+                std::unique_lock<std::mutex> lock(mutex);
+                _check_unset();
+                error = exception;
+                _complete(lock);
+            }
+
+            bool is_ready() {
+                std::lock_guard<std::mutex> lock(mutex);
+                return ready;
+            }
+
+            void wait() {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready_cv.wait(lock, [this] { return ready; });
+            }
+
+            /// @brief Value or error of a ready state (see wait).
+            const stored_t<T> &get() {
+                wait();
+                if(error) std::rethrow_exception(error);
+                return *value;
+            }
+
+            /// @brief Error of a ready state, nullptr if it holds a value.
+            std::exception_ptr get_error() {
+                wait();
+                return error;
+            }
+
+            /// @brief Runs continuation once the state is ready: right away (on the calling thread) if it already is,
+            /// on the thread completing it otherwise.
+            void on_ready(std::function<void()> continuation) {
+                std::unique_lock<std::mutex> lock(mutex);
+                if(!ready) {
+                    continuations.push_back(std::move(continuation));
+                    return;
+                }
+                lock.unlock();
+                continuation();
+            }
+    };
+
+    /// @brief Completes promise with the result of calling func with args (or its error); a returned Future is
+    /// unwrapped, i.e. promise completes with it.
+    template<class U, class F, class... Args>
+    void fulfill(Promise<U> promise, F &func, Args &&...args) {
+        using R = std::invoke_result_t<F &, Args...>;
+        try {
+            if constexpr(is_future<R>::value) {
+                R inner = func(std::forward<Args>(args)...);
+                inner.state->on_ready([promise, state = inner.state]() mutable {
+                    if(std::exception_ptr error = state->get_error()) promise.set_error(error);
+                    else promise.state->set_value(state->get());
+                });
+            } else if constexpr(std::is_void_v<R>) {
+                func(std::forward<Args>(args)...);
+                promise.state->set_value(unit{});
+            } else {
+                promise.state->set_value(func(std::forward<Args>(args)...));
+            }
+        } catch(...) {
+            promise.set_error(std::current_exception());
+        }
+    }
+}
+
+/// @brief Producer side of a Future: completes it with a value or an error, exactly once.
+template<class T>
+class Promise {
+    private:
+        std::shared_ptr<future_detail::SharedState<T>> state = std::make_shared<future_detail::SharedState<T>>();
+
+        template<class U, class F, class... Args>
+        friend void future_detail::fulfill(Promise<U> promise, F &func, Args &&...args);
+
+    public:
+        Future<T> get_future() const { return Future<T>(state); }
+
+        /// @throws std::logic_error if the promise is already satisfied.
+        template<class V = T, class = std::enable_if_t<!std::is_void_v<V>>>
+        void set_value(V value) const { state->set_value(std::move(value)); }
+
+        /// @throws std::logic_error if the promise is already satisfied.
+        template<class V = T, class = std::enable_if_t<std::is_void_v<V>>>
+        void set_value() const { state->set_value(future_detail::unit{}); }
+
+        /// @throws std::logic_error if the promise is already satisfied.
+        void set_error(std::exception_ptr error) const { state->set_error(error); }
+};
+
+/// @brief Shared handle to a value (or error) that becomes available later, e.g. the completion of a group run (see
+/// ThreadManager::run_future). Copies refer to the same value; get can be called any number of times.
+template<class T>
+class Future {
+    private:
+        std::shared_ptr<future_detail::SharedState<T>> state;
+
+        explicit Future(std::shared_ptr<future_detail::SharedState<T>> state) : state(std::move(state)) {}
+
+        friend class Promise<T>;
+        template<class U> friend class Future;
+        template<class U, class F, class... Args>
+        friend void future_detail::fulfill(Promise<U> promise, F &func, Args &&...args);
+        template<class U>
+        friend Future<std::conditional_t<std::is_void_v<U>, void, std::vector<U>>>
+        when_all(std::vector<Future<U>> futures);
+
+    public:
+        /// @brief An invalid future (see valid).
+        Future() = default;
+
+        /// @brief Whether the future refers to a shared state (default constructed ones do not).
+        bool valid() const { return state != nullptr; }
+
+        /// @brief Whether the value or error is available.
+        bool ready() const { return state->is_ready(); }
+
+        /// @brief Blocks until the value or error is available.
+        void wait() const { state->wait(); }
+
+        /// @brief Blocks until the future is ready and returns its value.
+        /// @throws the error the future was completed with.
+        std::conditional_t<std::is_void_v<T>, void, const future_detail::stored_t<T> &> get() const {
+            if constexpr(std::is_void_v<T>) state->get();
+            else return state->get();
+        }
+
+        /// @brief Calls func with the value (nothing for a Future<void>) once it is available, see the file comment
+        /// for the thread it runs on. An error of this future (or thrown by func) is passed on to the returned future
+        /// without calling func. If func returns a Future, the returned future completes with it.
+        /// @return Future of the result of func.
+        template<class F>
+        auto then(F func) const {
+            using R = std::conditional_t<std::is_void_v<T>, std::invoke_result<F &>,
+                    std::invoke_result<F &, const future_detail::stored_t<T> &>>;
+            using U = future_detail::unwrap_t<typename R::type>;
+            Promise<U> promise;
+            Future<U> result = promise.get_future();
+            state->on_ready([promise, func = std::move(func), state = state]() mutable {
+                if(std::exception_ptr error = state->get_error()) {
+                    promise.set_error(error);
+                } else if constexpr(std::is_void_v<T>) {
+                    future_detail::fulfill(promise, func);
+                } else {
+                    future_detail::fulfill(promise, func, state->get());
+                }
+            });
+            return result;
+        }
+};
+
+/// @brief Future that is ready with value.
+template<class T>
+Future<T> make_ready_future(T value) {
+    Promise<T> promise;
+    promise.set_value(std::move(value));
+    return promise.get_future();
+}
+
+/// @brief Future<void> that is ready.
+inline Future<void> make_ready_future() {
+    Promise<void> promise;
+    promise.set_value();
+    return promise.get_future();
+}
+
+/// @brief Future that is ready once all futures are: with their values in order (nothing for Future<void>), or with
+/// the first error (in order) after all of them completed, so nothing they refer to is in use anymore.
+template<class T>
+Future<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>> when_all(std::vector<Future<T>> futures) {
+    using V = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+    struct countdown {
+        std::mutex mutex;
+        std::size_t pending;
+        std::vector<Future<T>> futures;
+        Promise<V> promise;
+    };
+    auto shared = std::make_shared<countdown>();
+    shared->pending = futures.size();
+    shared->futures = futures;
+    Future<V> result = shared->promise.get_future();
+    if(futures.empty()) {
+        if constexpr(std::is_void_v<T>) shared->promise.set_value();
+        else shared->promise.set_value(V());
+        return result;
+    }
+
+    for(Future<T> &future : futures) {
+        future.state->on_ready([shared] {
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if(--shared->pending != 0) return;
+            }
+            // all are ready -> none of the loops below blocks
+            for(Future<T> &done : shared->futures) {
+                if(std::exception_ptr error = done.state->get_error()) {
+                    shared->promise.set_error(error);
+                    return;
+                }
+            }
+            if constexpr(std::is_void_v<T>) {
+                shared->promise.set_value();
+            } else {
+                V values;
+                values.reserve(shared->futures.size());
+                for(Future<T> &done : shared->futures) values.push_back(done.get());
+                shared->promise.set_value(std::move(values));
+            }
+        });
+    }
+    return result;
+}
+
+/// @brief Future<void> that is ready once all futures (of any value types) are, with the first error (see the
+/// vector overload).
+template<class... Ts>
+Future<void> when_all(const Future<Ts> &...futures) {
+    return when_all(std::vector<Future<void>>{futures.then([](const auto &...) {})...});
+}
@@ -0,0 +1,81 @@
+#include "MorselScheduler.hpp"
+
+#include <numa.h>
+#include <stdexcept>
+
+MorselScheduler::MorselScheduler(uint32_t thread_count, uint64_t morsel_count, uint64_t segment_count)
+        : morsel_count(morsel_count), segment_count(segment_count), ranges(thread_count), victims(thread_count) {
+    if(morsel_count > 0xFFFFFFFFull) {
+        throw std::invalid_argument("Morsel count must fit into 32 bit");
+    }
+}
+
+void MorselScheduler::reset(const std::vector<int> &thread_cpus) {
+    const uint32_t thread_count = ranges.size();
+
+    // the morsels starting in the static sliver of thread i (both split like VamPointer::sliver_segment_count),
+    // without segments the morsels themselves are split that way
+    const bool by_segments = segment_count >= morsel_count;
+    uint64_t begin = 0;
+    for(uint32_t i = 0; i < thread_count; ++i) {
+        uint64_t end = _part_begin(i + 1, morsel_count, thread_count);
+        if(by_segments) {
+            const uint64_t sliver_end = _part_begin(i + 1, segment_count, thread_count);
+            end = begin;
+            while(end < morsel_count && _part_begin(end, segment_count, morsel_count) < sliver_end) ++end;
+        }
+        if(i + 1 == thread_count) end = morsel_count;
+        ranges[i].range.store(_pack(begin, end), std::memory_order_relaxed);
+        begin = end;
+    }
+
+    std::vector<int> nodes;
+    for(int cpu : thread_cpus) {
+        nodes.push_back(cpu >= 0 ? numa_node_of_cpu(cpu) : -1);
+    }
+    for(uint32_t i = 0; i < thread_count; ++i) {
+        victims[i].clear();
+        // neighbours in cyclic order, the ones on the same node first
+        for(bool same_node : {true, false}) {
+            for(uint32_t d = 1; d < thread_count; ++d) {
+                uint32_t victim = (i + d) % thread_count;
+                if((nodes[victim] == nodes[i]) == same_node) victims[i].push_back(victim);
+            }
+        }
+    }
+}
+
+bool MorselScheduler::next(uint32_t thread_id, uint64_t &morsel) {
+    if(_pop_front(thread_id, morsel)) return true;
+    for(uint32_t victim : victims[thread_id]) {
+        if(_steal(victim, thread_id, morsel)) return true;
+    }
+    return false;
+}
+
+bool MorselScheduler::_pop_front(uint32_t thread_id, uint64_t &morsel) {
+    std::atomic<uint64_t> &own = ranges[thread_id].range;
+    uint64_t range = own.load(std::memory_order_relaxed);
+    while(_begin(range) < _end(range)) {
+        if(own.compare_exchange_weak(range, _pack(_begin(range) + 1, _end(range)), std::memory_order_relaxed)) {
+            morsel = _begin(range);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MorselScheduler::_steal(uint32_t victim, uint32_t thief, uint64_t &morsel) {
+    std::atomic<uint64_t> &other = ranges[victim].range;
+    uint64_t range = other.load(std::memory_order_relaxed);
+    while(_begin(range) < _end(range)) {
+        uint64_t mid = _end(range) - (_end(range) - _begin(range) + 1) / 2;
+        if(other.compare_exchange_weak(range, _pack(_begin(range), mid), std::memory_order_relaxed)) {
+            // the own range is empty, so no other thread modifies it (ranges are never handed out twice)
+            ranges[thief].range.store(_pack(mid + 1, _end(range)), std::memory_order_relaxed);
+            morsel = mid;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/// @brief Hands out the morsels (indices 0 .. morsel_count - 1) of a dynamic thread group to its threads. Every
+/// thread owns a contiguous range of morsels (initially the morsels starting in the sliver the static SplitWrapper
+/// split gives the thread, so NUMA-placed slivers stay local) and takes morsels from its front. A thread whose range is exhausted steals the
+/// back half of the range of another thread, preferring victims on its own NUMA node, and continues with it as its
+/// own range (so it can be stolen from again).
+class MorselScheduler {
+    private:
+        /// @brief Range [begin, end) of morsels owned by one thread, packed as begin | end << 32 so it can be taken
+        /// from with a single CAS. Padded to a cache line to avoid false sharing between the threads.
+        struct alignas(64) morsel_range {
+            std::atomic<uint64_t> range{0};
+        };
+
+        /// @brief Number of morsels of one run.
+        uint64_t morsel_count;
+        /// @brief Number of segments the morsels are split from, 0 if unknown.
+        uint64_t segment_count;
+        /// @brief Morsel range of each thread.
+        std::vector<morsel_range> ranges;
+        /// @brief Threads to steal from for each thread, same NUMA node first.
+        std::vector<std::vector<uint32_t>> victims;
+
+    public:
+        /// @brief Constructor for the MorselScheduler class.
+        /// @param thread_count Number of threads taking morsels.
+        /// @param morsel_count Number of morsels of each run.
+        /// @param segment_count Number of segments split into the morsels (like VamPointer::split), 0 if unknown.
+        MorselScheduler(uint32_t thread_count, uint64_t morsel_count, uint64_t segment_count = 0);
+
+        /// @brief Prepares the next run: assigns each thread its initial range and orders the victims of each
+        /// thread by the NUMA node of its CPU core. Thread i initially owns the morsels whose first segment lies in
+        /// sliver i of a static split over the threads (an even split of the morsels if the segment count is
+        /// unknown). Must not be called while a run is in progress.
+        /// @param thread_cpus CPU core of each thread, -1 if it is not pinned (see ThreadGroup::pin_threads).
+        void reset(const std::vector<int> &thread_cpus);
+
+        /// @brief Returns the number of morsels of each run.
+        uint64_t get_morsel_count() const { return morsel_count; }
+
+        /// @brief Gets the next morsel for thread thread_id, from its own range or stolen from another thread.
+        /// @param thread_id ID of the thread within its thread group.
+        /// @param morsel Set to the index of the morsel to process.
+        /// @return false if all morsels of this run are taken.
+        bool next(uint32_t thread_id, uint64_t &morsel);
+
+    private:
+        static uint64_t _pack(uint64_t begin, uint64_t end) { return begin | (end << 32); }
+        static uint64_t _begin(uint64_t range) { return range & 0xFFFFFFFFull; }
+        static uint64_t _end(uint64_t range) { return range >> 32; }
+
+        /// @brief First element of part i of count elements split into parts parts, remainder on the first parts
+        /// (the partition of VamPointer::sliver_segment_count).
+        static uint64_t _part_begin(uint64_t i, uint64_t count, uint64_t parts) {
+            return i * (count / parts) + std::min(i, count % parts);
+        }
+
+        /// @brief Takes the first morsel of the range of thread_id.
+        bool _pop_front(uint32_t thread_id, uint64_t &morsel);
+        /// @brief Takes the back half of the range of victim: thief processes its first morsel and owns the rest.
+        bool _steal(uint32_t victim, uint32_t thief, uint64_t &morsel);
+};
@@ -2,39 +2,137 @@
 
 
 ThreadGroup::~ThreadGroup() {
-    if(!start_pistol_fired) start_pistol.set_value(); // signal all threads to start
+    // the pending tasks reference this group
+    std::unique_lock<std::mutex> lock(run_mutex);
+    run_finished.wait(lock, [this] { return running == 0; });
+}
+
+void ThreadGroup::run_async(const std::vector<ThreadWrapper *> &workers, 
+        std::vector<std::pair<ThreadGroup *, dependency_kind>> run_dependencies,
+        std::function<void(std::exception_ptr)> finished) {
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        if(running != 0) {
+            throw std::runtime_error("ThreadGroup " + group_id + " is already running");
+        }
+        running = thread_count;
+        error = nullptr;
+        on_finished = std::move(finished);
+    }
+    active_dependencies = std::move(run_dependencies);
+    run_done.store(0, std::memory_order_relaxed);
+    done_prefix.store(0, std::memory_order_relaxed);
+    for(uint64_t m = 0; m < get_morsel_count(); ++m) {
+        morsel_done[m].store(0, std::memory_order_relaxed);
+    }
+
+    // the timers do not expand automatically (start calls would be delayed), so make room for this run while no
+    // thread of the group is running. Tasks sharing a worker run one after the other and may each take a group 
+    // timer round.
+    if(group_timer_valid) group_timer.expand_rounds_if(thread_count);
+    if(thread_timers_valid) {
+        for(auto& timer : thread_timers) timer.expand_rounds_if(1);
+    }
+    if(scheduler) scheduler->reset(thread_cpus);
+
+    for(uint32_t i = 0; i < thread_count; ++i) {
+        workers[i]->submit([this, i] {
+            try {
+                thread_tasks[i]();
+            } catch(...) {
+                {
+                    std::lock_guard<std::mutex> lock(run_mutex);
+                    if(!error) error = std::current_exception();
+                }
+                _release_dependents();
+            }
+            _finish_task();
+        });
+    }
+}
+
+void ThreadGroup::join() {
+    std::unique_lock<std::mutex> lock(run_mutex);
+    run_finished.wait(lock, [this] { return running == 0; });
+    if(error) {
+        std::exception_ptr task_error = error;
+        error = nullptr;
+        std::rethrow_exception(task_error);
+    }
+}
 
-    for(auto& thread_wrapper : thread_pool) {
-        // destructor of ThreadWarpper joins them as well
-        delete thread_wrapper;
+void ThreadGroup::_finish_task() {
+    std::function<void(std::exception_ptr)> finished;
+    std::exception_ptr run_error;
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        if(--running != 0) return;
+        run_done.store(1, std::memory_order_release);
+        run_done.notify_all();
+        run_finished.notify_all();
+        finished = std::move(on_finished);
+        on_finished = nullptr;
+        run_error = error;
     }
-    thread_pool.clear();
+    // may start the next run of this group (or delete it), so this is not touched afterwards
+    if(finished) finished(run_error);
 }
 
-void ThreadGroup::run() {
-    
-    start_pistol.set_value();
+void ThreadGroup::add_dependency(ThreadGroup *upstream, dependency_kind kind) {
+    if(kind != dependency_kind::all && 
+            (get_morsel_count() == 0 || get_morsel_count() != upstream->get_morsel_count())) {
+        throw std::invalid_argument("Morsel dependency of " + group_id + " on " + upstream->group_id + 
+                " requires two dynamic thread groups with the same morsel count");
+    }
+    dependencies.emplace_back(upstream, kind);
+}
 
-    for(ThreadWrapper* thread : thread_pool) {
-        thread->join(); // join all threads in the group
+void ThreadGroup::_wait_for_groups() {
+    for(auto [upstream, kind] : active_dependencies) {
+        if(kind == dependency_kind::all) {
+            TRACE_SCOPE(upstream->trace_name, "wait", 0)
+            upstream->run_done.wait(0, std::memory_order_acquire);
+        }
     }
 }
 
-ThreadWrapper * ThreadGroup::run_async() {
-    if(start_pistol_fired) {
-        throw std::runtime_error("ThreadGroup already started");
+void ThreadGroup::_wait_for_morsel(uint64_t morsel) {
+    for(auto [upstream, kind] : active_dependencies) {
+        TRACE_SCOPE(upstream->trace_name, "wait", morsel)
+        if(kind == dependency_kind::same_morsel) {
+            upstream->morsel_done[morsel].wait(0, std::memory_order_acquire);
+        } else if(kind == dependency_kind::previous_morsels) {
+            upstream->_wait_for_prefix(morsel);
+        }
     }
-    start_pistol.set_value();
-    start_pistol_fired = true;
+}
+
+void ThreadGroup::_wait_for_prefix(uint64_t morsel) {
+    uint64_t prefix = done_prefix.load(std::memory_order_acquire);
+    if(prefix > morsel) return;
 
-    // return the last thread, which join the other thread of the thread group and can be joined later
-    return thread_pool[thread_count - 1];
+    for(uint64_t m = prefix; m <= morsel; ++m) {
+        morsel_done[m].wait(0, std::memory_order_acquire);
+    }
+    // publish the longer prefix for the next waiters
+    while(prefix <= morsel && 
+            !done_prefix.compare_exchange_weak(prefix, morsel + 1, std::memory_order_acq_rel)) {}
+}
+
+void ThreadGroup::_finish_morsel(uint64_t morsel) {
+    morsel_done[morsel].store(1, std::memory_order_release);
+    morsel_done[morsel].notify_all();
+}
+
+void ThreadGroup::_release_dependents() {
+    for(uint64_t m = 0; m < get_morsel_count(); ++m) {
+        _finish_morsel(m);
+    }
 }
 
 std::vector<int> ThreadGroup::pin_threads(std::vector<std::pair<int, int>> range, uint64_t start_core_index) {
-    std::vector<int> result;
-    for(auto thread : thread_pool) {
-        result.push_back(thread->pin_thread(range, start_core_index));
+    for(uint32_t i = 0; i < thread_count; ++i) {
+        thread_cpus[i] = get_cpu_id(start_core_index + i, range);
     }
-    return result;
+    return thread_cpus;
 }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
-#include <future>
+#include <exception>
+#include <mutex>
 #include <map>
 #include <string>
 #include <thread>
@@ -9,31 +13,67 @@
 #include <vector>
 #include <type_traits>
 #include <functional>
+#include <memory>
 
 #include "stop_watch.hpp"
+#include "../perf_counters.hpp"
+#include "../tracer.hpp"
+#include "MorselScheduler.hpp"
 #include "ThreadWrapper.hpp"
 #include "SplitWrapper.hpp"
 
+/// @brief Kinds of dependencies between the thread groups started by one ThreadManager::run (see 
+/// ThreadManager::add_dependency).
+enum class dependency_kind {
+    all,             ///< The group starts after all threads of the other group have finished.
+    same_morsel,     ///< Morsel i of the group starts after morsel i of the other group has finished (both dynamic).
+    previous_morsels ///< Morsel i of the group starts after morsels 0 .. i of the other group have finished (both 
+                     ///< dynamic).
+};
+
 /// @brief Class representing a group of threads that can be managed (startet/stopped) together and carry out the same 
-/// function (on different data).
+/// function (on different data). A thread group is a task descriptor: it holds one task per group thread, which is 
+/// executed by the persistent worker (ThreadWrapper) of the ThreadManager assigned to that thread when the group is 
+/// run. A thread group can be run any number of times (but not concurrently with itself). The work is either split 
+/// statically (one sliver per thread, see initialize) or dynamically (morsels, see initialize_dynamic).
 class ThreadGroup {
     private:
-        /// @brief Flag indicating whether the start signal has been sent to the threads.
-        bool start_pistol_fired = false;
-        /// @brief Promise used to signal the threads to start execution.
-        std::promise<void> start_pistol;
-        /// @brief Shared future that threads wait on before starting execution.
-        std::shared_future<void> start_fut;
-
-        /// @brief Pool of thread wrappers representing the threads in the group.
-        std::vector<ThreadWrapper *> thread_pool;
-        
+        /// @brief Tasks of the threads in the group, task i executes the function with the arguments of thread i.
+        std::vector<std::function<void()>> thread_tasks;
+        /// @brief CPU core of each thread in the group, or -1 if the thread is not pinned (see pin_threads).
+        std::vector<int> thread_cpus;
+        /// @brief Distributes the morsels of a dynamic thread group (see initialize_dynamic), nullptr otherwise.
+        std::unique_ptr<MorselScheduler> scheduler;
+        /// @brief Per morsel: set to 1 when it has been processed in the current run (dynamic thread groups only).
+        std::unique_ptr<std::atomic<uint32_t>[]> morsel_done;
+        /// @brief Number of leading morsels known to be processed in the current run (see _wait_for_prefix).
+        std::atomic<uint64_t> done_prefix{0};
+        /// @brief Set to 1 when all threads of the current run have finished.
+        std::atomic<uint32_t> run_done{0};
+
+        /// @brief Groups this group depends on (see ThreadManager::add_dependency).
+        std::vector<std::pair<ThreadGroup *, dependency_kind>> dependencies;
+        /// @brief Dependencies on groups started by the same run as this group (the others are already satisfied).
+        std::vector<std::pair<ThreadGroup *, dependency_kind>> active_dependencies;
+
+        /// @brief Protects running and error.
+        std::mutex run_mutex;
+        /// @brief Notified when the last task of a run has finished.
+        std::condition_variable run_finished;
+        /// @brief Number of tasks of the current run that have not finished yet.
+        uint32_t running = 0;
+        /// @brief First exception thrown by a task of the current run (rethrown by join).
+        std::exception_ptr error;
+        /// @brief Called once after the last task of the current run has finished, with its error (see run_async).
+        std::function<void(std::exception_ptr)> on_finished;
         
     public:
         /// @brief Identifier for the thread group.
         std::string group_id;
         /// @brief Number of threads in the group.
         uint32_t thread_count;
+        /// @brief Name of the trace events of this group (see tracer.hpp), nullptr if tracing is disabled.
+        const char *trace_name;
 
         /// @brief Flag indicating whether group timing is enabled (used when writing the results to a file).
         bool group_timer_valid = false; 
@@ -43,6 +83,9 @@ class ThreadGroup {
         bool thread_timers_valid = false; 
         /// @brief Vector of timers to measure the execution time of individual threads.
         std::vector<thread_timer_t> thread_timers;
+        /// @brief Hardware counters of the individual threads, summed over all runs (only filled with 
+        /// MEASURE_THREAD and MEASURE_COUNTERS, see perf_counters.hpp).
+        std::vector<perf::counter_values> thread_counters;
 
     public:
         /// @brief Constructor for the ThreadGroup class.
@@ -50,7 +93,8 @@ class ThreadGroup {
         /// @param thread_count Number of threads in the group.
         /// @param timer_epoch Epoch time point for initializing the timers. This is typically the same for all thread groups in a ThreadManager.
         ThreadGroup(std::string group_id, uint32_t thread_count, time_point timer_epoch)
-                 : group_id(group_id), thread_count(thread_count), group_timer(timer_epoch) {} 
+                 : thread_cpus(thread_count, -1), group_id(group_id), thread_count(thread_count), 
+                   trace_name(TRACE_INTERN(group_id)), group_timer(timer_epoch) {} 
                  // the epoch is set here even if its no decideable by the constructor weather or not the timer is used, 
                  // but the epoch is const and has to be set at construction time (the timer is implicitly constructed with this constructor call)
 
@@ -73,44 +117,206 @@ class ThreadGroup {
                 thread_timers.reserve(thread_count);
                 for(int i = 0; i < thread_count; ++i) 
                     thread_timers.emplace_back(thread_timer_t(timer_epoch));
+                thread_counters.resize(thread_count);
             }
-                
-            // setup start signaling mechanism
-            start_pistol = std::promise<void>();
-            start_fut = start_pistol.get_future().share();
             
-            // setup ThreadWrappers
+            // setup thread tasks
             // generate_thread_arg_lists creates a vector of tuples, each tuple containing the arguments for one thread.
             // Here each argument is either the original argument, or split up into chunks (if it was wrapped in a 
             // SplitWrapper).
             auto parameters = generate_thread_arg_lists(thread_count, std::make_tuple(args...));
-            for(int i = 0; i < thread_count; ++i) {
-                ThreadWrapper* thread_wrapper = new ThreadWrapper(thread_pool, i, thread_count, 
-                        start_fut, group_timer, thread_timers[i]);
-                thread_wrapper->initalize<MEASURE_GROUP, MEASURE_THREAD>
-                        (std::forward<F>(func), parameters[i]);
+            thread_tasks.reserve(thread_count);
+            for(uint32_t i = 0; i < thread_count; ++i) {
+                thread_tasks.push_back(make_task<MEASURE_GROUP, MEASURE_THREAD>(i, std::forward<F>(func), parameters[i]));
+            }
+        }
 
-                thread_pool.push_back(thread_wrapper);
+        /// @brief Initializes the thread group for dynamic scheduling: the SplitWrapper'ed arguments are split into
+        /// morsels of about morsel_segments segments (instead of one sliver per thread) and the threads call the 
+        /// function once per morsel they take from the MorselScheduler (stealing morsels from other threads when 
+        /// their own ones are done). All SplitWrapper'ed arguments must have the same segment count.
+        /// @tparam MEASURE_GROUP Whether to measure group time.
+        /// @tparam MEASURE_THREAD Whether to measure thread time.
+        /// @tparam F Function type.
+        /// @tparam ...Args Argument types.
+        /// @param timer_epoch Epoch time point for initializing the timers. This is typically the same for all thread groups in a ThreadManager.
+        /// @param morsel_segments Number of segments per morsel.
+        /// @param func Function to be executed per morsel.
+        /// @param args Arguments to be passed to the function.
+        template<bool MEASURE_GROUP, bool MEASURE_THREAD, class F, class... Args>
+        void initialize_dynamic(time_point timer_epoch, std::size_t morsel_segments, F&& func, Args&&... args) {
+            if(morsel_segments == 0) {
+                throw std::invalid_argument("Morsel size must be greater than 0");
+            }
+            if constexpr(MEASURE_GROUP) {
+                group_timer_valid = true;
+            } if constexpr(MEASURE_THREAD) { 
+                thread_timers_valid = true;
+                thread_timers.reserve(thread_count);
+                for(uint32_t i = 0; i < thread_count; ++i) 
+                    thread_timers.emplace_back(thread_timer_t(timer_epoch));
+                thread_counters.resize(thread_count);
+            }
+
+            std::size_t segment_count = std::max({std::size_t(0), _split_segment_count(args)...});
+            std::size_t morsel_count = std::max<std::size_t>((segment_count + morsel_segments - 1) / morsel_segments, 1);
+            scheduler = std::make_unique<MorselScheduler>(thread_count, morsel_count, segment_count);
+            morsel_done = std::make_unique<std::atomic<uint32_t>[]>(morsel_count);
+
+            // one argument tuple per morsel, shared by the tasks of all threads
+            auto morsels = std::make_shared<decltype(generate_thread_arg_lists(morsel_count, std::make_tuple(args...)))>(
+                    generate_thread_arg_lists(morsel_count, std::make_tuple(args...)));
+            thread_tasks.reserve(thread_count);
+            for(uint32_t i = 0; i < thread_count; ++i) {
+                thread_tasks.push_back(make_dynamic_task<MEASURE_GROUP, MEASURE_THREAD>(i, std::forward<F>(func), morsels));
             }
         }
 
+        /// @brief Waits for a pending run to finish.
         ~ThreadGroup();
 
-        /// @brief Runs the thread group by signaling all threads to start and then waits for their completion.
-        /// This function blocks until all threads in the group have finished execution.
-        void run();
-        /// @brief Runs the thread group by signaling all threads to start and returns immediately. The caller is 
-        /// responsible for joining the returned ThreadWrapper later.
-        /// @return Pointer to the ThreadWrapper of the last thread in the group (which joins the other threads in its 
-        /// thread group), which can be joined later.
-        ThreadWrapper * run_async();
+        /// @brief Submits task i of the group to workers[i] and returns immediately. The caller is responsible for 
+        /// calling join later. The tasks wait for the given dependencies, so groups have to be started after the 
+        /// groups they depend on (tasks are executed in submission order by each worker, so a waiting task never 
+        /// blocks the task it waits for).
+        /// @param workers Worker for each thread of the group (see ThreadManager::run_async).
+        /// @param run_dependencies Dependencies on groups that are started by the same run (before this group).
+        /// @param finished Called by the worker of the last finished task with the first error of the run (nullptr 
+        /// if there was none), after the group can be run again (see ThreadManager::run_future).
+        /// @throws std::runtime_error if the group is still running.
+        void run_async(const std::vector<ThreadWrapper *> &workers, 
+                std::vector<std::pair<ThreadGroup *, dependency_kind>> run_dependencies = {},
+                std::function<void(std::exception_ptr)> finished = nullptr);
+        /// @brief Blocks until all tasks of the last run have finished.
+        /// @throws the first exception thrown by a task of the last run.
+        void join();
 
-        /// @brief Pins the threads in the group to specific CPU cores within the given ranges.
+        /// @brief Pins the threads in the group to specific CPU cores within the given ranges, i.e. selects the 
+        /// workers of these cores for the next runs.
         /// @param range A vector of pairs, where each pair represents a range of CPU cores to pin a thread to.
         /// @return A vector of integers representing the CPU cores each thread is pinned to.
         std::vector<int> pin_threads(std::vector<std::pair<int, int>> range, uint64_t start_core_index = 0);
 
+        /// @brief Returns the CPU core of each thread in the group (-1 if the thread is not pinned).
+        const std::vector<int> &get_thread_cpus() const { return thread_cpus; }
+
+        /// @brief Returns the number of morsels of a dynamic thread group, 0 for a statically split one.
+        uint64_t get_morsel_count() const { return scheduler ? scheduler->get_morsel_count() : 0; }
+
+        /// @brief Declares that this group depends on upstream whenever both are started by the same run.
+        /// @throws std::invalid_argument if kind is a morsel dependency and not both groups are dynamic thread 
+        /// groups with the same morsel count.
+        void add_dependency(ThreadGroup *upstream, dependency_kind kind);
+
+        /// @brief Returns the declared dependencies of this group.
+        const std::vector<std::pair<ThreadGroup *, dependency_kind>> &get_dependencies() const { 
+            return dependencies; 
+        }
+
     private:
+        /// @brief Creates the task of thread thread_id: starts and stops the optional timers (and thread counters) 
+        /// around the call of the function with the arguments of that thread.
+        /// @tparam MEASURE_GROUP Whether to measure group time.
+        /// @tparam MEASURE_THREAD Whether to measure thread time.
+        /// @tparam F Function type.
+        /// @tparam ...Args Argument types (after splitting).
+        /// @param thread_id ID of the thread within the group.
+        /// @param func Function to be executed by the thread.
+        /// @param args Arguments to be passed to the function.
+        template<bool MEASURE_GROUP, bool MEASURE_THREAD, class F, class ... Args>
+        std::function<void()> make_task(uint32_t thread_id, F&& func, std::tuple<Args...>& args) {
+            return [this, thread_id, task_args = ThreadArgs<F, Args...>(std::forward<F>(func), args)]() mutable {
+                _wait_for_groups();
+
+                if constexpr (MEASURE_GROUP) group_timer.start_time();
+
+                if constexpr (MEASURE_THREAD) thread_timers[thread_id].start_time();
+#if MEASURE_COUNTERS
+                perf::counter_values counters_start;
+                if constexpr (MEASURE_THREAD) counters_start = perf::read_this_thread();
+#endif
+
+                TRACE_BEGIN(trace_name, "group", thread_id)
+                std::apply(task_args.func, task_args.args);
+                TRACE_END(trace_name, "group", thread_id)
+
+#if MEASURE_COUNTERS
+                if constexpr (MEASURE_THREAD) thread_counters[thread_id] += perf::read_this_thread() - counters_start;
+#endif
+                if constexpr (MEASURE_THREAD) thread_timers[thread_id].stop_time();
+
+                if constexpr (MEASURE_GROUP) group_timer.stop_time();
+            };
+        }
+
+        /// @brief Creates the task of thread thread_id of a dynamic group: starts and stops the optional timers 
+        /// around calling the function for every morsel the thread gets from the scheduler.
+        /// @tparam MEASURE_GROUP Whether to measure group time.
+        /// @tparam MEASURE_THREAD Whether to measure thread time.
+        /// @tparam F Function type.
+        /// @tparam ...Args Argument types (after splitting).
+        /// @param thread_id ID of the thread within the group.
+        /// @param func Function to be executed per morsel.
+        /// @param morsels Arguments of each morsel.
+        template<bool MEASURE_GROUP, bool MEASURE_THREAD, class F, class ... Args>
+        std::function<void()> make_dynamic_task(uint32_t thread_id, F&& func, 
+                std::shared_ptr<std::vector<std::tuple<Args...>>> morsels) {
+            return [this, thread_id, func = std::forward<F>(func), morsels]() mutable {
+                _wait_for_groups();
+
+                if constexpr (MEASURE_GROUP) group_timer.start_time();
+
+                if constexpr (MEASURE_THREAD) thread_timers[thread_id].start_time();
+#if MEASURE_COUNTERS
+                perf::counter_values counters_start;
+                if constexpr (MEASURE_THREAD) counters_start = perf::read_this_thread();
+#endif
+
+                TRACE_BEGIN(trace_name, "group", thread_id)
+                uint64_t morsel;
+                while(scheduler->next(thread_id, morsel)) {
+                    _wait_for_morsel(morsel);
+                    TRACE_BEGIN(trace_name, "morsel", morsel)
+                    std::apply(func, (*morsels)[morsel]);
+                    TRACE_END(trace_name, "morsel", morsel)
+                    _finish_morsel(morsel);
+                }
+                TRACE_END(trace_name, "group", thread_id)
+
+#if MEASURE_COUNTERS
+                if constexpr (MEASURE_THREAD) thread_counters[thread_id] += perf::read_this_thread() - counters_start;
+#endif
+                if constexpr (MEASURE_THREAD) thread_timers[thread_id].stop_time();
+
+                if constexpr (MEASURE_GROUP) group_timer.stop_time();
+            };
+        }
+
+        /// @brief Segment count of a SplitWrapper'ed argument (used to size the morsels of a dynamic group).
+        template<class T, std::size_t block_size>
+        static std::size_t _split_segment_count(SplitWrapper<block_size, T>& value) {
+            return value.value->segment_count();
+        }
+
+        /// @brief Overload for arguments that are not split, they do not determine the morsel count.
+        template<class T>
+        static std::size_t _split_segment_count(T&) { return 0; }
+
+        /// @brief Called by every task after it finished, wakes up join (and dependent groups) after the last one.
+        void _finish_task();
+
+        /// @brief Waits until the groups of all active dependencies of kind all have finished.
+        void _wait_for_groups();
+        /// @brief Waits until the morsel dependencies of morsel are satisfied.
+        void _wait_for_morsel(uint64_t morsel);
+        /// @brief Waits until morsels 0 .. morsel of this group are processed.
+        void _wait_for_prefix(uint64_t morsel);
+        /// @brief Marks morsel as processed and wakes up the groups waiting for it.
+        void _finish_morsel(uint64_t morsel);
+        /// @brief Marks all morsels as processed after a task failed, so dependent groups do not wait forever 
+        /// (the error is rethrown by join).
+        void _release_dependents();
+
         /// @brief Generates a vector of tuples, where each tuple contains the arguments for one thread.
         /// Each argument is either the original argument or a subchunk of the argument if it was wrapped in a SplitWrapper.
         /// @tparam ...Args Types of the arguments.
@@ -19,14 +19,125 @@ ThreadManager::ThreadManager(thread_pin_policy pin_policy = thread_pin_policy::m
 }
 
 ThreadManager::~ThreadManager() {
+    // the groups wait for their pending runs, so the workers are idle afterwards
     for(auto& group : thread_groups) {
         delete group.second;
     }
+    for(auto& worker : workers) {
+        delete worker.second;
+    }
 }
 
 // Private member functions:
+
+ThreadWrapper* ThreadManager::_worker(int key) {
+    auto it = workers.find(key);
+    if(it == workers.end()) {
+        it = workers.emplace(key, new ThreadWrapper(key >= 0 ? key : -1)).first;
+    }
+    return it->second;
+}
+
+void ThreadManager::_reserve_workers(const ThreadGroup& group) {
+    for(uint32_t i = 0; i < group.thread_count; ++i) {
+        _worker(_worker_key(group.get_thread_cpus(), i, 0));
+    }
+}
+
+std::vector<ThreadGroup *> ThreadManager::_topological_order(const std::vector<std::string>& group_ids) {
+    std::vector<ThreadGroup *> requested;
+    for(const std::string& group_id : group_ids) {
+        //might throw an exception if group_id does not exist
+        requested.push_back(thread_groups.at(group_id));
+    }
+
+    // 0: not visited, 1: in progress, 2: done
+    std::map<ThreadGroup *, int> state;
+    for(ThreadGroup *group : requested) state[group] = 0;
+
+    std::vector<ThreadGroup *> order;
+    std::function<void(ThreadGroup *)> visit = [&](ThreadGroup *group) {
+        int &group_state = state.at(group);
+        if(group_state == 2) return;
+        if(group_state == 1) {
+            throw std::runtime_error("Cyclic dependency involving thread group " + group->group_id);
+        }
+        group_state = 1;
+        for(auto [upstream, kind] : group->get_dependencies()) {
+            if(state.count(upstream)) visit(upstream);
+        }
+        state.at(group) = 2;
+        order.push_back(group);
+    };
+    for(ThreadGroup *group : requested) visit(group);
+    return order;
+}
+
+std::vector<ThreadGroup *> ThreadManager::_dispatch(const std::vector<std::string>& group_ids,
+        std::function<void(std::exception_ptr)> finished) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::vector<ThreadGroup *> groups = _topological_order(group_ids);
+    std::vector<ThreadGroup *> started;
+    uint32_t unpinned_offset = 0;
+
+    // counts down the groups of this run, the last one to finish calls finished
+    std::function<void(std::exception_ptr)> group_finished;
+    if(finished) {
+        struct countdown {
+            std::mutex mutex;
+            std::size_t pending;
+            std::exception_ptr error;
+            std::function<void(std::exception_ptr)> finished;
+        };
+        auto shared = std::make_shared<countdown>();
+        shared->pending = groups.size();
+        shared->finished = std::move(finished);
+        group_finished = [shared](std::exception_ptr error) {
+            {
+                std::lock_guard<std::mutex> count_lock(shared->mutex);
+                if(error && !shared->error) shared->error = error;
+                if(--shared->pending != 0) return;
+            }
+            shared->finished(shared->error);
+        };
+        if(groups.empty()) shared->finished(nullptr);
+    }
+
+    for(size_t g = 0; g < groups.size(); ++g) {
+        ThreadGroup *group = groups[g];
+        std::vector<ThreadWrapper *> group_workers;
+        bool unpinned = false;
+        for(uint32_t i = 0; i < group->thread_count; ++i) {
+            int key = _worker_key(group->get_thread_cpus(), i, unpinned_offset);
+            unpinned |= key < 0;
+            group_workers.push_back(_worker(key));
+        }
+        if(unpinned) unpinned_offset += group->thread_count;
+
+        // only the dependencies on groups of this run have to be waited for
+        std::vector<std::pair<ThreadGroup *, dependency_kind>> run_dependencies;
+        for(auto dependency : group->get_dependencies()) {
+            if(std::find(groups.begin(), groups.end(), dependency.first) != groups.end()) {
+                run_dependencies.push_back(dependency);
+            }
+        }
+
+        try {
+            group->run_async(group_workers, run_dependencies, group_finished);
+        } catch(...) {
+            // the groups that were not started count as failed, so the started ones still complete the run
+            if(group_finished) {
+                for(size_t rest = g; rest < groups.size(); ++rest) group_finished(std::current_exception());
+            }
+            throw;
+        }
+        started.push_back(group);
+    }
+    return started;
+}
     
 void ThreadManager::reset() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     for(auto & group : thread_groups) {
         delete group.second; // call destructor to clean up
     }
@@ -46,32 +157,23 @@ void ThreadManager::reset() {
 
 void ThreadManager::run(std::vector<std::string> group_ids){
 
-    std::vector<ThreadWrapper *> join_threads;
-
-    for(std::string& group_id : group_ids) {
-        //might throw an exception if group_id does not exist
-        auto *group_join_thread = thread_groups.at(group_id)->run_async();
-        
-        join_threads.push_back(group_join_thread);
-        
-    }
-    
-    for(ThreadWrapper* thread : join_threads) {
-        thread->join();
+    for(ThreadGroup* group : _dispatch(group_ids)) {
+        group->join();
     }
 }
 
-std::vector<ThreadWrapper *> ThreadManager::run_async(std::vector<std::string> group_ids){
+std::vector<ThreadGroup *> ThreadManager::run_async(std::vector<std::string> group_ids){
 
-    std::vector<ThreadWrapper *> join_threads;
+    return _dispatch(group_ids);
+}
 
-    for(std::string& group_id : group_ids) {
-        //might throw an exception if group_id does not exist
-        auto *group_join_thread = thread_groups.at(group_id)->run_async();
-        
-        join_threads.push_back(group_join_thread);
-        
-    }
-    
-    return join_threads;
+Future<void> ThreadManager::run_future(std::vector<std::string> group_ids){
+
+    Promise<void> promise;
+    Future<void> future = promise.get_future();
+    _dispatch(group_ids, [promise](std::exception_ptr error) {
+        if(error) promise.set_error(error);
+        else promise.set_value();
+    });
+    return future;
 }
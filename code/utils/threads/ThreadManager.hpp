@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <future>
 #include <map>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <tuple>
@@ -11,6 +14,7 @@
 
 #include "../stop_watch.hpp"
 
+#include "Future.hpp"
 #include "ThreadGroup.hpp"
 #include "ThreadWrapper.hpp"
 
@@ -20,11 +24,17 @@ enum class thread_pin_policy {
   automatic ///< Pin threads in order of the given CPU ID ranges.
 };
 
-// TODO optional round count for stop_watch preallocation
 /// @brief Class managing multiple thread groups, allowing their creation,
-/// execution, and timing.
+/// execution, and timing. The threads are a pool of persistent workers, one
+/// per used CPU core, that execute the tasks of all thread groups. Groups can
+/// be created, pinned and started from any thread (e.g. from the
+/// continuations of run_future); reset must not be called while groups run.
 class ThreadManager {
 private:
+  /// @brief Protects the groups, pinnings and workers against concurrent
+  /// creation and dispatch (recursive, pin_threads_like pins).
+  mutable std::recursive_mutex mutex;
+
   /// @brief Map storing thread groups identified by their unique string IDs.
   std::map<std::string, ThreadGroup *> thread_groups;
 
@@ -41,19 +51,79 @@ private:
   /// @brief Map storing the pinning information for each thread group by their
   /// IDs.
   std::map<std::string, std::vector<int>> thread_pinnings;
+  /// @brief CPU ranges for groups that are pinned by plan instead of in order
+  /// (see plan_pinning), by group ID. Kept by reset.
+  std::map<std::string, std::vector<std::pair<int, int>>> planned_pinnings;
+
+  /// @brief Persistent workers by CPU core; unpinned workers have the negative
+  /// keys -1, -2, ... (see _worker_key). Created once and reused by all runs
+  /// of all thread groups.
+  std::map<int, ThreadWrapper *> workers;
 
 private:
-  /// @brief Resets the ThreadManager by clearing all existing thread groups.
-  /// This function deletes all thread groups and clears the internal map.
-  void reset();
+  /// @brief Key of the worker for thread thread_id of a group with the given
+  /// CPU cores. Unpinned threads get the unpinned worker thread_id +
+  /// unpinned_offset, so unpinned groups started together do not share
+  /// workers.
+  static int _worker_key(const std::vector<int> &thread_cpus,
+                         uint32_t thread_id, uint32_t unpinned_offset) {
+    int cpu_id = thread_cpus[thread_id];
+    return cpu_id >= 0 ? cpu_id : -1 - int(thread_id + unpinned_offset);
+  }
+
+  /// @brief Returns the worker for key, starting (and pinning) it on first
+  /// use.
+  ThreadWrapper *_worker(int key);
+
+  /// @brief Starts the workers the threads of a group will run on, so thread
+  /// creation is not part of the first run.
+  void _reserve_workers(const ThreadGroup &group);
+
+  /// @brief Pins a new group (if the pin policy is automatic), starts its
+  /// workers and adds it to thread_groups.
+  void _add_group(ThreadGroup *group) {
+    auto planned = planned_pinnings.find(group->group_id);
+    if (planned != planned_pinnings.end()) {
+      thread_pinnings.emplace(group->group_id,
+                              group->pin_threads(planned->second));
+    } else if (pin_policy == thread_pin_policy::automatic) {
+      auto pinnings = group->pin_threads(pin_range, next_core_index);
+      thread_pinnings.emplace(group->group_id, pinnings);
+      next_core_index += group->thread_count;
+    }
+    _reserve_workers(*group);
+
+    thread_groups.emplace(group->group_id, group);
+  }
+
+  /// @brief Orders the given groups so every group comes after the groups it
+  /// depends on.
+  /// @throws std::out_of_range if any of the group IDs does not exist
+  /// @throws std::runtime_error if the dependencies contain a cycle
+  std::vector<ThreadGroup *>
+  _topological_order(const std::vector<std::string> &group_ids);
+
+  /// @brief Starts all given groups (in dependency order) and returns them.
+  /// finished (if set) is called once all of them have finished, with the
+  /// first error of their tasks (see ThreadGroup::run_async).
+  std::vector<ThreadGroup *>
+  _dispatch(const std::vector<std::string> &group_ids,
+            std::function<void(std::exception_ptr)> finished = nullptr);
 
 public:
   /// @brief Constructor for the ThreadManager class.
   ThreadManager(thread_pin_policy pin_policy,
                 std::vector<std::pair<int, int>> pin_range);
   ThreadManager(const ThreadManager &) = delete; // disable copy constructor
+  /// @brief Waits for all thread groups and stops the workers.
   ~ThreadManager();
 
+  /// @brief Resets the ThreadManager by clearing all existing thread groups.
+  /// This function deletes all thread groups and clears the internal map. The
+  /// workers are kept, so the groups of the next run (e.g. the next query)
+  /// reuse the already running (and pinned) threads.
+  void reset();
+
   /// @brief Creates a new thread group with the specified parameters and adds
   /// it to the manager.
   /// @tparam MEASURE_GROUP Whether to measure per group time.
@@ -71,6 +141,7 @@ public:
   template <bool MEASURE_GROUP, bool MEASURE_THREAD, class F, class... Args>
   void create_thread_group(std::string group_id, uint32_t thread_count,
                            F &&func, Args &&...args) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     if (thread_count == 0) {
       throw std::invalid_argument("Thread count must be greater than 0");
     }
@@ -82,23 +153,94 @@ public:
     ThreadGroup *group = new ThreadGroup(group_id, thread_count, epoch);
     group->initialize<MEASURE_GROUP, MEASURE_THREAD>(
         epoch, std::forward<F>(func), std::forward<Args>(args)...);
-    if (pin_policy == thread_pin_policy::automatic) {
-      auto pinnings = group->pin_threads(pin_range, next_core_index);
-      thread_pinnings.emplace(group_id, pinnings);
-      next_core_index += thread_count;
+    _add_group(group);
+  }
+
+  /// @brief Creates a new dynamically scheduled thread group and adds it to
+  /// the manager. Instead of one sliver per thread, the SplitWrapper'ed
+  /// arguments are split into morsels of morsel_segments segments, which the
+  /// threads take (and steal from each other, same NUMA node first) until
+  /// all are processed, so uneven work per segment does not leave threads
+  /// idle (see ThreadGroup::initialize_dynamic). func is called once per
+  /// morsel with the same signature as for create_thread_group.
+  /// @tparam MEASURE_GROUP Whether to measure per group time.
+  /// @tparam MEASURE_THREAD Whether to measure per thread time.
+  /// @tparam F Function type of the function to be executed per morsel.
+  /// @tparam ...Args Argument types of the function.
+  /// @param group_id Unique identifier for the thread group.
+  /// @param thread_count Number of threads in the group.
+  /// @param morsel_segments Number of segments per morsel.
+  /// @param func Function to be executed per morsel.
+  /// @param args Arguments to be passed to the function.
+  /// @throws std::invalid_argument if thread_count or morsel_segments is zero.
+  /// @throws std::runtime_error if a thread group with the same ID already
+  /// exists.
+  template <bool MEASURE_GROUP, bool MEASURE_THREAD, class F, class... Args>
+  void create_dynamic_thread_group(std::string group_id,
+                                   uint32_t thread_count,
+                                   std::size_t morsel_segments, F &&func,
+                                   Args &&...args) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (thread_count == 0) {
+      throw std::invalid_argument("Thread count must be greater than 0");
     }
+    if (thread_groups.find(group_id) != thread_groups.end()) {
+      throw std::runtime_error("Thread group with ID " + group_id +
+                               " already exists");
+    }
+
+    ThreadGroup *group = new ThreadGroup(group_id, thread_count, epoch);
+    group->initialize_dynamic<MEASURE_GROUP, MEASURE_THREAD>(
+        epoch, morsel_segments, std::forward<F>(func),
+        std::forward<Args>(args)...);
+    _add_group(group);
+  }
 
-    thread_groups.emplace(group_id, group);
+  /// @brief Declares that group_id depends on depends_on whenever both are
+  /// started by the same run: with dependency_kind::all group_id starts after
+  /// depends_on has finished, with the morsel kinds (dynamic thread groups
+  /// with the same morsel count) each morsel waits only for the morsel(s) of
+  /// depends_on it needs, so the stages overlap instead of being separated by
+  /// a barrier.
+  /// @throws std::out_of_range if any of the group IDs does not exist
+  /// @throws std::invalid_argument if the groups do not fit the kind (see
+  /// ThreadGroup::add_dependency)
+  void add_dependency(const std::string &group_id,
+                      const std::string &depends_on,
+                      dependency_kind kind = dependency_kind::all) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    thread_groups.at(group_id)->add_dependency(thread_groups.at(depends_on),
+                                               kind);
   }
 
   /// @brief Runs the specified thread groups by their IDs. This function starts
-  /// all threads in the specified groups and waits for their completion.
+  /// all threads in the specified groups and waits for their completion. A
+  /// group can be run again after it finished. Groups are started after the
+  /// groups they depend on (see add_dependency), independent of their order in
+  /// group_ids.
   /// @throws std::out_of_range if any of the specified group IDs do not exist??
   /// @param group_ids Vector of string IDs representing the thread groups to be
   /// run.
   void run(std::vector<std::string> group_ids);
 
-  std::vector<ThreadWrapper *> run_async(std::vector<std::string> group_ids);
+  /// @brief Starts the specified thread groups by their IDs and returns
+  /// immediately. The caller is responsible to call ThreadGroup::join on the
+  /// returned groups before any of them is run again.
+  /// @throws std::out_of_range if any of the specified group IDs do not exist
+  /// @param group_ids Vector of string IDs representing the thread groups to be
+  /// run.
+  /// @return The started groups.
+  std::vector<ThreadGroup *> run_async(std::vector<std::string> group_ids);
+
+  /// @brief Starts the specified thread groups like run_async and returns a
+  /// future that is ready once all of them have finished (with the first
+  /// exception of their tasks), without a thread blocking in join. The groups
+  /// can be run again from its continuations (see Future.hpp), e.g. to
+  /// pipeline the stages of successive queries:
+  ///   tm.run_future({"build"}).then([&] { return tm.run_future({"probe"}); })
+  /// @throws std::out_of_range if any of the specified group IDs do not exist
+  /// @throws std::runtime_error if one of the groups is still running
+  Future<void> run_future(std::vector<std::string> group_ids);
 
   /// @brief Pins the threads of a specific thread group to specific CPU cores
   /// within the given ranges.
@@ -110,11 +252,54 @@ public:
   std::vector<int>
   pin_threads_for_group(const std::string &group_id,
                         std::vector<std::pair<int, int>> range) {
-    auto pinnings = thread_groups.at(group_id)->pin_threads(range);
-    thread_pinnings.emplace(group_id, pinnings);
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    ThreadGroup *group = thread_groups.at(group_id);
+    auto pinnings = group->pin_threads(range);
+    thread_pinnings.insert_or_assign(group_id, pinnings);
+    _reserve_workers(*group);
     return pinnings;
   }
 
+  /// @brief Pins the groups created with ID group_id (now and after reset) in
+  /// order to the cores of range instead of the next cores of the pin range,
+  /// e.g. to place each stage of a query on its own cores (see
+  /// PlacementPlan). The planned groups do not advance the core index of the
+  /// automatically pinned ones.
+  void plan_pinning(const std::string &group_id,
+                    std::vector<std::pair<int, int>> range) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    planned_pinnings.insert_or_assign(group_id, std::move(range));
+  }
+
+  /// @brief Removes all pinnings set by plan_pinning.
+  void clear_planned_pinnings() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    planned_pinnings.clear();
+  }
+
+  /// @brief Returns the number of threads of a thread group.
+  /// @throws std::out_of_range if the group does not exist
+  uint32_t get_thread_count(const std::string &group_id) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return thread_groups.at(group_id)->thread_count;
+  }
+
+  /// @brief Pins thread i of a thread group to the CPU core of thread i of
+  /// another (already pinned) thread group, e.g. to prepare the data of a
+  /// group on the cores that consume it.
+  /// @param group_id ID of the thread group whose threads are to be pinned.
+  /// @param like_group_id ID of the thread group whose pinning is copied.
+  /// @return A vector of integers representing the CPU cores each thread is
+  /// pinned to.
+  std::vector<int> pin_threads_like(const std::string &group_id,
+                                    const std::string &like_group_id) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::vector<std::pair<int, int>> range;
+    for (int core_id : thread_pinnings.at(like_group_id))
+      range.emplace_back(core_id, core_id + 1);
+    return pin_threads_for_group(group_id, range);
+  }
+
   /// @brief Prints the timing results for all thread groups and their
   /// individual threads.
   void print_timings() {
@@ -140,11 +325,26 @@ public:
                       << " ms";
           } else
             std::cout << "not measured";
+#if MEASURE_COUNTERS
+          if (group->thread_timers_valid)
+            std::cout << ", " << group->thread_counters[i].to_string();
+#endif
           std::cout << std::endl;
         }
     }
   }
 
+  /// @brief Returns the measured duration (seconds, summed over all runs) of
+  /// every thread group with a group timer.
+  std::map<std::string, double> get_group_durations() {
+    std::map<std::string, double> durations;
+    for (auto &[id, group] : thread_groups) {
+      if (group->group_timer_valid)
+        durations.emplace(id, group->group_timer.get_duration_sum());
+    }
+    return durations;
+  }
+
   double sum_group_durations() {
     double total_duration = 0.0;
     for (auto &[id, group] : thread_groups) {
@@ -1,34 +1,42 @@
 #include "ThreadWrapper.hpp"
 
-ThreadWrapper::~ThreadWrapper() {
-    if(thread.joinable()) thread.join();
-}
-
-int ThreadWrapper::pin_thread(std::vector<std::pair<int, int>> range, uint64_t start_core_index) {
-    return pin_thread_in_range(thread, start_core_index + thread_id, range);
+ThreadWrapper::ThreadWrapper(int cpu_id) : cpu_id(cpu_id) {
+    thread = std::thread(&ThreadWrapper::thread_func, this);
+    if(cpu_id >= 0) pin_thread_to_cpu_id(thread, cpu_id);
 }
 
-void ThreadWrapper::join() {
-    thread.join();
+ThreadWrapper::~ThreadWrapper() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_available.notify_one();
+    if(thread.joinable()) thread.join();
 }
 
-void ThreadWrapper::_join() {
-    uint32_t iteration = 0b1;
-    while(thread_id % (iteration*2) == 0) {
-        if(thread_id + iteration < thread_count) {
-            std::cout << "T " << thread_id << " joining with T " << thread_id + iteration << std::endl;
-            // join with next still active (not-joined) thread
-            thread_pool[thread_id + iteration]->join();
-            iteration *= 2;
-        } else break;// to break the loop for thread_id 0.
+void ThreadWrapper::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
     }
+    task_available.notify_one();
 }
 
-void ThreadWrapper::_simple_join() {
-    //the last thread is responssible for joining all other thread of its thread group
-    if(thread_id == thread_count - 1) {
-        for(int i = 0; i < thread_count - 1; ++i) {
-            thread_pool[i]->join();
+void ThreadWrapper::thread_func() {
+    TRACE_THREAD_NAME(cpu_id >= 0 ? "worker cpu " + std::to_string(cpu_id) : std::string("worker"))
+#if MEASURE_COUNTERS
+    perf::read_this_thread(); // opens the counters of this thread before the first task
+#endif
+    while(true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_available.wait(lock, [this] { return stopping || !tasks.empty(); });
+            // stop only after the queue is drained, the tasks signal their thread groups
+            if(tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
         }
+        task();
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,233 @@
+/**
+ * @file tracer.hpp
+ * @brief Low overhead event tracer: every thread records begin/end events
+ * (TSC timestamp and CPU id) into its own ring buffer without locking. At
+ * exit the events of all threads are written as a Chrome trace (JSON, can be
+ * opened with chrome://tracing or ui.perfetto.dev) to $TRACE_FILE (default
+ * trace.json). Enabled with -DTRACING=1 (CMake option TRACING), otherwise the
+ * TRACE_* macros expand to nothing.
+ */
+
+#pragma once
+
+#ifndef TRACING
+#define TRACING 0
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <numa.h>
+#include <sched.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace tracing {
+
+struct trace_event {
+  uint64_t tsc;
+  /// interned (see Tracer::intern) or a string literal
+  const char *name;
+  const char *category;
+  uint64_t arg;
+  uint32_t cpu;
+  /// 'B' (begin) or 'E' (end)
+  char phase;
+};
+
+/// @brief Reads the time stamp counter and the CPU the thread runs on with one
+/// rdtscp (Linux keeps the CPU id in the low 12 bits of TSC_AUX).
+inline uint64_t read_tsc(uint32_t &cpu) {
+#if defined(__x86_64__)
+  unsigned int aux;
+  uint64_t tsc = __rdtscp(&aux);
+  cpu = aux & 0xFFF;
+  return tsc;
+#else
+  cpu = sched_getcpu();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+/// @brief Ring buffer of the events of one thread. Only its thread writes, so
+/// recording is a store plus a release increment; when full, the oldest
+/// events are overwritten.
+class TraceBuffer {
+public:
+  static constexpr std::size_t capacity = 1 << 16;
+
+  const uint32_t tid;
+  /// shown as thread name in the trace
+  std::string name;
+  std::vector<trace_event> events;
+  std::atomic<uint64_t> head{0};
+
+  explicit TraceBuffer(uint32_t tid)
+      : tid(tid), name("thread " + std::to_string(tid)), events(capacity) {}
+
+  void record(char phase, const char *event_name, const char *category,
+              uint64_t arg) {
+    uint32_t cpu;
+    const uint64_t tsc = read_tsc(cpu);
+    const uint64_t h = head.load(std::memory_order_relaxed);
+    events[h & (capacity - 1)] = {tsc, event_name, category, arg, cpu, phase};
+    head.store(h + 1, std::memory_order_release);
+  }
+};
+
+/// @brief Owns the buffers of all threads and writes the trace at exit.
+class Tracer {
+private:
+  std::mutex mutex;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers;
+  std::set<std::string> names;
+
+  /// reference points to convert TSC ticks to microseconds
+  uint64_t start_tsc;
+  std::chrono::steady_clock::time_point start_time;
+
+public:
+  Tracer() {
+    uint32_t cpu;
+    start_tsc = read_tsc(cpu);
+    start_time = std::chrono::steady_clock::now();
+  }
+
+  /// the worker threads are joined before static destruction, so no thread
+  /// is recording anymore
+  ~Tracer() {
+    if (buffers.empty())
+      return;
+    const char *path = std::getenv("TRACE_FILE");
+    write_chrome_trace(path != nullptr ? path : "trace.json");
+  }
+
+  /// @brief Buffer of the calling thread (created on first use).
+  TraceBuffer &local() {
+    thread_local TraceBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+      std::lock_guard<std::mutex> lock(mutex);
+      buffers.push_back(std::make_unique<TraceBuffer>(buffers.size()));
+      buffer = buffers.back().get();
+    }
+    return *buffer;
+  }
+
+  /// @brief Returns a copy of name that lives until the trace is written (for
+  /// names of objects that may be destroyed earlier, e.g. thread groups).
+  const char *intern(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return names.insert(name).first->c_str();
+  }
+
+  void write_chrome_trace(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+      std::perror(("Could not write trace " + path).c_str());
+      return;
+    }
+
+    uint32_t cpu;
+    const uint64_t end_tsc = read_tsc(cpu);
+    const double elapsed_us =
+        std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start_time)
+            .count();
+    const double ticks_per_us =
+        elapsed_us > 0 ? (end_tsc - start_tsc) / elapsed_us : 1.0;
+
+    std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto &buffer : buffers) {
+      std::fprintf(file,
+                   "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                   "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                   first ? "" : ",\n", buffer->tid,
+                   _escape(buffer->name).c_str());
+      first = false;
+
+      const uint64_t head = buffer->head.load(std::memory_order_acquire);
+      const uint64_t count = std::min<uint64_t>(head, TraceBuffer::capacity);
+      for (uint64_t i = head - count; i < head; ++i) {
+        const trace_event &event =
+            buffer->events[i & (TraceBuffer::capacity - 1)];
+        std::fprintf(file,
+                     ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+                     "\"ts\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"arg\":%lu,"
+                     "\"cpu\":%u,\"node\":%d}}",
+                     _escape(event.name).c_str(),
+                     _escape(event.category).c_str(), event.phase,
+                     (event.tsc - start_tsc) / ticks_per_us, buffer->tid,
+                     event.arg, event.cpu, numa_node_of_cpu(event.cpu));
+      }
+    }
+    std::fprintf(file, "\n]}\n");
+    std::fclose(file);
+  }
+
+private:
+  static std::string _escape(const char *str) {
+    std::string result;
+    for (; str != nullptr && *str != '\0'; ++str) {
+      if (*str == '"' || *str == '\\')
+        result += '\\';
+      result += *str;
+    }
+    return result;
+  }
+  static std::string _escape(const std::string &str) {
+    return _escape(str.c_str());
+  }
+};
+
+inline Tracer tracer;
+
+/// @brief Records a begin event at construction and the end event at
+/// destruction.
+class TraceScope {
+private:
+  const char *name;
+  const char *category;
+  uint64_t arg;
+
+public:
+  TraceScope(const char *name, const char *category, uint64_t arg = 0)
+      : name(name), category(category), arg(arg) {
+    tracer.local().record('B', name, category, arg);
+  }
+  ~TraceScope() { tracer.local().record('E', name, category, arg); }
+};
+
+} // namespace tracing
+
+// clang-format off
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACING
+	#define TRACE_BEGIN(name, category, arg) tracing::tracer.local().record('B', name, category, arg);
+	#define TRACE_END(name, category, arg) tracing::tracer.local().record('E', name, category, arg);
+	#define TRACE_SCOPE(name, category, arg) tracing::TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, category, arg);
+	#define TRACE_INTERN(name) tracing::tracer.intern(name)
+	#define TRACE_THREAD_NAME(thread_name) tracing::tracer.local().name = thread_name;
+#else
+	#define TRACE_BEGIN(name, category, arg)
+	#define TRACE_END(name, category, arg)
+	#define TRACE_SCOPE(name, category, arg)
+	#define TRACE_INTERN(name) nullptr
+	#define TRACE_THREAD_NAME(thread_name)
+#endif
+// clang-format on
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <numa.h>
+#include <vector>
 
 #include "vmalloc_defs.hpp"
 
@@ -8,11 +13,29 @@
 
 namespace vampir {
 
+/// @brief Properties of a NUMA node as given by the memory configuration.
+struct NodeInfo {
+  Memory mem_type;
+  /// 0 if unknown (treated as unlimited)
+  std::size_t capacity_bytes = 0;
+  /// sequential read bandwidth in GB/s, 0 if unknown
+  double bandwidth_gbs = 0.0;
+  /// idle load-to-use latency in ns, 0 if unknown
+  double latency_ns = 0.0;
+  /// NUMA nodes with CPUs for which this node is local memory
+  std::vector<NumaId> cpu_nodes;
+
+  bool is_local_to(NumaId cpu_node) const {
+    return std::find(cpu_nodes.begin(), cpu_nodes.end(), cpu_node) !=
+           cpu_nodes.end();
+  }
+};
+
 class MemoryConfig {
 
 private:
-  // mapping from numa node to memory type
-  std::unordered_map<NumaId, Memory> node_memory_map;
+  // mapping from numa node to its properties
+  std::map<NumaId, NodeInfo> node_infos;
 
 public:
   static MemoryConfig load_config(const std::string &path) {
@@ -28,20 +51,36 @@ public:
     return MemoryConfig(json_str);
   }
 
+  /// nodes need "node" and "mem_type"; "capacity_gib", "bandwidth_gbs",
+  /// "latency_ns" and "cpu_nodes" are optional
   MemoryConfig(const std::string &json_str) {
     nlohmann::json json_obj = nlohmann::json::parse(json_str);
     for (auto node : json_obj["nodes"]) {
       NumaId node_id = node["node"];
-      Memory mem_type = memory_from_string(node["mem_type"]);
+      NodeInfo info;
+      info.mem_type = memory_from_string(node["mem_type"]);
+      info.capacity_bytes = static_cast<std::size_t>(
+          node.value("capacity_gib", 0.0) * (1ull << 30));
+      info.bandwidth_gbs = node.value("bandwidth_gbs", 0.0);
+      info.latency_ns = node.value("latency_ns", 0.0);
+      if (node.contains("cpu_nodes")) {
+        for (auto cpu_node : node["cpu_nodes"])
+          info.cpu_nodes.push_back(cpu_node);
+      }
 
-      node_memory_map[node_id] = mem_type;
+      node_infos[node_id] = info;
     }
   }
 
+  const std::map<NumaId, NodeInfo> &get_nodes() const { return node_infos; }
+
+  /// @throws std::out_of_range if node is not configured
+  const NodeInfo &get_node(NumaId node) const { return node_infos.at(node); }
+
   NumaId get_first_node(Memory mem_type) const {
     NumaId min_node = std::numeric_limits<NumaId>::max();
-    for (const auto &[node_id, type] : node_memory_map) {
-      if (type == mem_type) {
+    for (const auto &[node_id, info] : node_infos) {
+      if (info.mem_type == mem_type) {
         min_node = std::min(min_node, node_id);
       }
     }
@@ -53,19 +92,101 @@ public:
   }
 
   NumaId get_first_node() const {
-    if (node_memory_map.empty()) {
+    if (node_infos.empty()) {
       throw std::invalid_argument(
           "No NUMA nodes available in memory configuration");
     }
 
     NumaId min_node = std::numeric_limits<NumaId>::max();
-    for (const auto &[node_id, type] : node_memory_map) {
+    for (const auto &[node_id, info] : node_infos) {
       min_node = std::min(min_node, node_id);
     }
     return min_node;
   }
+
+  /**
+   * @brief Get the node of mem_type with the smallest distance (see
+   * get_distance) to from. Ties are broken by the lower node id.
+   * @throws std::invalid_argument if there is no node of mem_type
+   */
+  NumaId get_nearest_node(Memory mem_type, NumaId from) const {
+    return _get_nearest_node(from, &mem_type);
+  }
+
+  /**
+   * @brief Get the node (of any memory type) nearest to from.
+   */
+  NumaId get_nearest_node(NumaId from) const {
+    return _get_nearest_node(from, nullptr);
+  }
+
+  /**
+   * @brief Distance of memory node to the CPUs of cpu_node: the configured
+   * affinity (cpu_nodes) counts as local, otherwise numa_distance is used.
+   */
+  int get_distance(NumaId cpu_node, NumaId node) const {
+    auto it = node_infos.find(node);
+    if (node == cpu_node ||
+        (it != node_infos.end() && it->second.is_local_to(cpu_node)))
+      return numa_local_distance;
+    // numa_distance returns 0 if it cannot be determined
+    const int distance = numa_distance(cpu_node, node);
+    return distance == 0 ? std::numeric_limits<int>::max() - 1 : distance;
+  }
+
+private:
+  /// distance of local memory in the ACPI SLIT (as returned by numa_distance)
+  static constexpr int numa_local_distance = 10;
+
+  NumaId _get_nearest_node(NumaId from, const Memory *mem_type) const {
+    NumaId nearest = std::numeric_limits<NumaId>::max();
+    int nearest_distance = std::numeric_limits<int>::max();
+    for (const auto &[node_id, info] : node_infos) {
+      if (mem_type != nullptr && info.mem_type != *mem_type)
+        continue;
+      const int distance = get_distance(from, node_id);
+      if (distance < nearest_distance ||
+          (distance == nearest_distance && node_id < nearest)) {
+        nearest = node_id;
+        nearest_distance = distance;
+      }
+    }
+
+    if (nearest != std::numeric_limits<NumaId>::max())
+      return nearest;
+    else
+      throw std::invalid_argument("No NUMA node found for memory type");
+  }
 };
 
+/// @brief Bytes currently allocated per NUMA node (through vmalloc). Is
+/// updated on allocation and by the release hook of the allocation.
+class MemoryUsage {
+private:
+  mutable std::mutex mutex;
+  std::map<NumaId, std::size_t> used_bytes;
+
+public:
+  void add(NumaId node, std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    used_bytes[node] += bytes;
+  }
+
+  void remove(NumaId node, std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &used = used_bytes[node];
+    used -= std::min(used, bytes);
+  }
+
+  std::size_t get(NumaId node) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = used_bytes.find(node);
+    return it == used_bytes.end() ? 0 : it->second;
+  }
+};
+
+MemoryUsage mem_usage;
+
 #if TESTING
   MemoryConfig mem_config =
   MemoryConfig::load_config("code/utils/vmalloc/crobat_testing_config.json");
@@ -5,20 +5,144 @@
 #include <cstdint>
 #include <iostream>
 #include <numa.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
 #include <tuple>
+#include <utility>
 #include <vector>
 
+#include "../allocator.hpp"
 #include "vmalloc_defs.hpp"
 
 namespace vampir {
 
 struct AllocationInfo {
+  /// called once before the memory is freed (e.g. for per-node accounting)
+  using release_hook_t = void (*)(const AllocationInfo &);
+
   NumaId numa_node;
   void *data;
   std::size_t size_bytes; // in bytes
   std::atomic<uint32_t> ref_cnt;
+  /// per-sliver placement as (byte offset, NUMA node) in ascending order;
+  /// empty if the whole allocation is placed on numa_node
+  std::vector<std::pair<std::size_t, NumaId>> placement;
+  release_hook_t release_hook = nullptr;
+  /// frees data instead of munmap/numa_free if set (memory owned by a pool)
+  release_hook_t free_memory = nullptr;
+  /// page type the memory is actually mapped with (hugepage mappings fall
+  /// back to THP if no hugepages are reserved)
+  PageType page_type = K4_Normal;
+  /// size of the mmap'ed region (munmap), 0 if allocated by libnuma
+  std::size_t mapped_bytes = 0;
+  /// access pattern given to vmalloc (STREAM_WRITE selects streaming stores)
+  AccessPattern pattern = AccessPattern::LINEAR;
+  /// bytes at the start that may still hold data of an earlier user (memory
+  /// a VamPool reused without zeroing it, see clear_dirty), 0 if all zero
+  std::size_t dirty_bytes = 0;
+
+  /// @brief Bytes of the allocation per NUMA node part, as (node, bytes).
+  std::vector<std::pair<NumaId, std::size_t>> node_bytes() const {
+    if (placement.empty())
+      return {{numa_node, size_bytes}};
+
+    std::vector<std::pair<NumaId, std::size_t>> result;
+    for (std::size_t i = 0; i < placement.size(); ++i) {
+      const std::size_t begin = std::min(placement[i].first, size_bytes);
+      const std::size_t end = i + 1 < placement.size()
+                                  ? std::min(placement[i + 1].first, size_bytes)
+                                  : size_bytes;
+      result.emplace_back(placement[i].second, end - begin);
+    }
+    return result;
+  }
 };
 
+/// @brief Size of the pages of a mapping of page type ptype.
+inline std::size_t page_size_of(PageType ptype) {
+  switch (ptype) {
+  case M2_HugePages:
+  case Transparent_HugePages:
+    return std::size_t(1) << 21;
+  case G1_HugePages:
+    return std::size_t(1) << 30;
+  default:
+    return numa_pagesize();
+  }
+}
+
+/**
+ * @brief Maps (but does not touch) bytes of anonymous memory with huge
+ * pages. Reserved hugepages (M2/G1) are tried first, THP (2 MiB aligned,
+ * MADV_HUGEPAGE) is the fallback. ptype is set to the page type used.
+ * @return the mapping, nullptr if mmap failed
+ */
+inline void *map_huge_pages(std::size_t bytes, PageType &ptype,
+                            std::size_t &mapped_bytes) {
+  // no MAP_NORESERVE: hugetlb mappings have to fail here (and fall back)
+  // instead of raising SIGBUS on the first touch
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (ptype == M2_HugePages || ptype == G1_HugePages) {
+    const std::size_t page = page_size_of(ptype);
+    mapped_bytes = (bytes + page - 1) / page * page;
+    void *ptr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                     flags | MAP_HUGETLB |
+                         (ptype == M2_HugePages ? MAP_HUGE_2MB
+                                                : MAP_HUGE_1GB),
+                     -1, 0);
+    if (ptr != MAP_FAILED)
+      return ptr;
+    DEBUG_VAMPPH("no reserved hugepages left; falling back to THP");
+  }
+
+  ptype = Transparent_HugePages;
+  const std::size_t page = page_size_of(ptype);
+  mapped_bytes = (bytes + page - 1) / page * page;
+  // over-allocate by one page to align the mapping at a THP boundary
+  char *raw = static_cast<char *>(mmap(nullptr, mapped_bytes + page,
+                                       PROT_READ | PROT_WRITE, flags, -1, 0));
+  if (raw == MAP_FAILED)
+    return nullptr;
+  char *aligned = reinterpret_cast<char *>(
+      (reinterpret_cast<uintptr_t>(raw) + page - 1) / page * page);
+  if (aligned != raw)
+    munmap(raw, aligned - raw);
+  if (aligned + mapped_bytes != raw + mapped_bytes + page)
+    munmap(aligned + mapped_bytes, raw + page - aligned);
+  madvise(aligned, mapped_bytes, MADV_HUGEPAGE);
+  return aligned;
+}
+
+/**
+ * @brief Drops one reference of an allocation. The last reference runs the
+ * release hook, frees the memory (through free_memory if set, e.g. back into
+ * a VamPool) and deletes info.
+ * @return true if the allocation was freed
+ */
+inline bool release_reference(AllocationInfo *info) {
+  if (info == nullptr || info->ref_cnt.fetch_sub(1) != 1)
+    return false;
+
+  DEBUG_VAMSPLT("freed (really) " << std::dec << info->size_bytes
+                                  << " B on NUMA node " << info->numa_node
+                                  << " at address 0x" << std::hex
+                                  << info->data);
+
+  if (info->release_hook != nullptr)
+    info->release_hook(*info);
+  if (info->free_memory != nullptr) {
+    info->free_memory(*info);
+  } else if (info->data != nullptr) {
+    if (info->mapped_bytes != 0)
+      munmap(info->data, info->mapped_bytes);
+    else
+      numa_free(info->data, info->size_bytes);
+  }
+  delete info;
+  return true;
+}
+
 template <typename base_t, std::size_t segment_size_bytes = 4096>
 class VamPointer {
   // grants access to private members of all VamPointer specializations (for
@@ -52,21 +176,7 @@ private:
                               << " B on NUMA node " << ptr.alloc_info->numa_node
                               << " at address 0x" << std::hex << ptr.start);
 
-    if (ptr.alloc_info != nullptr) {
-      if (ptr.alloc_info->ref_cnt.fetch_sub(1) == 1) {
-
-        DEBUG_VAMSPLT("freed (really) "
-                      << std::dec << ptr.alloc_info->size_bytes
-                      << " B on NUMA node " << ptr.alloc_info->numa_node
-                      << " at address 0x" << std::hex << ptr.alloc_info->data);
-
-        if (ptr.alloc_info->data != nullptr)
-          numa_free(ptr.alloc_info->data, ptr.alloc_info->size_bytes);
-        delete ptr.alloc_info;
-        return true;
-      }
-    }
-    return false;
+    return release_reference(ptr.alloc_info);
   }
 
   template <typename T, std::size_t SSIZE_0>
@@ -76,6 +186,57 @@ private:
     ptr.alloc_info = nullptr;
   }
 
+  /**
+   * @brief Bytes [begin, end) of the pages of sliver i of the placement:
+   * sliver borders are rounded up to pages of page_size (a page shared by two
+   * slivers goes to the earlier one), the last sliver also gets the bytes up
+   * to bound_bytes (the rest of a mapping).
+   */
+  std::pair<std::size_t, std::size_t>
+  _sliver_pages(std::size_t i, std::size_t page_size,
+                std::size_t bound_bytes) const {
+    const auto &placement = alloc_info->placement;
+    const auto round_up = [page_size](std::size_t bytes) {
+      return (bytes + page_size - 1) / page_size * page_size;
+    };
+    const std::size_t begin =
+        round_up(std::min(size_bytes, placement[i].first));
+    const std::size_t end =
+        i + 1 < placement.size()
+            ? round_up(std::min(size_bytes, placement[i + 1].first))
+            : std::max(round_up(size_bytes), bound_bytes);
+    return {begin, std::max(begin, end)};
+  }
+
+  /**
+   * @brief Records the placement of the slivers of split(sliver_nodes.size())
+   * and binds their pages (mbind, see _sliver_pages) to their nodes.
+   */
+  void _place_slivers(const std::vector<NumaId> &sliver_nodes,
+                      std::size_t page_size, std::size_t bound_bytes) {
+    const std::size_t total_segments = segment_count();
+    std::size_t offset_segments = 0;
+    for (std::size_t i = 0; i < sliver_nodes.size(); ++i) {
+      alloc_info->placement.emplace_back(offset_segments * segment_size_bytes,
+                                         sliver_nodes[i]);
+      offset_segments +=
+          sliver_segment_count(i, total_segments, sliver_nodes.size());
+    }
+
+    for (std::size_t i = 0; i < sliver_nodes.size(); ++i) {
+      const auto [page_begin, page_end] =
+          _sliver_pages(i, page_size, bound_bytes);
+      if (page_end > page_begin && start != nullptr)
+        numa_tonode_memory(reinterpret_cast<char *>(start) + page_begin,
+                           page_end - page_begin, sliver_nodes[i]);
+
+      DEBUG_VAMPPH("placed sliver " << std::dec << i << " ("
+                                    << alloc_info->placement[i].first
+                                    << " B offset) on NUMA node "
+                                    << sliver_nodes[i]);
+    }
+  }
+
   template <typename new_base_t>
   VamPointer<new_base_t, segment_size_bytes> _cast() const {
     VamPointer<new_base_t, segment_size_bytes> new_ptr;
@@ -104,13 +265,27 @@ public:
    *
    * @param size - size in **number of base_t elements**
    * @param numa_node - NUMA node to allocate memory on
+   * @param ptype - page type, hugepage types are mapped with mmap and bound
+   * to numa_node (mbind)
    */
-  VamPointer(std::size_t size, NumaId numa_node)
+  VamPointer(std::size_t size, NumaId numa_node,
+             PageType ptype = K4_Normal)
       : size_bytes(size * sizeof(base_t)) {
-    void *raw_ptr = numa_alloc_onnode(size_bytes, numa_node);
+    std::size_t mapped_bytes = 0;
+    void *raw_ptr = nullptr;
+    if (ptype == K4_Normal) {
+      raw_ptr = numa_alloc_onnode(size_bytes, numa_node);
+    } else if (size_bytes > 0) {
+      // bind before the first touch, so all pages are faulted in on the node
+      raw_ptr = map_huge_pages(size_bytes, ptype, mapped_bytes);
+      if (raw_ptr != nullptr)
+        numa_tonode_memory(raw_ptr, mapped_bytes, numa_node);
+    }
 
     alloc_info = new AllocationInfo{numa_node, raw_ptr, size_bytes,
                                     std::atomic<uint32_t>(1)};
+    alloc_info->page_type = ptype;
+    alloc_info->mapped_bytes = mapped_bytes;
     start = reinterpret_cast<base_t *>(raw_ptr);
 
     DEBUG_VAMPPH("alloced " << std::dec << size_bytes << " B on NUMA node "
@@ -121,10 +296,135 @@ public:
                  << alloc_info->ref_cnt.load());
   }
 
+  /**
+   * @brief Construct a new Vam Pointer object whose slivers (as returned by
+   * split(sliver_nodes.size())) are placed on different NUMA nodes. The
+   * memory is reserved first and bound per sliver before it is touched, so
+   * every page is faulted in on the node of its sliver. Sliver borders are
+   * rounded up to pages (a page shared by two slivers goes to the earlier
+   * one).
+   *
+   * @param size - size in **number of base_t elements**
+   * @param sliver_nodes - NUMA node of each sliver
+   * @param ptype - page type (sliver borders are rounded to its page size)
+   */
+  VamPointer(std::size_t size, const std::vector<NumaId> &sliver_nodes,
+             PageType ptype = K4_Normal)
+      : size_bytes(size * sizeof(base_t)) {
+    if (sliver_nodes.empty())
+      throw std::invalid_argument(
+          "Error: [VamPointer] sliver placement needs at least one node");
+
+    std::size_t mapped_bytes = 0;
+    void *raw_ptr = nullptr;
+    if (ptype == K4_Normal)
+      raw_ptr = numa_alloc(size_bytes);
+    else if (size_bytes > 0)
+      raw_ptr = map_huge_pages(size_bytes, ptype, mapped_bytes);
+
+    alloc_info = new AllocationInfo{sliver_nodes[0], raw_ptr, size_bytes,
+                                    std::atomic<uint32_t>(1)};
+    alloc_info->page_type = ptype;
+    alloc_info->mapped_bytes = mapped_bytes;
+    start = reinterpret_cast<base_t *>(raw_ptr);
+
+    _place_slivers(sliver_nodes, page_size_of(ptype),
+                   std::max(size_bytes, mapped_bytes));
+
+    DEBUG_VAMPPH("alloced " << std::dec << size_bytes << " B on "
+                            << sliver_nodes.size()
+                            << " NUMA slivers at address 0x" << std::hex
+                            << start);
+  }
+
+  /**
+   * @brief Creates the first VamPointer of an allocation described by info
+   * (which has to hold a reference count of 1), e.g. memory of a VamPool.
+   *
+   * @param info - allocation to take over, freed with the last reference
+   */
+  static this_t adopt(AllocationInfo *info) {
+    this_t ptr;
+    ptr.alloc_info = info;
+    ptr.start = reinterpret_cast<base_t *>(info->data);
+    ptr.size_bytes = info->size_bytes;
+    return ptr;
+  }
+
+  /**
+   * @brief Maps size elements of file fd starting at offset (zero copy,
+   * MAP_PRIVATE: writes stay in memory) with the slivers of
+   * split(sliver_nodes.size()) bound to their nodes like the sliver
+   * constructor. The file is unmapped with the last reference, fd may be
+   * closed right away.
+   *
+   * mbind only places the pages allocated for the mapping. Pages of the file
+   * are page cache pages, allocated by the task policy of whoever reads them
+   * first, so with populate every sliver is read in here with its node as
+   * preferred node of the calling thread (MADV_POPULATE_READ, which faults
+   * in without copying); pages already cached stay where they are.
+   *
+   * @param offset - byte offset in the file, multiple of the page size
+   * @param size - size in **number of base_t elements** (the file has to hold
+   * them up to the next page)
+   * @throws std::runtime_error if the file cannot be mapped
+   */
+  static this_t map_file(int fd, std::size_t offset, std::size_t size,
+                         const std::vector<NumaId> &sliver_nodes,
+                         bool populate) {
+    if (sliver_nodes.empty())
+      throw std::invalid_argument(
+          "Error: [VamPointer] sliver placement needs at least one node");
+    if (size == 0)
+      return this_t();
+
+    const std::size_t page_size = page_size_of(K4_Normal);
+    const std::size_t size_bytes = size * sizeof(base_t);
+    const std::size_t mapped_bytes =
+        (size_bytes + page_size - 1) / page_size * page_size;
+    void *raw_ptr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, offset);
+    if (raw_ptr == MAP_FAILED)
+      throw std::runtime_error("Error: [VamPointer] could not map " +
+                               std::to_string(mapped_bytes) + " B of file");
+
+    this_t ptr = adopt(new AllocationInfo{sliver_nodes[0], raw_ptr,
+                                          size_bytes, std::atomic<uint32_t>(1)});
+    ptr.alloc_info->mapped_bytes = mapped_bytes;
+    ptr._place_slivers(sliver_nodes, page_size, mapped_bytes);
+
+    if (populate) {
+      const auto &placement = ptr.alloc_info->placement;
+      for (std::size_t i = 0; i < placement.size(); ++i) {
+        // the pages bound to the sliver
+        const auto [begin, end] =
+            ptr._sliver_pages(i, page_size, mapped_bytes);
+        if (end <= begin)
+          continue;
+        char *bytes = reinterpret_cast<char *>(raw_ptr) + begin;
+        numa_set_preferred(placement[i].second);
+#ifdef MADV_POPULATE_READ
+        if (madvise(bytes, end - begin, MADV_POPULATE_READ) != 0)
+#endif
+          for (std::size_t j = 0; j < end - begin; j += page_size)
+            (void)*reinterpret_cast<volatile char *>(bytes + j);
+      }
+      numa_set_localalloc();
+    }
+
+    DEBUG_VAMPPH("mapped " << std::dec << size_bytes << " B of a file on "
+                           << sliver_nodes.size()
+                           << " NUMA slivers at address 0x" << std::hex
+                           << ptr.start);
+    return ptr;
+  }
+
   // Copy constructor
   VamPointer(const this_t &other) {
     _copy_attr(other, *this);
-    alloc_info->ref_cnt.fetch_add(1);
+    // empty pointers have no allocation to reference
+    if (alloc_info != nullptr)
+      alloc_info->ref_cnt.fetch_add(1);
 
     DEBUG_VAMPTR("copy constructed ptr at pos 0x"
                  << std::hex << start << "; reference count " << std::dec
@@ -155,10 +455,9 @@ public:
                  << std::hex << start << "; reference count " << std::dec
                  << ref_cnt->load() - 1);
 
-    if (alloc_info->ref_cnt.fetch_sub(1) == 1) {
-      if (_free_ptr(*this))
-        _unset_attr(*this);
-    }
+    // _free_ptr drops the reference (and frees on the last one)
+    _free_ptr(*this);
+    _unset_attr(*this);
   }
 
   // ------------------------
@@ -173,7 +472,8 @@ public:
       // clean up previously held data)
       _free_ptr(*this);
       _copy_attr(other, *this);
-      alloc_info->ref_cnt.fetch_add(1);
+      if (alloc_info != nullptr)
+        alloc_info->ref_cnt.fetch_add(1);
     }
     DEBUG_VAMPTR("copy assigned    ptr at pos 0x"
                  << std::hex << start << "; reference count " << std::dec
@@ -225,13 +525,10 @@ public:
     std::vector<this_t> slivers;
     slivers.reserve(sliver_count);
 
-    size_t sliver_segments = segment_count() / sliver_count;
-    size_t remainder = segment_count() % sliver_count;
-
     size_t offset = 0;
     for (size_t i = 0; i < sliver_count; ++i) {
       size_t sliver_segment_count =
-          sliver_segments + (i < remainder ? 1 : 0); // distribute remainder
+          this_t::sliver_segment_count(i, segment_count(), sliver_count);
 
       slivers.emplace_back(*this);
       slivers.back().start =
@@ -250,10 +547,56 @@ public:
     return slivers;
   }
 
+  /**
+   * @brief Number of segments of the sliver_index-th of sliver_count slivers
+   * (the remainder is distributed over the first slivers). Is shared by split
+   * and the per-sliver placement, so placed slivers and split slivers match.
+   */
+  static std::size_t sliver_segment_count(std::size_t sliver_index,
+                                          std::size_t segment_count,
+                                          std::size_t sliver_count) {
+    return segment_count / sliver_count +
+           (sliver_index < segment_count % sliver_count ? 1 : 0);
+  }
+
   // -----------------
   // --- ACCESSORS ---
   // -----------------
 
+  /**
+   * @brief Get the allocation info shared by all VamPointers of one
+   * allocation (nullptr for an empty VamPointer).
+   */
+  AllocationInfo *allocation_info() const { return alloc_info; }
+
+  /**
+   * @brief Get the access pattern the memory was allocated for (LINEAR for an
+   * empty VamPointer).
+   */
+  AccessPattern access_pattern() const {
+    return alloc_info == nullptr ? AccessPattern::LINEAR : alloc_info->pattern;
+  }
+
+  /**
+   * @brief Get the NUMA node the memory at the start of this (sliver of a)
+   * VamPointer is placed on.
+   * @return NumaId NUMA node, -1 for an empty VamPointer.
+   */
+  NumaId numa_node() const {
+    if (alloc_info == nullptr)
+      return -1;
+
+    NumaId node = alloc_info->numa_node;
+    const std::size_t offset = reinterpret_cast<const char *>(start) -
+                               reinterpret_cast<const char *>(alloc_info->data);
+    for (const auto &[sliver_offset, sliver_node] : alloc_info->placement) {
+      if (sliver_offset > offset)
+        break;
+      node = sliver_node;
+    }
+    return node;
+  }
+
   /**
    * @brief Overloaded subscript operator for element access.
    * @param index The index of the element to access.
@@ -299,9 +642,10 @@ public:
     size_bytes = new_size * sizeof(base_t);
   }
 
-  // here prefech?
   /**
-   * @brief Get the segment at the specified segment index.
+   * @brief Get the segment at the specified segment index (checked; loops
+   * over all segments use lockstep, see segment_range.hpp, which also
+   * prefetches).
    *
    * @param index The index of the segment to retrieve.
    * @return std::tuple<base_t *, std::size_t> A tuple containing a pointer to
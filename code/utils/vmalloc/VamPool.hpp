@@ -0,0 +1,238 @@
+#pragma once
+
+#include <bit>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numa.h>
+#include <sys/mman.h>
+#include <tuple>
+#include <vector>
+
+#include "VamPointer.hpp"
+#include "vmalloc_defs.hpp"
+
+namespace vampir {
+
+/**
+ * @brief Per NUMA node pool of mapped (and already faulted) memory regions.
+ * Regions are kept in power-of-two size classes per (node, page type) and
+ * handed out again instead of being unmapped, so repeated allocations of the
+ * same sizes (e.g. the intermediates of a query run in a loop) cause neither
+ * mmap/munmap nor page faults. Memory is zeroed on reuse, like fresh memory,
+ * unless the caller opts out (zero_on_reuse): intermediates that are fully
+ * overwritten skip the zeroing, large ones that need zeroed memory clear it
+ * per sliver on the threads that use it (see clear_dirty).
+ *
+ * Only single-node allocations are pooled (no per-sliver placement).
+ */
+class VamPool {
+private:
+  struct Region {
+    void *data;
+    std::size_t mapped_bytes;
+    /// bytes that may have been written since the region was mapped
+    std::size_t dirty_bytes;
+    PageType page_type;
+  };
+
+  /// (node, requested page type, size class) -> free regions
+  using pool_key_t = std::tuple<NumaId, PageType, std::size_t>;
+
+  std::mutex mutex;
+  std::map<pool_key_t, std::vector<Region>> free_regions;
+  /// pool key and dirty_bytes of the regions currently handed out
+  std::map<void *, std::pair<pool_key_t, std::size_t>> used_regions;
+  std::size_t cached_bytes = 0;
+
+public:
+  /// the smallest size class (smaller allocations share its regions)
+  static constexpr std::size_t min_class_bytes = std::size_t(1) << 16;
+  /// cached regions beyond this limit are unmapped on release
+  std::size_t max_cached_bytes = std::size_t(16) << 30;
+
+  VamPool() = default;
+  VamPool(const VamPool &) = delete;
+  ~VamPool() { trim(); }
+
+  static std::size_t size_class(std::size_t bytes) {
+    return std::bit_ceil(std::max(bytes, min_class_bytes));
+  }
+
+  /**
+   * @brief Allocates size_bytes on node, reusing a cached region of the same
+   * size class if possible.
+   * @param zero_on_reuse zero the part of a reused region written by earlier
+   * users (serially, on this thread); if false it is left as is and recorded
+   * in the dirty_bytes of the AllocationInfo
+   * @return a new AllocationInfo (reference count 1) whose memory returns to
+   * this pool with the last reference, nullptr data if mapping failed
+   */
+  AllocationInfo *allocate(std::size_t size_bytes, NumaId node,
+                           PageType ptype, bool zero_on_reuse = true) {
+    const std::size_t class_bytes = size_class(size_bytes);
+    const pool_key_t key{node, ptype, class_bytes};
+
+    Region region{nullptr, 0, 0, ptype};
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = free_regions.find(key);
+      if (it != free_regions.end() && !it->second.empty()) {
+        region = it->second.back();
+        it->second.pop_back();
+        cached_bytes -= region.mapped_bytes;
+      }
+    }
+
+    // only the part written by earlier users is not zero anymore
+    std::size_t dirty_bytes = 0;
+    if (region.data == nullptr) {
+      region.page_type = ptype;
+      region.data = _map(class_bytes, node, region.page_type,
+                         region.mapped_bytes);
+      DEBUG_VAMPPH("pool: mapped " << std::dec << region.mapped_bytes
+                                   << " B on NUMA node " << node);
+    } else {
+      dirty_bytes = std::min(region.dirty_bytes, size_bytes);
+      if (zero_on_reuse) {
+        std::memset(region.data, 0, dirty_bytes);
+        dirty_bytes = 0;
+      }
+      DEBUG_VAMPPH("pool: reused " << std::dec << region.mapped_bytes
+                                   << " B on NUMA node " << node);
+    }
+
+    AllocationInfo *info = new AllocationInfo{node, region.data, size_bytes,
+                                              std::atomic<uint32_t>(1)};
+    info->page_type = region.page_type;
+    info->mapped_bytes = region.mapped_bytes;
+    info->free_memory = release_to_global_pool;
+    if (region.data == nullptr)
+      return info;
+    info->dirty_bytes = dirty_bytes;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      used_regions[region.data] = {key,
+                                   std::max(region.dirty_bytes, size_bytes)};
+    }
+    return info;
+  }
+
+  /// @brief Takes back the memory of info (called with its last reference).
+  void release(const AllocationInfo &info) {
+    if (info.data == nullptr)
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto used = used_regions.find(info.data);
+    if (used == used_regions.end())
+      return;
+    const auto [key, dirty_bytes] = used->second;
+    used_regions.erase(used);
+
+    if (cached_bytes + info.mapped_bytes > max_cached_bytes) {
+      munmap(info.data, info.mapped_bytes);
+      return;
+    }
+    free_regions[key].push_back(
+        {info.data, info.mapped_bytes, dirty_bytes, info.page_type});
+    cached_bytes += info.mapped_bytes;
+  }
+
+  /// @brief Unmaps all cached regions (regions in use are not affected).
+  void trim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &[key, regions] : free_regions) {
+      for (auto &region : regions)
+        munmap(region.data, region.mapped_bytes);
+    }
+    free_regions.clear();
+    cached_bytes = 0;
+  }
+
+  std::size_t get_cached_bytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cached_bytes;
+  }
+
+private:
+  static void release_to_global_pool(const AllocationInfo &info);
+
+  /// @brief Maps class_bytes bound to node (not touched yet).
+  static void *_map(std::size_t class_bytes, NumaId node, PageType &ptype,
+                    std::size_t &mapped_bytes) {
+    void *data = nullptr;
+    if (ptype == K4_Normal) {
+      mapped_bytes = class_bytes;
+      data = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (data == MAP_FAILED)
+        data = nullptr;
+    } else {
+      data = map_huge_pages(class_bytes, ptype, mapped_bytes);
+    }
+    if (data != nullptr)
+      numa_tonode_memory(data, mapped_bytes, node);
+    return data;
+  }
+};
+
+/// the pool behind vmalloc while a VamArena is active
+VamPool vam_pool;
+
+inline void VamPool::release_to_global_pool(const AllocationInfo &info) {
+  vam_pool.release(info);
+}
+
+/**
+ * @brief Scoped arena: while it exists, vmalloc (single node variants) serves
+ * allocations from vam_pool. The arena holds one reference to each of its
+ * allocations and drops them all at once when it is destroyed; the memory
+ * returns to the pool as soon as no other VamPointer references it.
+ *
+ * Arenas nest (the innermost one is active) and are bound to the thread that
+ * created them.
+ */
+class VamArena {
+private:
+  static inline thread_local VamArena *active = nullptr;
+
+  VamArena *outer;
+  std::vector<AllocationInfo *> allocations;
+
+public:
+  VamArena() : outer(active) { active = this; }
+  VamArena(const VamArena &) = delete;
+
+  ~VamArena() {
+    release();
+    active = outer;
+  }
+
+  /// @return the innermost arena of this thread, nullptr if there is none
+  static VamArena *current() { return active; }
+
+  /// @brief Allocates from vam_pool and keeps a reference in the arena (see
+  /// VamPool::allocate for zero_on_reuse).
+  template <typename base_t, std::size_t segment_size_bytes>
+  VamPointer<base_t, segment_size_bytes>
+  allocate(std::size_t size_elem, NumaId node, PageType ptype,
+           bool zero_on_reuse = true) {
+    AllocationInfo *info = vam_pool.allocate(size_elem * sizeof(base_t), node,
+                                             ptype, zero_on_reuse);
+    auto ptr = VamPointer<base_t, segment_size_bytes>::adopt(info);
+    info->ref_cnt.fetch_add(1); // reference of the arena
+    allocations.push_back(info);
+    return ptr;
+  }
+
+  /// @brief Drops the arena's references of all its allocations.
+  void release() {
+    for (AllocationInfo *info : allocations)
+      release_reference(info);
+    allocations.clear();
+  }
+};
+
+} // namespace vampir
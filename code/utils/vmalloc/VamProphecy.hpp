@@ -1,5 +1,7 @@
 #pragma once
 
+#include <numa.h>
+
 #include "MemoryConfig.hpp"
 
 #include "vmalloc_defs.hpp"
@@ -10,19 +12,119 @@ class VamProphecy {
 
 public:
   // #### MODIFY: change prediction algorithm and interface
-  static NumaId predict(AccessPattern pattern) {
-    if (pattern == AccessPattern::LINEAR) {
-      try {
-        return mem_config.get_first_node(Memory::HBM);
-      } catch (const std::invalid_argument &e) {
-        // Fallback to any if no HBM node is available
-        return mem_config.get_first_node();
-      }
+  /**
+   * @brief Predicts the node for an allocation of size_bytes without a known
+   * consumer: LINEAR allocations are balanced over the HBM nodes, RANDOM ones
+   * go to the DRAM node with the lowest latency. Spills to the other memory
+   * type when no node of the preferred type has capacity left.
+   */
+  static NumaId predict(AccessPattern pattern, std::size_t size_bytes = 0) {
+    return _predict(pattern, size_bytes, -1);
+  }
+
+  /**
+   * @brief Predicts the node for memory that is processed by the thread
+   * pinned to cpu. Like predict(pattern, size_bytes), but only the nodes
+   * nearest to the NUMA node of cpu (configured cpu_nodes or numa_distance)
+   * are candidates.
+   */
+  static NumaId predict(AccessPattern pattern, int cpu,
+                        std::size_t size_bytes) {
+    return _predict(pattern, size_bytes, numa_node_of_cpu(cpu));
+  }
+
+  /**
+   * @brief Like predict(pattern, cpu, size_bytes), but with the memory type
+   * given instead of derived from the pattern (e.g. to compare HBM and DRAM
+   * placement). Still spills to the other type when preferred is full.
+   */
+  static NumaId predict(Memory preferred, AccessPattern pattern, int cpu,
+                        std::size_t size_bytes) {
+    return _predict(preferred, pattern, size_bytes, numa_node_of_cpu(cpu));
+  }
+  // #### end MODIFY
+
+private:
+  static bool _fits(NumaId node, const NodeInfo &info,
+                    std::size_t size_bytes) {
+    // unknown capacity -> assume it fits
+    return info.capacity_bytes == 0 ||
+           mem_usage.get(node) + size_bytes <= info.capacity_bytes;
+  }
+
+  /// @brief Cost model for placing size_bytes on node (lower is better,
+  /// compared lexicographically).
+  static std::pair<double, double> _cost(AccessPattern pattern, NumaId node,
+                                         const NodeInfo &info,
+                                         std::size_t size_bytes) {
+    const double used = mem_usage.get(node) + size_bytes;
+    if (pattern != AccessPattern::RANDOM) {
+      // time to stream everything placed on the node, assuming it is all
+      // scanned concurrently -> spreads scans over the nodes' bandwidth
+      return {used / (info.bandwidth_gbs > 0 ? info.bandwidth_gbs : 1.0), 0.0};
     } else {
-      return mem_config.get_first_node(Memory::DRAM);
+      // latency first, usage only breaks ties
+      return {info.latency_ns, used};
+    }
+  }
+
+  /// @return best fitting node of mem_type, -1 if there is none
+  static NumaId _select(Memory mem_type, AccessPattern pattern,
+                        std::size_t size_bytes, NumaId cpu_node) {
+    int nearest_distance = std::numeric_limits<int>::max();
+    if (cpu_node >= 0) {
+      for (const auto &[node, info] : mem_config.get_nodes()) {
+        if (info.mem_type == mem_type && _fits(node, info, size_bytes))
+          nearest_distance = std::min(nearest_distance,
+                                      mem_config.get_distance(cpu_node, node));
+      }
+    }
+
+    NumaId best = -1;
+    std::pair<double, double> best_cost{std::numeric_limits<double>::max(),
+                                        std::numeric_limits<double>::max()};
+    for (const auto &[node, info] : mem_config.get_nodes()) {
+      if (info.mem_type != mem_type || !_fits(node, info, size_bytes))
+        continue;
+      if (cpu_node >= 0 &&
+          mem_config.get_distance(cpu_node, node) != nearest_distance)
+        continue;
+
+      const auto cost = _cost(pattern, node, info, size_bytes);
+      if (cost < best_cost) {
+        best = node;
+        best_cost = cost;
+      }
+    }
+    return best;
+  }
+
+  static NumaId _predict(AccessPattern pattern, std::size_t size_bytes,
+                         NumaId cpu_node) {
+    const Memory preferred =
+        pattern != AccessPattern::RANDOM ? Memory::HBM : Memory::DRAM;
+    return _predict(preferred, pattern, size_bytes, cpu_node);
+  }
+
+  static NumaId _predict(Memory preferred, AccessPattern pattern,
+                         std::size_t size_bytes, NumaId cpu_node) {
+    const Memory spill =
+        preferred == Memory::HBM ? Memory::DRAM : Memory::HBM;
+
+    NumaId node = _select(preferred, pattern, size_bytes, cpu_node);
+    if (node < 0)
+      node = _select(spill, pattern, size_bytes, cpu_node);
+    if (node >= 0)
+      return node;
+
+    // no capacity left anywhere -> the allocation will likely fail, keep the
+    // static choice
+    try {
+      return mem_config.get_first_node(preferred);
+    } catch (const std::invalid_argument &e) {
+      return mem_config.get_first_node();
     }
   }
-  // #### end MODIFY
 };
 
 } // namespace vampir
@@ -0,0 +1,211 @@
+/**
+ * @file column_file.hpp
+ * @brief On-disk format of a VamPointer column, loaded without copying: the
+ * file is a header, the statistics (min, max, rows) of every segment and the
+ * values, starting at a page boundary and padded to whole segments and
+ * pages. map_column maps the values into a VamPointer whose slivers are
+ * bound to their NUMA nodes, the VamPointer unmaps the file with its last
+ * reference.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+#include "VamPointer.hpp"
+#include "vmalloc.hpp"
+
+namespace vampir {
+
+constexpr char column_file_magic[8] = {'V', 'A', 'M', 'C', 'O', 'L', '\0',
+                                       '\0'};
+constexpr uint32_t column_file_version = 1;
+/// the values start at a multiple of this (mmap offsets are page aligned)
+constexpr std::size_t column_file_alignment = 4096;
+
+/// @brief Type of the values of a column file: signedness and size.
+template <typename T> constexpr uint32_t column_type_code() {
+  static_assert(std::is_integral_v<T>, "column files store integral values");
+  return (std::is_signed_v<T> ? 0x100 : 0) | sizeof(T);
+}
+
+struct column_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t type_code;
+  uint64_t segment_size_bytes;
+  /// values of the column (the file holds segment_count whole segments)
+  uint64_t count;
+  uint64_t segment_count;
+  /// byte offsets of the segment statistics and of the values
+  uint64_t stats_offset;
+  uint64_t data_offset;
+};
+
+/// @brief Minimum and maximum of the values of one segment (converted to
+/// int64_t), rows = 0 for the empty segments past count.
+struct column_segment_stats {
+  int64_t min;
+  int64_t max;
+  uint64_t rows;
+};
+
+/**
+ * @brief Writes the first count values of column to path (see file comment).
+ * @throws std::runtime_error if the file cannot be written
+ */
+template <typename T, std::size_t S>
+void write_column(const std::string &path, const VamPointer<T, S> &column,
+                  std::size_t count) {
+  static_assert(S % sizeof(T) == 0, "segments have to hold whole values");
+  constexpr std::size_t segment_rows = S / sizeof(T);
+  count = std::min(count, column.size());
+  const T *values = count > 0 ? column.data(0) : nullptr;
+
+  column_file_header header{};
+  std::memcpy(header.magic, column_file_magic, sizeof(header.magic));
+  header.version = column_file_version;
+  header.type_code = column_type_code<T>();
+  header.segment_size_bytes = S;
+  header.count = count;
+  header.segment_count = (count + segment_rows - 1) / segment_rows;
+  header.stats_offset = sizeof(column_file_header);
+  const std::size_t data_offset =
+      header.stats_offset + header.segment_count * sizeof(column_segment_stats);
+  header.data_offset = (data_offset + column_file_alignment - 1) /
+                       column_file_alignment * column_file_alignment;
+
+  std::vector<column_segment_stats> stats(header.segment_count);
+  for (std::size_t i = 0; i < stats.size(); i++) {
+    const T *segment = values + i * segment_rows;
+    const std::size_t rows = std::min(segment_rows, count - i * segment_rows);
+    const auto [min, max] = std::minmax_element(segment, segment + rows);
+    stats[i] = {static_cast<int64_t>(*min), static_cast<int64_t>(*max), rows};
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file)
+    throw std::runtime_error("Could not write column file " + path);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(stats.data()),
+             stats.size() * sizeof(column_segment_stats));
+  const std::vector<char> zeros(std::max(S, column_file_alignment), 0);
+  file.write(zeros.data(), header.data_offset - data_offset);
+  file.write(reinterpret_cast<const char *>(values), count * sizeof(T));
+  // pad to whole segments and pages, so every segment (and the mapping of
+  // its last page) lies within the file
+  const std::size_t data_bytes = header.segment_count * S;
+  const std::size_t padded_bytes = (data_bytes + column_file_alignment - 1) /
+                                   column_file_alignment *
+                                   column_file_alignment;
+  for (std::size_t left = padded_bytes - count * sizeof(T); left > 0;) {
+    const std::size_t chunk = std::min(left, zeros.size());
+    file.write(zeros.data(), chunk);
+    left -= chunk;
+  }
+  if (!file)
+    throw std::runtime_error("Could not write column file " + path);
+}
+
+/**
+ * @brief Reads and checks the header of a column file.
+ * @throws std::runtime_error if the file cannot be read or is no column file
+ * of this version
+ */
+inline column_file_header read_column_header(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  column_file_header header{};
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    throw std::runtime_error("Could not read column file " + path);
+  if (std::memcmp(header.magic, column_file_magic, sizeof(header.magic)) != 0)
+    throw std::runtime_error(path + " is no column file");
+  if (header.version != column_file_version)
+    throw std::runtime_error(path + " has column file version " +
+                             std::to_string(header.version) + ", expected " +
+                             std::to_string(column_file_version));
+  return header;
+}
+
+/**
+ * @brief Reads the statistics of every segment of a column file.
+ * @throws std::runtime_error if the file cannot be read
+ */
+inline std::vector<column_segment_stats>
+read_segment_stats(const std::string &path) {
+  const column_file_header header = read_column_header(path);
+  std::vector<column_segment_stats> stats(header.segment_count);
+  std::ifstream file(path, std::ios::binary);
+  file.seekg(header.stats_offset);
+  if (!file.read(reinterpret_cast<char *>(stats.data()),
+                 stats.size() * sizeof(column_segment_stats)))
+    throw std::runtime_error("Could not read the segment statistics of " +
+                             path);
+  return stats;
+}
+
+/**
+ * @brief Maps the values of a column file into a VamPointer (see
+ * VamPointer::map_file), sliver i of split(sliver_nodes.size()) bound to
+ * sliver_nodes[i].
+ * @param populate read all pages in now, on the nodes of their slivers
+ * @throws std::invalid_argument if the file holds another value type or
+ * segment size than VamPointer<T, S>
+ * @throws std::runtime_error if the file cannot be read or mapped
+ */
+template <typename T, std::size_t S>
+VamPointer<T, S> map_column(const std::string &path,
+                            const std::vector<NumaId> &sliver_nodes,
+                            bool populate) {
+  const column_file_header header = read_column_header(path);
+  if (header.type_code != column_type_code<T>() ||
+      header.segment_size_bytes != S)
+    throw std::invalid_argument(
+        path + " holds values of type " + std::to_string(header.type_code) +
+        " in segments of " + std::to_string(header.segment_size_bytes) +
+        " B, expected type " + std::to_string(column_type_code<T>()) +
+        " in segments of " + std::to_string(S) + " B");
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Could not open column file " + path);
+  try {
+    auto column = VamPointer<T, S>::map_file(fd, header.data_offset,
+                                             header.count, sliver_nodes,
+                                             populate);
+    close(fd);
+    return column;
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+}
+
+/**
+ * @brief Maps a column file like vmalloc places a new column: sliver i is
+ * bound to the node predicted for access pattern from CPU sliver_cpus[i] and
+ * the column is accounted in mem_usage.
+ */
+template <typename T, std::size_t S>
+VamPointer<T, S> vmap(const std::string &path, AccessPattern pattern,
+                      const std::vector<int> &sliver_cpus, bool populate,
+                      std::optional<Memory> preferred = std::nullopt) {
+  const column_file_header header = read_column_header(path);
+  const std::vector<NumaId> sliver_nodes = predict_sliver_nodes(
+      header.count * sizeof(T), pattern, sliver_cpus, preferred);
+  DEBUG_VAMPPH("vmap: access pattern " << access_pattern_to_string(pattern)
+                                       << "; mapping " << path << " on "
+                                       << sliver_nodes.size() << " slivers");
+  return account(map_column<T, S>(path, sliver_nodes, populate));
+}
+
+} // namespace vampir
@@ -0,0 +1,203 @@
+/**
+ * @file segment_range.hpp
+ * @brief Lockstep iteration over the segments of several VamPointers: segment
+ * i of every column is computed from its start and size without the checks of
+ * VamPointer::get_segment (the columns are checked once, when the range is
+ * created), and the segments segment_prefetch_distance ahead are prefetched.
+ *
+ *   for (auto [i, a, b, res] : lockstep(col_a, col_b, result))
+ *     multiplier(res.data, a.data, a.size, b.data);
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "VamPointer.hpp"
+
+namespace vampir {
+
+/// @brief Segments a range prefetches ahead of the one being processed (0 to
+/// disable), default of all ranges created afterwards (PREFETCH_DISTANCE).
+inline std::size_t segment_prefetch_distance = 4;
+
+constexpr std::size_t prefetch_line_bytes = 64;
+
+/// @brief One segment of a column: size elements at data.
+template <typename T> struct segment {
+  T *data;
+  std::size_t size;
+};
+
+/**
+ * @brief Start and size of a column iterated by a SegmentRange.
+ * @tparam ROWS elements per segment
+ * @tparam PREFETCH whether the range prefetches the segments ahead (columns
+ * accessed randomly are prefetched by the kernel, see prefetch_gather)
+ */
+template <typename T, std::size_t ROWS, bool PREFETCH = true>
+struct segment_column {
+  T *start = nullptr;
+  std::size_t size = 0;
+
+  std::size_t segment_count() const { return (size + ROWS - 1) / ROWS; }
+
+  /// @brief Segment i, i < segment_count() (not checked).
+  segment<T> at(std::size_t i) const {
+    const std::size_t offset = i * ROWS;
+    return {start + offset, std::min(ROWS, size - offset)};
+  }
+
+  void prefetch(std::size_t i) const {
+    if constexpr (PREFETCH) {
+      const char *bytes = reinterpret_cast<const char *>(start + i * ROWS);
+      for (std::size_t offset = 0; offset < ROWS * sizeof(T);
+           offset += prefetch_line_bytes)
+        __builtin_prefetch(bytes + offset);
+    }
+  }
+};
+
+template <typename T, std::size_t S>
+segment_column<T, S / sizeof(T)> column_of(const VamPointer<T, S> &column) {
+  return {column.size() > 0 ? column.data(0) : nullptr, column.size()};
+}
+
+template <typename T, std::size_t ROWS, bool PREFETCH>
+segment_column<T, ROWS, PREFETCH>
+column_of(const segment_column<T, ROWS, PREFETCH> &column) {
+  return column;
+}
+
+/// @brief column in a lockstep range without prefetching its segments
+/// ahead, e.g. the data of a gather (see prefetch_gather) or a column written
+/// with streaming stores.
+template <typename T, std::size_t S>
+segment_column<T, S / sizeof(T), false>
+no_prefetch(const VamPointer<T, S> &column) {
+  return {column.size() > 0 ? column.data(0) : nullptr, column.size()};
+}
+
+/// @brief Prefetches the cache lines of data read by a gather of the count
+/// ascending positions (each line once).
+template <typename T, typename I>
+void prefetch_gather(const T *data, const I *positions, std::size_t count) {
+  const char *last_line = nullptr;
+  for (std::size_t j = 0; j < count; j++) {
+    const char *line = reinterpret_cast<const char *>(
+        reinterpret_cast<uintptr_t>(data + positions[j]) &
+        ~uintptr_t(prefetch_line_bytes - 1));
+    if (line != last_line)
+      __builtin_prefetch(line);
+    last_line = line;
+  }
+}
+
+/**
+ * @brief Segment i of all columns at once, for i below the segment count of
+ * the first column (see lockstep).
+ */
+template <typename... Columns> class SegmentRange {
+private:
+  std::tuple<Columns...> columns;
+  std::size_t count;
+  std::size_t distance;
+
+  void _prefetch(std::size_t i) const {
+    if (i < count)
+      std::apply([i](const auto &...column) { (column.prefetch(i), ...); },
+                 columns);
+  }
+
+  template <typename Column>
+  void _check(const Column &column, std::size_t k) const {
+    if (column.segment_count() < count)
+      throw std::out_of_range("Error: [SegmentRange] column " +
+                              std::to_string(k) + " has " +
+                              std::to_string(column.segment_count()) +
+                              " segments, the range " + std::to_string(count));
+  }
+
+public:
+  /// @throws std::out_of_range if a column has fewer segments than the first
+  explicit SegmentRange(Columns... columns)
+      : columns(columns...), count(std::get<0>(this->columns).segment_count()),
+        distance(segment_prefetch_distance) {
+    std::apply(
+        [this](const auto &...column) {
+          std::size_t k = 0;
+          (_check(column, k++), ...);
+        },
+        this->columns);
+  }
+
+  /// @brief The same range prefetching distance segments ahead.
+  SegmentRange with_prefetch_distance(std::size_t distance) const {
+    SegmentRange range = *this;
+    range.distance = distance;
+    return range;
+  }
+
+  std::size_t size() const { return count; }
+
+  std::size_t prefetch_distance() const { return distance; }
+
+  /// @brief Segment i of column K (e.g. to prefetch a gather of a later
+  /// segment).
+  template <std::size_t K> auto column(std::size_t i) const {
+    return std::get<K>(columns).at(i);
+  }
+
+  class iterator {
+  private:
+    const SegmentRange *range;
+    std::size_t i;
+
+  public:
+    iterator(const SegmentRange *range, std::size_t i) : range(range), i(i) {}
+
+    /// @brief (i, segment i of every column)
+    auto operator*() const {
+      return std::apply(
+          [this](const auto &...column) {
+            return std::tuple(i, column.at(i)...);
+          },
+          range->columns);
+    }
+
+    iterator &operator++() {
+      ++i;
+      if (range->distance > 0)
+        range->_prefetch(i + range->distance);
+      return *this;
+    }
+
+    bool operator!=(const iterator &other) const { return i != other.i; }
+  };
+
+  /// @brief Also prefetches the first distance segments after segment 0.
+  iterator begin() const {
+    for (std::size_t i = 1; i <= distance; i++)
+      _prefetch(i);
+    return iterator(this, 0);
+  }
+
+  iterator end() const { return iterator(this, count); }
+};
+
+/**
+ * @brief Iterates the segments of the first column and the segments with the
+ * same index of the other columns (VamPointers or segment_columns, e.g.
+ * no_prefetch(column)).
+ */
+template <typename... Pointers> auto lockstep(const Pointers &...columns) {
+  return SegmentRange<decltype(column_of(columns))...>(column_of(columns)...);
+}
+
+} // namespace vampir
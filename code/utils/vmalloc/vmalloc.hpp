@@ -1,13 +1,49 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <numa.h>
+#include <optional>
+#include <vector>
 
 #include "VamPointer.hpp"
+#include "VamPool.hpp"
 #include "VamProphecy.hpp"
 #include "vmalloc_defs.hpp"
 
 namespace vampir {
 
+/// @brief Release hook of vmalloc'ed memory: returns the bytes of all parts of
+/// the allocation to mem_usage.
+inline void release_accounted(const AllocationInfo &info) {
+  for (const auto &[node, bytes] : info.node_bytes())
+    mem_usage.remove(node, bytes);
+}
+
+/// @brief Adds the allocation to mem_usage and registers release_accounted.
+template <typename base_t, std::size_t segment_size_bytes>
+VamPointer<base_t, segment_size_bytes>
+account(VamPointer<base_t, segment_size_bytes> ptr) {
+  AllocationInfo *info = ptr.allocation_info();
+  if (info == nullptr)
+    return ptr;
+  for (const auto &[node, bytes] : info->node_bytes())
+    mem_usage.add(node, bytes);
+  info->release_hook = release_accounted;
+  return ptr;
+}
+
+/// @brief Records the access pattern of the allocation (see
+/// VamPointer::access_pattern).
+template <typename base_t, std::size_t segment_size_bytes>
+VamPointer<base_t, segment_size_bytes>
+with_pattern(VamPointer<base_t, segment_size_bytes> ptr,
+             AccessPattern pattern) {
+  if (AllocationInfo *info = ptr.allocation_info())
+    info->pattern = pattern;
+  return ptr;
+}
+
 /**
  * @brief Allocate a VamPointer on the default NUMA node 0.
  *
@@ -24,7 +60,10 @@ VamPointer<base_t, segment_size_bytes> vmalloc(std::size_t size_elem) {
   DEBUG_VAMPPH(
       "vmalloc called without access pattern; allocating on default NUMA node: "
       << node);
-  return VamPointer<base_t, segment_size_bytes>(size_elem, node);
+  if (VamArena *arena = VamArena::current())
+    return account(arena->allocate<base_t, segment_size_bytes>(
+        size_elem, node, K4_Normal));
+  return account(VamPointer<base_t, segment_size_bytes>(size_elem, node));
 }
 
 /**
@@ -36,17 +75,130 @@ VamPointer<base_t, segment_size_bytes> vmalloc(std::size_t size_elem) {
  * 4096).
  * @param size_elem The number of elements to allocate.
  * @param pattern The access pattern used for NUMA node prediction.
+ * @param ptype The page type (see VamPointer::VamPointer).
+ * @param zero_on_reuse Whether memory reused from the pool of an active
+ * VamArena is zeroed (serially, here). Pass false for intermediates that are
+ * fully overwritten, or that are cleared per sliver with clear_dirty.
  * @return VamPointer<base_t, segment_size_bytes> The allocated VamPointer.
  */
 template <typename base_t, std::size_t segment_size_bytes = 4096>
-VamPointer<base_t, segment_size_bytes> vmalloc(std::size_t size_elem,
-                                               AccessPattern pattern) {
+VamPointer<base_t, segment_size_bytes>
+vmalloc(std::size_t size_elem, AccessPattern pattern,
+        PageType ptype = K4_Normal, bool zero_on_reuse = true) {
   // #### MODIFY: change prediction strategy in VamProphecy if needed
-  NumaId node = VamProphecy::predict(pattern);
+  NumaId node = VamProphecy::predict(pattern, size_elem * sizeof(base_t));
   // #### end MODIFY
   DEBUG_VAMPPH("vmalloc: access pattern " << access_pattern_to_string(pattern)
                                           << "; predicted NUMA node " << node);
-  return VamPointer<base_t, segment_size_bytes>(size_elem, node);
+  if (VamArena *arena = VamArena::current())
+    return account(with_pattern(
+        arena->allocate<base_t, segment_size_bytes>(size_elem, node, ptype,
+                                                    zero_on_reuse),
+        pattern));
+  return account(with_pattern(
+      VamPointer<base_t, segment_size_bytes>(size_elem, node, ptype),
+      pattern));
+}
+
+/**
+ * @brief Predicts the NUMA node of every sliver of sliver_cpus.size()
+ * slivers of size_bytes: sliver i goes to the node predicted for access
+ * pattern from CPU sliver_cpus[i] (see vmalloc).
+ */
+inline std::vector<NumaId>
+predict_sliver_nodes(std::size_t size_bytes, AccessPattern pattern,
+                     const std::vector<int> &sliver_cpus,
+                     std::optional<Memory> preferred = std::nullopt) {
+  std::vector<NumaId> sliver_nodes;
+  sliver_nodes.reserve(sliver_cpus.size());
+  const std::size_t sliver_bytes =
+      size_bytes / std::max<std::size_t>(sliver_cpus.size(), 1);
+  for (int cpu : sliver_cpus) {
+    // #### MODIFY: change prediction strategy in VamProphecy if needed
+    NumaId node =
+        preferred ? VamProphecy::predict(*preferred, pattern, cpu, sliver_bytes)
+                  : VamProphecy::predict(pattern, cpu, sliver_bytes);
+    // #### end MODIFY
+    sliver_nodes.push_back(node);
+    // count the sliver right away, so the next slivers see its usage
+    mem_usage.add(node, sliver_bytes);
+  }
+  for (NumaId node : sliver_nodes)
+    mem_usage.remove(node, sliver_bytes);
+  return sliver_nodes;
+}
+
+/**
+ * @brief Allocate a VamPointer whose slivers are placed on the NUMA node local
+ * to the thread that will process them. Sliver i of split(sliver_cpus.size())
+ * is placed on the node predicted for access pattern from CPU sliver_cpus[i].
+ *
+ * @tparam base_t The base type of the elements to allocate.
+ * @tparam segment_size_bytes The size of each segment in bytes (default is
+ * 4096).
+ * @param size_elem The number of elements to allocate.
+ * @param pattern The access pattern used for NUMA node prediction.
+ * @param sliver_cpus CPU id of the consuming thread of each sliver (see
+ * get_cpu_ids).
+ * @param ptype The page type (see VamPointer::VamPointer).
+ * @param preferred Memory type to place the slivers on (spills to the other
+ * type when full), by default the one predicted for the access pattern.
+ * @return VamPointer<base_t, segment_size_bytes> The allocated VamPointer.
+ */
+template <typename base_t, std::size_t segment_size_bytes = 4096>
+VamPointer<base_t, segment_size_bytes>
+vmalloc(std::size_t size_elem, AccessPattern pattern,
+        const std::vector<int> &sliver_cpus, PageType ptype = K4_Normal,
+        std::optional<Memory> preferred = std::nullopt) {
+  const std::vector<NumaId> sliver_nodes = predict_sliver_nodes(
+      size_elem * sizeof(base_t), pattern, sliver_cpus, preferred);
+  DEBUG_VAMPPH("vmalloc: access pattern " << access_pattern_to_string(pattern)
+                                          << "; placing "
+                                          << sliver_nodes.size()
+                                          << " slivers");
+  return account(with_pattern(
+      VamPointer<base_t, segment_size_bytes>(size_elem, sliver_nodes, ptype),
+      pattern));
+}
+
+/**
+ * @brief Faults in all pages of a (sliver of a) VamPointer without changing
+ * its content. Meant to be run by a thread group over SplitWrapper'ed
+ * slivers, pinned like the group that will consume them (see
+ * ThreadManager::pin_threads_like), so the page faults are taken before and
+ * outside of the timed region.
+ */
+template <typename base_t, std::size_t segment_size_bytes>
+void prefault(VamPointer<base_t, segment_size_bytes> sliver) {
+  if (sliver.size() == 0)
+    return;
+
+  volatile char *bytes = reinterpret_cast<volatile char *>(sliver.data(0));
+  const std::size_t size_bytes = sliver.size() * sizeof(base_t);
+  // one touch per base page (also faults in every huge page)
+  const std::size_t page_size = 4096;
+  for (std::size_t i = 0; i < size_bytes; i += page_size)
+    bytes[i] = bytes[i];
+}
+
+/**
+ * @brief Zeroes the part of a (sliver of a) VamPointer that may still hold
+ * data of an earlier user of its memory (allocated with zero_on_reuse false,
+ * see AllocationInfo::dirty_bytes). Fresh memory is zero already and is not
+ * touched. Meant to be run like prefault, by the threads that use the
+ * slivers.
+ */
+template <typename base_t, std::size_t segment_size_bytes>
+void clear_dirty(VamPointer<base_t, segment_size_bytes> sliver) {
+  const AllocationInfo *info = sliver.allocation_info();
+  if (info == nullptr || sliver.size() == 0)
+    return;
+
+  char *begin = reinterpret_cast<char *>(sliver.data(0));
+  char *dirty_end = static_cast<char *>(info->data) + info->dirty_bytes;
+  char *end = std::min(begin + sliver.size() * sizeof(base_t), dirty_end);
+  if (begin < end)
+    std::memset(begin, 0, end - begin);
 }
 
 } // namespace vampir
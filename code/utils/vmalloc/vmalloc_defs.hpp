@@ -8,17 +8,21 @@ namespace vampir {
 
 using NumaId = int;
 
-enum class AccessPattern { LINEAR, RANDOM };
+/// STREAM_WRITE: written once (linearly) and read once by the next stage,
+/// kernels write it with non-temporal stores (see stream_store.hpp)
+enum class AccessPattern { LINEAR, RANDOM, STREAM_WRITE };
 
 static AccessPattern access_pattern_from_string(const std::string &str) {
 	if (str == "LINEAR") return AccessPattern::LINEAR;
 	else if (str == "RANDOM") return AccessPattern::RANDOM;
+	else if (str == "STREAM_WRITE") return AccessPattern::STREAM_WRITE;
 	else { throw std::invalid_argument("Unknown access pattern: " + str); }
 }
 
 static std::string access_pattern_to_string(AccessPattern pattern) {
 	if (pattern == AccessPattern::LINEAR) return "LINEAR";
 	else if (pattern == AccessPattern::RANDOM) return "RANDOM";
+	else if (pattern == AccessPattern::STREAM_WRITE) return "STREAM_WRITE";
 	else {
 		throw std::invalid_argument(
 		    "No string representation for access pattern: " + std::to_string(static_cast<int>(pattern)));
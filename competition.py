@@ -1,10 +1,13 @@
 #!/usr/bin/env python3
 
+import json
 import os
 from glob import glob
 from dataclasses import dataclass
 
 glob_file_name = "my_results"
+# written next to my_results by `./run.sh ROOFLINE=ON` (see code/roofline.hpp)
+roofline_file_name = "my_roofline.json"
 directory_patterns = [
     "/home/*/*",
     "/home/*",
@@ -13,6 +16,16 @@ def get_user(file_name):
     # assumes a /home/<user>/... file_name pattern
     return file_name.split("/")[2]
 
+def get_roof_fraction(file_name):
+    # fraction of the calibrated memory bandwidth the query reached, None
+    # without a roofline report next to the results file
+    path = os.path.join(os.path.dirname(file_name), roofline_file_name)
+    try:
+        with open(path, "r") as file:
+            return float(json.load(file)["query"]["fraction_of_roof"])
+    except (OSError, ValueError, KeyError, TypeError):
+        return None
+
 def get_file_names():
     return [ # flatten the files from all the directory_patterns
         file_name
@@ -30,6 +43,10 @@ class Results:
     safe_result: int
     inner_throughput: float
     outer_throughput: float
+    roof_fraction: float = None
+    # relative tolerance of a sampled checksum ("<sum> ~<tolerance>"), 0 for
+    # an exact one
+    safe_tolerance: float = 0.0
 
     def from_file_name(file_name):
         user = get_user(file_name)
@@ -37,12 +54,15 @@ class Results:
             lines = filter(len, file.read().split("\n"))
             try:
                 fast_result, safe_result, inner_throughput, outer_throughput = lines
+                safe_result, _, safe_tolerance = safe_result.partition(" ~")
                 return Results(
                     user,
                     int(fast_result),
                     int(safe_result),
                     float(inner_throughput),
                     float(outer_throughput),
+                    get_roof_fraction(file_name),
+                    float(safe_tolerance or 0),
                 )
             except Exception as e:
                 print(f"could not read results file\n  {file_name!r}\n  {e!r}")
@@ -77,8 +97,23 @@ class Results:
             if format
         )
 
+    def format_roof(self):
+        if self.roof_fraction is None:
+            return "       -"
+        return f"{self.roof_fraction:8.1%}"
+
+    def sampled(self):
+        return self.safe_tolerance > 0
+
     def correct(self):
-        return self.fast_result == self.safe_result
+        # the tolerance of a sampled checksum is written by the participant,
+        # only an exact checksum validates a result here
+        return not self.sampled() and self.fast_result == self.safe_result
+
+    def check_mark(self):
+        if self.sampled():
+            return " ?? " # not verified (sampled checksum)
+        return " :) " if self.correct() else " :( "
 
 def get_table(file_names):
     return [
@@ -90,15 +125,15 @@ def main():
     table = get_table(get_file_names())
     check = " ok "
     result = Results("user", "fast", "safe", "throughput", "")
-    print(    f"{check}{result:20,,,>14,}")
+    print(    f"{check}{result:20,,,>14,}{'of roof':>9}")
+    # unverified (sampled) results are listed after all verified ones
     sorted_table = sorted(
         table,
-        key = lambda result: result.outer_throughput,
+        key = lambda result: (not result.sampled(), result.outer_throughput),
         reverse = True,
     )
     for result in sorted_table:
-        check = " :) " if result.correct() else " :( "
-        print(f"{check}{result:20,,, 8.3fG,}")
+        print(f"{result.check_mark()}{result:20,,, 8.3fG,} {result.format_roof()}")
 
 if __name__ == "__main__":
     main()
@@ -3,6 +3,7 @@
 target="simdops_query"
 testing="ON"
 build_type="ON"
+roofline="OFF"
 
 for arg in "$@"; do
     case "$arg" in
@@ -15,6 +16,11 @@ for arg in "$@"; do
             build_type="${arg#BUILD_TYPE=}"
             ;;
     esac
+    case "$arg" in
+        ROOFLINE=ON|ROOFLINE=OFF)
+            roofline="${arg#ROOFLINE=}"
+            ;;
+    esac
 done
 
 set -e
@@ -22,6 +28,12 @@ set -e
 echo "Target:  $target"
 echo "Testing: $testing"
 echo "Build type: $build_type"
+echo "Roofline: $roofline"
+
+# performance model report next to my_results (see code/roofline.hpp)
+if [ "$roofline" = "ON" ]; then
+    export ROOFLINE_JSON="$PWD/my_roofline.json"
+fi
 
 touch cmake_output.txt
 cmake -DTESTING="$testing" -DCMAKE_BUILD_TYPE="$build_type" . > cmake_output.txt 2>&1